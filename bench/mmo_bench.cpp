@@ -0,0 +1,536 @@
+/*************************************************\
+* @file   : mmo_bench.cpp
+*           复杂对象--线性映射库--基准测试
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include "mmo_segment.h"
+#include "mmo_image.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * 用法：bench [最大对象数] [重复次数]
+ *   对象数从 1000 起按 10 倍递增到最大对象数（默认 1000000，最大可到 10000000），
+ *   每项计时重复多次取中位数。数据由固定种子生成，同一机器、同一编译选项下多次运行结果可直接对比。
+ *
+ * 输出为制表符分隔的表格，每行一个指标：
+ *   metric  count  mmo  baseline  unit
+ * baseline 一列：构造、查找、遍历对应 std::vector / std::unordered_map，
+ * 镜像字节数与首次访问对应一种 varint 编码的序列化格式（类 protobuf，读取前需完整解码）。
+ */
+
+class Point2D
+{
+public:
+  Point2D(){}
+  Point2D(int32_t a,int32_t b){x=a;y=b;}
+public:
+  int32_t   x{0};
+  int32_t   y{0};
+};
+
+/**
+ * @brief 生成测试数据的原始道路，也是 std 容器基线中的对象
+ */
+class SRoad
+{
+public:
+  uint64_t              id{0};
+  std::string           name;
+  std::vector<Point2D>  coors;
+  uint32_t              length{0};
+};
+
+class SRoadMap
+{
+public:
+  std::vector<SRoad>                    roads;
+  std::unordered_map<uint64_t,int32_t>  id_index;
+  std::vector<uint32_t>                 lengths;
+public:
+  void  build(const std::vector<SRoad>& src)
+  {
+    roads = src;
+    id_index.reserve(src.size());
+    lengths.reserve(src.size());
+    for(size_t i = 0;i < src.size();i++)
+    {
+      id_index.emplace(src[i].id,(int32_t)i);
+      lengths.push_back(src[i].length);
+    }
+  }
+};
+
+typedef mmo::hash_map<uint64_t,int32_t,int32_t> RoadIdIndex;
+class BRoad
+{
+protected:
+  uint64_t                          m_id{0};
+  mmo::string<int32_t>              m_name;
+  mmo::vector<Point2D,int32_t>      m_coors;
+  uint32_t                          m_length{0};
+public:
+  BRoad(){}
+public:
+  uint64_t                              get_id()const{return m_id;}
+  const mmo::string<int32_t>&           get_name()const{return m_name;}
+  const mmo::vector<Point2D,int32_t>&   get_coors()const{return m_coors;}
+  uint32_t                              get_length()const{return m_length;}
+public:
+  void init(const SRoad& src,mmo::segment_manager& segment)
+  {
+    m_id      = src.id;
+    m_length  = src.length;
+    m_name.assign(src.name,segment);
+    m_coors.assign(src.coors,segment);
+  }
+};
+
+class BRoadMap
+{
+protected:
+  mmo::indexed_var_vector<BRoad,int32_t>  m_roads;
+  RoadIdIndex                             m_id_index;
+  mmo::vector<uint32_t,int32_t>           m_lengths;
+public:
+  BRoadMap(){}
+public:
+  const mmo::indexed_var_vector<BRoad,int32_t>& roads()const{return m_roads;}
+  const RoadIdIndex&                            id_index()const{return m_id_index;}
+  const mmo::vector<uint32_t,int32_t>&          lengths()const{return m_lengths;}
+public:
+  void init(const std::vector<SRoad>& src,mmo::segment_manager& segment)
+  {
+    m_roads.prepare_append_elements(segment);
+    for(auto& road:src)
+    {
+      auto element = m_roads.begin_append_element(segment);
+      element->object().init(road,segment);
+      m_roads.end_append_element(element,segment);
+    }
+    m_roads.finish_append_elements(segment);
+
+    m_id_index.init_hash((int32_t)src.size(),segment);
+    for(size_t i = 0;i < src.size();i++)
+      m_id_index.add(src[i].id,(int32_t)i,segment);
+
+    m_lengths.resize((int32_t)src.size(),segment);
+    if(!segment.measuring())
+    {
+      for(size_t i = 0;i < src.size();i++)
+        m_lengths[(int32_t)i] = src[i].length;
+    }
+  }
+};
+
+/**
+ * @brief 序列化基线：varint 编码，坐标按差分 zigzag 编码，解码时重建全部对象与索引
+ */
+class codec
+{
+public:
+  static void  encode(const std::vector<SRoad>& roads,std::string& out)
+  {
+    out.clear();
+    put_varint(out,roads.size());
+    for(auto& road:roads)
+    {
+      put_varint(out,road.id);
+      put_varint(out,road.name.size());
+      out.append(road.name);
+      put_varint(out,road.coors.size());
+      int32_t x = 0,y = 0;
+      for(auto& pt:road.coors)
+      {
+        put_varint(out,zigzag(pt.x - x));
+        put_varint(out,zigzag(pt.y - y));
+        x = pt.x;
+        y = pt.y;
+      }
+      put_varint(out,road.length);
+    }
+  }
+  static bool  decode(const char* data,size_t size,SRoadMap& dst)
+  {
+    const uint8_t* p    = (const uint8_t*)data;
+    const uint8_t* end  = p + size;
+    uint64_t count = 0;
+    if(!get_varint(p,end,count))
+      return false;
+    dst.roads.resize(count);
+    dst.id_index.reserve(count);
+    dst.lengths.resize(count);
+    for(uint64_t i = 0;i < count;i++)
+    {
+      SRoad& road = dst.roads[i];
+      uint64_t value = 0;
+      if(!get_varint(p,end,road.id) || !get_varint(p,end,value) || (uint64_t)(end - p) < value)
+        return false;
+      road.name.assign((const char*)p,value);
+      p += value;
+      if(!get_varint(p,end,value))
+        return false;
+      road.coors.resize(value);
+      int32_t x = 0,y = 0;
+      for(auto& pt:road.coors)
+      {
+        uint64_t dx = 0,dy = 0;
+        if(!get_varint(p,end,dx) || !get_varint(p,end,dy))
+          return false;
+        pt.x = x = x + unzigzag(dx);
+        pt.y = y = y + unzigzag(dy);
+      }
+      if(!get_varint(p,end,value))
+        return false;
+      road.length       = (uint32_t)value;
+      dst.lengths[i]    = road.length;
+      dst.id_index.emplace(road.id,(int32_t)i);
+    }
+    return p == end;
+  }
+protected:
+  static uint64_t zigzag(int32_t v){return ((uint64_t)(uint32_t)v << 1) ^ (uint64_t)(int64_t)(v >> 31);}
+  static int32_t  unzigzag(uint64_t v){return (int32_t)((uint32_t)(v >> 1) ^ (uint32_t)-(int32_t)(v & 1));}
+  static void     put_varint(std::string& out,uint64_t v)
+  {
+    while(v >= 0x80)
+    {
+      out.push_back((char)(v | 0x80));
+      v >>= 7;
+    }
+    out.push_back((char)v);
+  }
+  static bool     get_varint(const uint8_t*& p,const uint8_t* end,uint64_t& v)
+  {
+    v = 0;
+    for(int shift = 0;p < end && shift < 64;shift += 7)
+    {
+      uint8_t b = *p++;
+      v |= (uint64_t)(b & 0x7f) << shift;
+      if((b & 0x80) == 0)
+        return true;
+    }
+    return false;
+  }
+};
+
+class bench
+{
+public:
+  typedef std::chrono::steady_clock clock;
+protected:
+  int                   m_repeat{5};
+  std::string           m_path;
+  volatile uint64_t     m_sink{0};   //保存计算结果，防止被编译器优化掉
+public:
+  bench(int repeat,const std::string& path):
+    m_repeat(repeat),
+    m_path(path)
+  {
+  }
+public:
+  /**
+   * @brief 重复执行 run 并返回耗时的中位数（纳秒），每次执行前调用 setup（不计时）
+   */
+  double  median_ns(const std::function<uint64_t()>& run,const std::function<void()>& setup = nullptr)
+  {
+    std::vector<double> samples;
+    for(int i = 0;i < m_repeat;i++)
+    {
+      if(setup)
+        setup();
+      auto begin = clock::now();
+      m_sink = m_sink + run();
+      samples.push_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - begin).count());
+    }
+    std::sort(samples.begin(),samples.end());
+    return samples[samples.size() / 2];
+  }
+  /**
+   * @brief 输出一行指标，值为负表示该列不适用，输出 "-"
+   */
+  static void row(const char* metric,size_t count,double mmo_value,double base_value,const char* unit)
+  {
+    printf("%s\t%zu\t",metric,count);
+    for(double value:{mmo_value,base_value})
+    {
+      if(value < 0)
+        printf("-\t");
+      else
+        printf("%.3f\t",value);
+    }
+    printf("%s\n",unit);
+  }
+  /**
+   * @brief 生成 count 条道路，id 互不相同、顺序打乱，另生成同样多个不存在的 id 用于未命中查找
+   */
+  static void generate(size_t count,uint64_t seed,std::vector<SRoad>& roads,std::vector<uint64_t>& misses)
+  {
+    std::mt19937_64 rand(seed);
+    const uint64_t mix = 0x9e3779b97f4a7c15ULL;  //奇数，乘法在 2^64 下为双射，保证 id 不重复
+    roads.resize(count);
+    misses.resize(count);
+    for(size_t i = 0;i < count;i++)
+    {
+      SRoad& road = roads[i];
+      road.id     = (uint64_t)(i + 1) * mix;
+      road.name   = "road_" + std::to_string(i + 1);
+      int32_t x   = (int32_t)(rand() % 1000000);
+      int32_t y   = (int32_t)(rand() % 1000000);
+      size_t points = 2 + rand() % 8;
+      road.coors.reserve(points);
+      for(size_t j = 0;j < points;j++)
+      {
+        x += (int32_t)(rand() % 200) - 100;
+        y += (int32_t)(rand() % 200) - 100;
+        road.coors.emplace_back(x,y);
+        road.length += (uint32_t)(rand() % 500);
+      }
+      misses[i] = (uint64_t)(count + i + 1) * mix;
+    }
+  }
+  void    run(size_t count,uint64_t seed)
+  {
+    std::vector<SRoad>    roads;
+    std::vector<uint64_t> misses;
+    generate(count,seed,roads,misses);
+
+    std::vector<uint64_t> hits(count);
+    for(size_t i = 0;i < count;i++)
+      hits[i] = roads[i].id;
+    std::shuffle(hits.begin(),hits.end(),std::mt19937_64(seed + 1));
+
+    //构造，完成后保存镜像并释放内存段，之后的读取都通过映射文件进行，与实际使用方式一致
+    //各阶段结束即释放不再使用的数据，1000 万对象时峰值内存约为源数据加一份 std 容器
+    size_t image_bytes = 0;
+    double mmo_build   = 0;
+    {
+      mmo::growable_segment segment((size_t)1 << 36);
+      BRoadMap* map = NULL;
+      mmo_build = median_ns([&]()
+      {
+        map = mmo::construct<BRoadMap>(segment);
+        map->init(roads,segment);
+        return (uint64_t)segment.size();
+      },[&](){segment.clear();});
+      image_bytes = segment.size();
+      mmo::save_image(m_path,segment,map);
+    }
+
+    std::string encoded_path = m_path + ".enc";
+    size_t encoded_bytes = 0;
+    double encode        = 0;
+    {
+      std::string encoded;
+      encode = median_ns([&]()
+      {
+        codec::encode(roads,encoded);
+        return (uint64_t)encoded.size();
+      });
+      encoded_bytes = encoded.size();
+      write_file(encoded_path,encoded);
+    }
+
+    SRoadMap std_map;
+    double std_build = median_ns([&]()
+    {
+      std_map.build(roads);
+      return (uint64_t)std_map.roads.size();
+    },[&](){std_map = SRoadMap();});
+    roads.clear();
+    roads.shrink_to_fit();
+
+    row("build_throughput",count,count * 1e3 / mmo_build,count * 1e3 / std_build,"Mobj/s");
+    row("encode_throughput",count,-1,count * 1e3 / encode,"Mobj/s");
+    row("image_bytes",count,(double)image_bytes,(double)encoded_bytes,"bytes");
+
+    mmo::mapped_image image(m_path);
+    const BRoadMap* map = image.root<BRoadMap>();
+
+    //hash 查找
+    const RoadIdIndex& index = map->id_index();
+    row("hash_hit",count,
+      median_ns([&](){return lookup(index,hits);}) / count,
+      median_ns([&](){return lookup(std_map.id_index,hits);}) / count,
+      "ns/op");
+    row("hash_miss",count,
+      median_ns([&](){return lookup(index,misses);}) / count,
+      median_ns([&](){return lookup(std_map.id_index,misses);}) / count,
+      "ns/op");
+
+    //遍历所有道路的所有坐标
+    row("var_vector_iterate",count,
+      median_ns([&]()
+      {
+        uint64_t sum = 0;
+        for(auto it = map->roads().begin();it != map->roads().end();++it)
+        {
+          const mmo::vector<Point2D,int32_t>& coors = (*it).get_coors();
+          for(int32_t i = 0;i < coors.size();i++)
+            sum += (uint32_t)(coors[i].x + coors[i].y);
+        }
+        return sum;
+      }) / count,
+      median_ns([&]()
+      {
+        uint64_t sum = 0;
+        for(auto& road:std_map.roads)
+        {
+          for(auto& pt:road.coors)
+            sum += (uint32_t)(pt.x + pt.y);
+        }
+        return sum;
+      }) / count,
+      "ns/obj");
+
+    //顺序扫描定长数组
+    row("vector_scan",count,
+      median_ns([&]()
+      {
+        const mmo::vector<uint32_t,int32_t>& lengths = map->lengths();
+        uint64_t sum = 0;
+        for(int32_t i = 0;i < lengths.size();i++)
+          sum += lengths[i];
+        return sum;
+      }) / count,
+      median_ns([&]()
+      {
+        uint64_t sum = 0;
+        for(auto length:std_map.lengths)
+          sum += length;
+        return sum;
+      }) / count,
+      "ns/elem");
+    image.close();
+    std_map = SRoadMap();
+
+    //首次访问：从打开文件到读出中间一条道路的名字，计时前把文件逐出页缓存
+    //mmo 只映射文件、按需读入访问到的页；序列化基线需读入整个文件并解码出全部对象
+    size_t middle = count / 2;
+    double mmo_first = median_ns([&]()
+    {
+      mmo::mapped_image first(m_path);
+      const BRoadMap* root = first.root<BRoadMap>();
+      return (uint64_t)root->roads()[(int32_t)middle].get_name()[0];
+    },[&](){evict(m_path);});
+    double decode_first = median_ns([&]()
+    {
+      std::string data;
+      read_file(encoded_path,data);
+      SRoadMap decoded;
+      if(!codec::decode(data.data(),data.size(),decoded))
+        throw mmo::mmo_exception((int32_t)mmo::mmo_exception::invalid_image,"mmo_bench:: decode failed!");
+      return (uint64_t)decoded.roads[middle].name[0];
+    },[&](){evict(encoded_path);});
+    row("first_access",count,mmo_first / 1e3,decode_first / 1e3,"us");
+    unlink(encoded_path.c_str());
+    unlink(m_path.c_str());
+    fflush(stdout);
+  }
+protected:
+  static uint64_t lookup(const RoadIdIndex& index,const std::vector<uint64_t>& keys)
+  {
+    uint64_t found = 0;
+    for(auto key:keys)
+    {
+      const int32_t* value = index.get(key);
+      if(value != NULL)
+        found += (uint64_t)*value + 1;
+    }
+    return found;
+  }
+  static uint64_t lookup(const std::unordered_map<uint64_t,int32_t>& index,const std::vector<uint64_t>& keys)
+  {
+    uint64_t found = 0;
+    for(auto key:keys)
+    {
+      auto it = index.find(key);
+      if(it != index.end())
+        found += (uint64_t)it->second + 1;
+    }
+    return found;
+  }
+  /**
+   * @brief 落盘后把文件逐出页缓存，使首次访问的计时包含真实的读盘开销
+   */
+  static void     evict(const std::string& path)
+  {
+    int fd = ::open(path.c_str(),O_RDONLY);
+    if(fd < 0)
+      return;
+    fdatasync(fd);
+    posix_fadvise(fd,0,0,POSIX_FADV_DONTNEED);
+    ::close(fd);
+  }
+  static void     write_file(const std::string& path,const std::string& data)
+  {
+    FILE* fp = fopen(path.c_str(),"wb");
+    bool ok = fp != NULL && fwrite(data.data(),1,data.size(),fp) == data.size();
+    if(fp != NULL)
+      ok = (fclose(fp) == 0) && ok;
+    if(!ok)
+      throw mmo::mmo_exception((int32_t)mmo::mmo_exception::io_error,"mmo_bench:: write file failed:" + path);
+  }
+  static void     read_file(const std::string& path,std::string& data)
+  {
+    FILE* fp = fopen(path.c_str(),"rb");
+    if(fp == NULL)
+      throw mmo::mmo_exception((int32_t)mmo::mmo_exception::io_error,"mmo_bench:: open file failed:" + path);
+    fseek(fp,0,SEEK_END);
+    data.resize((size_t)ftell(fp));
+    fseek(fp,0,SEEK_SET);
+    bool ok = data.empty() || fread(&data[0],1,data.size(),fp) == data.size();
+    fclose(fp);
+    if(!ok)
+      throw mmo::mmo_exception((int32_t)mmo::mmo_exception::io_error,"mmo_bench:: read file failed:" + path);
+  }
+};
+
+int main(int argc,char* argv[])
+{
+  size_t    max_count = 1000000;
+  int       repeat    = 5;
+  uint64_t  seed      = 20261016;
+  if(argc > 1)
+    max_count = (size_t)strtoull(argv[1],NULL,10);
+  if(argc > 2)
+    repeat = atoi(argv[2]);
+  if(max_count < 1000 || max_count > 10000000 || repeat < 1)
+  {
+    fprintf(stderr,"用法: %s [最大对象数 1000-10000000] [重复次数]\n",argv[0]);
+    return 1;
+  }
+
+#ifdef MMO_ALIGNED_LAYOUT
+  const char* layout = "aligned";
+#else
+  const char* layout = "packed";
+#endif
+  printf("# mmo bench: layout=%s compiler=%s seed=%llu repeat=%d\n",layout,__VERSION__,(unsigned long long)seed,repeat);
+  printf("metric\tcount\tmmo\tbaseline\tunit\n");
+  try
+  {
+    bench b(repeat,"bench.dat");
+    for(size_t count = 1000;count <= max_count;count *= 10)
+      b.run(count,seed);
+  }
+  catch(const mmo::mmo_exception& e)
+  {
+    fprintf(stderr,"%s\n",e.what());
+    return 1;
+  }
+  return 0;
+}
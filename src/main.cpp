@@ -1,6 +1,16 @@
 
 
+//demo 的 report 命令按用途给出字节分布，需要容器分配带用途标记
+#ifndef MMO_ALLOC_TRACKING
+#define MMO_ALLOC_TRACKING
+#endif
 #include "mmo_lib.h"
+#include "mmo_segment.h"
+#include "mmo_image.h"
+#include "mmo_rtree.h"
+#include "mmo_schema.h"
+#include "mmo_verify.h"
+#include "mmo_report.h"
 #include <string>
 #include <stdio.h>
 #include <cstring> 
@@ -17,8 +27,10 @@ public:
   int32_t   x{0};
   int32_t   y{0};
 };
+MMO_PLAIN_DATA(Point2D)
 typedef mmo::offset_ptr<mmo::string<int16_t>,int16_t> PString;
 typedef mmo::hash_map<int32_t,PString,int16_t> LabelMap;
+typedef mmo::packed_rtree<int16_t,int16_t>      RoadIndex;
 class CRoad
 {
 protected:
@@ -26,6 +38,7 @@ protected:
   mmo::string<int16_t>             m_name; 
   mmo::vector<Point2D,int16_t>     m_coors;
   LabelMap                         m_labels;
+  MMO_SCHEMA(CRoad,m_id,m_name,m_coors,m_labels)
 public:
   CRoad()
   {
@@ -47,13 +60,16 @@ public:
     m_labels.init_hash(count,segment);    
     for(int i=0;i<count;i++)
     {
-      PString ss = mmo::construct<mmo::string<int16_t>>(segment);
+      //偏移指针只能存放在段内，不能在栈上中转，否则栈与段的距离会超出 int16_t
+      mmo::string<int16_t>* ss = mmo::construct<mmo::string<int16_t>>(segment);
       ss->assign(std::to_string(id)+"_label_"+std::to_string(i+1),segment);       
-      m_labels.add(i+100,ss,segment);
+      LabelMap::iresult ret = m_labels.insert(i+100,PString(),segment);
+      if(ret.pvalue != NULL)
+        ret.pvalue->value = ss;
     }
   }
 
-  void print()
+  void print()const
   {
     printf("id= %ld\r\nname=%s\r\n",get_id(),get_name());
     for(int i=0;i<get_coors_size();i++)
@@ -67,7 +83,7 @@ public:
       printf("label = {%d , %s}\r\n",it.node->key,(*it)->c_str());
     }
   }
-  void show_label(int32_t label_id)
+  void show_label(int32_t label_id)const
   {
     printf("show_label[%d] : %s\r\n",
       label_id,
@@ -79,12 +95,15 @@ class CRoadMap
 {
 protected:
   int m_count{0};
-  mmo::var_vector<CRoad,int16_t>  m_road_map;
+  mmo::indexed_var_vector<CRoad,int16_t>  m_road_map;
+  RoadIndex                               m_road_index;   //道路外包矩形的空间索引，值为道路下标
 public:
   CRoadMap(){}
   void init(int count,mmo::segment_manager& segment)
   {
     m_count=count;
+    std::vector<std::pair<RoadIndex::BoxType,int16_t>> boxes;
+    MMO_ALLOC_SITE("CRoadMap::m_road_map");
     m_road_map.prepare_append_elements(segment);
     for (int i = 0; i < m_count; i++)
     {
@@ -96,10 +115,22 @@ public:
 
       element->object().init(i+1,"road_"+std::to_string(i+1),coors,segment);
 
+      RoadIndex::BoxType box;
+      for(auto& pt:coors)
+        box.expand(pt.x,pt.y);
+      boxes.emplace_back(box,(int16_t)i);
+
       m_road_map.end_append_element(element,segment);
     }
+    m_road_map.finish_append_elements(segment);
+    MMO_ALLOC_SITE("CRoadMap::m_road_index");
+    m_road_index.build(boxes,segment);
+  }
+  bool mmo_verify(mmo::verifier& verify)const
+  {
+    return verify(m_road_map) && verify(m_road_index);
   }
-  void print()
+  void print()const
   {
     printf("road_count=%d\n",m_count);
     
@@ -112,56 +143,77 @@ public:
       (*it).show_label(101);
 
     }
+    printf("=====================\r\n");
+    RoadIndex::BoxType view(15,35,25,45);
+    m_road_index.query(view,[this](const int16_t& index)
+    {
+      printf("in view [15,35,25,45] : %s\r\n",m_road_map[index].get_name());
+      return true;
+    });
+    m_road_index.nearest(0,0,[this](const int16_t& index,double)
+    {
+      printf("nearest to [0,0] : %s\r\n",m_road_map[index].get_name());
+      return false;
+    });
   }
 
 };
 
 void save()
 {
-  //预分配内存
-  char buf[2048];
-  mmo::segment_manager segment(buf,sizeof(buf));
+  //先试运行一遍，得到精确的内存大小
+  size_t bytes = mmo::measure([](mmo::segment_manager& segment)
+  {
+    mmo::construct<CRoadMap>(segment)->init(3,segment);
+  });
+
+  //按精确大小一次性分配内存
+  std::vector<char> buf(bytes);
+  mmo::segment_manager segment(buf.data(),buf.size());
  
   //构造RoadMap
   CRoadMap* pRoadMap = mmo::construct<CRoadMap>(segment);
   //构造3个对象
   pRoadMap->init(3,segment);
+  printf("image bytes=%zu\n",segment.size());
   
   //调用 对象的方法，输出构造的信息，用于后续的验证
   pRoadMap->print();
 
   //保存到文件
-  FILE* fp = fopen("1.dat","wb");
-  if(fp)
-  {
-    fwrite(segment.data(),segment.size(),1,fp);
-    fclose(fp);
-  }  
+  mmo::save_image("1.dat",segment,pRoadMap);
 }
 
 void load()
 {
-  //读取文件内容
-  FILE* fp = fopen("1.dat","rb");
-  if(fp==nullptr)
-    return;    
-  char buf[1024];
-  fread(buf,sizeof(buf),1,fp);
-  fclose(fp);
+  //只读映射文件，不读取、不拷贝
+  mmo::mapped_image image("1.dat");
 
   //无需进行数据到对象的序列化操作，可直接映射成对象使用
-  CRoadMap* pRoadMap = (CRoadMap*)buf;
+  //先校验镜像中所有偏移都未越界，文件被截断或损坏时抛出异常而不是越界读
+  const CRoadMap* pRoadMap = mmo::verified_root<CRoadMap>(image);
 
   //调用 映射的对象的方法，验证其成员函数获取信息的正确性
   pRoadMap->print();
 
 }
 
+void report()
+{
+  //以测量方式试运行构造过程，统计各类容器内容占用的字节数
+  mmo::alloc_tracker tracker;
+  size_t bytes = mmo::track([](mmo::segment_manager& segment)
+  {
+    mmo::construct<CRoadMap>(segment)->init(3,segment);
+  },tracker);
+  printf("%s",tracker.report(bytes).c_str());
+}
+
 int main(int argc, char* argv[]) 
 {
     // 检查参数数量是否为 2（程序名 + 一个参数）
     if (argc != 2) {
-        std::cerr << "用法: " << argv[0] << " [save|load]" << std::endl;
+        std::cerr << "用法: " << argv[0] << " [save|load|report]" << std::endl;
         return 1;
     }
 
@@ -172,10 +224,22 @@ int main(int argc, char* argv[])
     } 
     else if (strcmp(argv[1], "load") == 0) 
     {
-        load();
+        try
+        {
+            load();
+        }
+        catch(const mmo::mmo_exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    else if (strcmp(argv[1], "report") == 0)
+    {
+        report();
     } else {
-        std::cerr << "错误: 无效参数，请输入 'save' 或 'load'" << std::endl;
-        std::cerr << "用法: " << argv[0] << " [save|load]" << std::endl;
+        std::cerr << "错误: 无效参数，请输入 'save'、'load' 或 'report'" << std::endl;
+        std::cerr << "用法: " << argv[0] << " [save|load|report]" << std::endl;
         return 1;
     }
 
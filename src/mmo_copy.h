@@ -0,0 +1,274 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_copy.h
+*           复杂对象--线性映射库--对象图深拷贝
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include "mmo_delta_vector.h"
+#include "mmo_offset.h"
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+namespace mmo
+{
+
+class copier;
+
+/**
+ * @brief 检测类型是否提供了深拷贝钩子：void mmo_copy(const T& src,mmo::copier& copy)
+ */
+template<typename T>
+class has_mmo_copy
+{
+  template<typename U>
+  static auto test(int) -> decltype(std::declval<U&>().mmo_copy(std::declval<const U&>(),std::declval<copier&>()),std::true_type());
+  template<typename U>
+  static std::false_type test(...);
+public:
+  enum { value = decltype(test<T>(0))::value };
+};
+
+/**
+ * @brief 深拷贝器：把一个对象（可位于只读映射的镜像中）连同其引用的全部内容重新构造到另一个内存段
+ *        容器的拷贝构造都被禁用，直接 memcpy 会使指向对象以外的相对偏移失效，
+ *        这里按类型逐层遍历，在目标内存段中重新分配并拷贝：
+ *          - mmo::string / vector / var_vector / indexed_var_vector / hash_map / offset_ptr / far_ptr / delta_vector 内置支持；
+ *          - 纯数据类型（整数、枚举，以及 MMO_PLAIN_DATA 声明的 Point2D 等）直接按字节拷贝；
+ *          - 其他自定义类型需提供成员函数 void mmo_copy(const T& src,mmo::copier& copy)，
+ *            在其中对每个成员调用 copy(m_xxx,src.m_xxx)。
+ *        同一个对象被多个 offset_ptr / far_ptr 引用、或字串内容被 string_pool 共享时，拷贝后仍然共享，只拷贝一次。
+ *        目标内存段可以是测量段，用于先得到拷贝所需的精确字节数。
+ *
+ *   class CRoad
+ *   {
+ *   public:
+ *     void mmo_copy(const CRoad& src,mmo::copier& copy)
+ *     {
+ *       m_id = src.m_id;
+ *       copy(m_name,src.m_name);
+ *       copy(m_coors,src.m_coors);
+ *       copy(m_labels,src.m_labels);
+ *     }
+ *   };
+ *   CRoad* road = mmo::clone(image.root<CRoadMap>()->road(10),segment);
+ */
+class copier
+{
+protected:
+  segment_manager&                          m_segment;
+  std::unordered_map<const void*,void*>     m_objects;    //源对象地址 -> 目标对象地址
+  std::unordered_map<const char*,char*>     m_payloads;   //源字串内容地址 -> 目标字串内容地址
+public:
+  copier(segment_manager& segment):
+    m_segment(segment)
+  {
+  }
+  copier(const copier&) = delete;
+  copier& operator=(const copier&) = delete;
+public:
+  segment_manager&  segment(){return m_segment;}
+  /**
+   * @brief 在目标内存段中构造 src 的副本
+   */
+  template<typename T>
+  T*    clone(const T& src)
+  {
+    T* dst = construct<T>(m_segment);
+    (*this)(*dst,src);
+    return dst;
+  }
+public:
+  /**
+   * @brief 通用类型：有 mmo_copy 钩子则调用钩子，否则须为纯数据类型（is_plain_data）
+   *
+   * @param dst 位于目标内存段中、已默认构造的对象
+   * @param src
+   */
+  template<typename T>
+  void  operator()(T& dst,const T& src)
+  {
+    _copy(dst,src,std::integral_constant<bool,has_mmo_copy<T>::value>());
+  }
+  template<typename SizeType>
+  void  operator()(string<SizeType>& dst,const string<SizeType>& src)
+  {
+    if(src.empty())
+      return;
+    auto it = m_payloads.find(src.data());
+    if(it != m_payloads.end() && dst._share(it->second,src.size()))
+      return;
+    dst.assign(src.data(),src.size(),m_segment);
+    m_payloads[src.data()] = dst.data();
+  }
+  template<typename ValueType,typename SizeType>
+  void  operator()(vector<ValueType,SizeType>& dst,const vector<ValueType,SizeType>& src)
+  {
+    dst.resize(src.size(),m_segment);
+    if(m_segment.measuring() && _plain<ValueType>::value)
+      return;
+    _copy_array(dst.data(),src.data(),(size_t)src.size(),std::integral_constant<bool,_plain<ValueType>::value>());
+  }
+  template<typename ValueType,typename SizeType>
+  void  operator()(var_vector<ValueType,SizeType>& dst,const var_vector<ValueType,SizeType>& src)
+  {
+    dst.prepare_append_elements(m_segment);
+    _append_all(dst,src);
+  }
+  template<typename ValueType,typename SizeType>
+  void  operator()(indexed_var_vector<ValueType,SizeType>& dst,const indexed_var_vector<ValueType,SizeType>& src)
+  {
+    dst.prepare_append_elements(m_segment);
+    _append_all(dst,src);
+    if(src.indexed())
+      dst.finish_append_elements(m_segment);
+  }
+  /**
+   * @brief 保持原有的桶数，容量收缩为实际元素个数
+   */
+  template<typename KeyType,typename ValueType,typename SizeType>
+  void  operator()(hash_map<KeyType,ValueType,SizeType>& dst,const hash_map<KeyType,ValueType,SizeType>& src)
+  {
+    if(src.hash_size() == 0)
+      return;
+    dst.init_hash(src.size(),m_segment,src.hash_size());
+    for(auto it = src.begin();it != src.end();++it)
+    {
+      //值可能是偏移指针等不能经栈中转的类型，先插入默认值再原地拷贝
+      auto ret = dst.insert(it.node->key,ValueType(),m_segment);
+      if(ret.pvalue != NULL)
+        (*this)(ret.pvalue->value,it.node->value);
+    }
+  }
+  template<typename ValueType,typename OffsetType>
+  void  operator()(offset_ptr<ValueType,OffsetType>& dst,const offset_ptr<ValueType,OffsetType>& src)
+  {
+    const ValueType* from = src.get();
+    if(from == NULL)
+    {
+      dst = (ValueType*)NULL;
+      return;
+    }
+    auto it = m_objects.find(from);
+    if(it != m_objects.end())
+    {
+      dst = (ValueType*)it->second;
+      return;
+    }
+    ValueType* to = construct<ValueType>(m_segment);
+    m_objects[from] = to;
+    (*this)(*to,*from);
+    dst = to;
+  }
+  /**
+   * @brief 源指针经由远程偏移槽寻址时，在目标内存段的当前位置为 dst 预留槽
+   *        槽须在 dst 的近范围内，因此要在 mmo_copy 钩子的开头、拷贝其他成员之前调用：
+   *          void mmo_copy(const Node& src,mmo::copier& copy)
+   *          {
+   *            copy.reserve(m_next,src.m_next);
+   *            copy(m_payload,src.m_payload);
+   *            copy(m_next,src.m_next);
+   *          }
+   */
+  template<typename ValueType,typename NearType,typename FarType>
+  void  reserve(far_ptr<ValueType,NearType,FarType>& dst,const far_ptr<ValueType,NearType,FarType>& src)
+  {
+    if(src._is_far())
+      dst.reserve(m_segment);
+  }
+  /**
+   * @brief 新对象构造后立即赋给 dst：目标在近范围内时为近指针，否则写入 reserve 预留的槽
+   */
+  template<typename ValueType,typename NearType,typename FarType>
+  void  operator()(far_ptr<ValueType,NearType,FarType>& dst,const far_ptr<ValueType,NearType,FarType>& src)
+  {
+    const ValueType* from = src.get();
+    if(from == NULL)
+    {
+      dst.reset();
+      return;
+    }
+    auto it = m_objects.find(from);
+    if(it != m_objects.end())
+    {
+      dst.assign((const ValueType*)it->second,m_segment);
+      return;
+    }
+    ValueType* to = construct<ValueType>(m_segment);
+    dst.assign(to,m_segment);
+    m_objects[from] = to;
+    (*this)(*to,*from);
+  }
+  template<typename PointType,typename SizeType>
+  void  operator()(delta_vector<PointType,SizeType>& dst,const delta_vector<PointType,SizeType>& src)
+  {
+    dst.assign(src,m_segment);
+  }
+protected:
+  /**
+   * @brief 可按字节拷贝：没有钩子的纯数据类型（见 is_plain_data）
+   */
+  template<typename T>
+  struct _plain:
+    std::integral_constant<bool,!has_mmo_copy<T>::value && is_plain_data<T>::value>
+  {
+  };
+  template<typename T>
+  void  _copy(T& dst,const T& src,std::true_type)
+  {
+    dst.mmo_copy(src,*this);
+  }
+  template<typename T>
+  void  _copy(T& dst,const T& src,std::false_type)
+  {
+    static_assert(is_plain_data<T>::value,"mmo::copier: type is not plain data, declare it with MMO_PLAIN_DATA, MMO_SCHEMA or provide void mmo_copy(const T&,mmo::copier&)");
+    memcpy((void*)&dst,(const void*)&src,sizeof(T));
+  }
+  template<typename T>
+  void  _copy_array(T* dst,const T* src,size_t count,std::true_type)
+  {
+    if(count != 0)
+      memcpy((void*)dst,(const void*)src,sizeof(T) * count);
+  }
+  template<typename T>
+  void  _copy_array(T* dst,const T* src,size_t count,std::false_type)
+  {
+    for(size_t i = 0;i < count;i++)
+      (*this)(dst[i],src[i]);
+  }
+  template<typename ValueType,typename SizeType>
+  void  _append_all(var_vector<ValueType,SizeType>& dst,const var_vector<ValueType,SizeType>& src)
+  {
+    for(auto it = src.begin();it != src.end();++it)
+    {
+      auto element = dst.begin_append_element(m_segment);
+      (*this)(element->object(),*it);
+      dst.end_append_element(element,m_segment);
+    }
+  }
+};
+
+/**
+ * @brief 把 src 深拷贝到 dst，dst 须位于 segment 中且为默认构造状态
+ */
+template<typename T>
+void  deep_copy(T& dst,const T& src,segment_manager& segment)
+{
+  copier copy(segment);
+  copy(dst,src);
+}
+
+/**
+ * @brief 在 segment 中构造 src 的深拷贝副本
+ */
+template<typename T>
+T*    clone(const T& src,segment_manager& segment)
+{
+  copier copy(segment);
+  return copy.clone(src);
+}
+
+}//end namespace mmo
@@ -0,0 +1,321 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_delta_vector.h
+*           复杂对象--线性映射库--差分+变长编码的压缩坐标数组
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace mmo
+{
+
+MMO_PACK_BEGIN
+
+/**
+ * @brief 无内存分配 ，内容相对地址存储，压缩存储二维坐标序列的只读 vector 模板类
+ *        相邻坐标高度相关（道路折线等），每个点只存与前一点的差：
+ *        x、y 的差值先做 zigzag 映射（小的负数变成小的正数），再按 7 位一组的变长编码存放，
+ *        差值在 [-64,63] 内的分量只占 1 字节，每个点通常 2~4 字节，原始为 8 字节。
+ *        差值按 32 位回绕计算，任意 int32_t 坐标都能无损还原。
+ *        解码：连续 16 个字节都是单字节编码时（即连续 8 个点），用 SSE2 一次解出并做前缀和，
+ *        否则逐个点解码；decode() 与迭代器共用这一解码核，迭代器每次解出的 8 个点暂存在自身中。
+ *        只能顺序访问，不支持按下标随机访问，需要时先 decode() 到 std::vector。
+ *
+ * @tparam PointType  带有 x、y 两个 int32_t 成员，且可由 PointType(x,y) 构造
+ * @tparam SizeType   注意：类型最大值 需大于 寻址空间最大值
+ */
+template<typename PointType,typename SizeType>
+class delta_vector
+{
+  typedef delta_vector<PointType,SizeType>  SelfType;
+public:
+  /**
+   * @brief 顺序解码的只读迭代器，能成块解码时一次解出 8 个点，之后的 7 次 ++ 只读暂存
+   */
+  class iterator
+  {
+  public:
+    const uint8_t*  pos{nullptr};
+    const uint8_t*  last{nullptr};
+    SizeType        remain{0};
+    uint32_t        x{0};
+    uint32_t        y{0};
+  protected:
+    uint32_t        m_block[16];    //成块解出的点 (x0,y0,x1,y1,...)
+    uint32_t        m_next{0};
+    uint32_t        m_count{0};
+  public:
+    iterator(const uint8_t* p,const uint8_t* end,SizeType count)
+    {
+      pos     = p;
+      last    = end;
+      remain  = count;
+      _load();
+    }
+    bool operator==(const iterator& _rhs) const{return (remain == _rhs.remain);}
+    bool operator!=(const iterator& _rhs) const{return (remain != _rhs.remain);}
+    PointType operator*() const{return PointType((int32_t)x,(int32_t)y);}
+    iterator operator++(int)
+    {
+      iterator _Tmp = *this;
+      ++*this;
+      return (_Tmp);
+    }
+    iterator& operator++()
+    {
+      --remain;
+      _load();
+      return *this;
+    }
+  protected:
+    void  _load()
+    {
+      if(remain == 0)
+        return;
+      if(m_next == m_count)
+      {
+        m_next  = 0;
+        m_count = _decode_block(pos,last,x,y,m_block) ? 8 : 0;
+      }
+      if(m_next < m_count)
+      {
+        x = m_block[m_next * 2];
+        y = m_block[m_next * 2 + 1];
+        ++ m_next;
+        return;
+      }
+      x += _unzigzag(_read_varint(pos));
+      y += _unzigzag(_read_varint(pos));
+    }
+  };
+protected:
+  SizeType        m_size{0};
+  SizeType        m_bytes{0};
+  SizeType        m_offset{0};
+public:
+  delta_vector(){}
+  delta_vector(const SelfType&) = delete;
+  SelfType& operator=(const SelfType&) = delete;
+public:
+  /**
+   * @brief 编码后的字节数，用于预估内存
+   */
+  static size_t   encoded_bytes(const std::vector<PointType>& src)
+  {
+    size_t    bytes = 0;
+    uint32_t  px    = 0;
+    uint32_t  py    = 0;
+    for(auto& pt:src)
+    {
+      bytes += _varint_bytes(_zigzag((uint32_t)pt.x - px));
+      bytes += _varint_bytes(_zigzag((uint32_t)pt.y - py));
+      px = (uint32_t)pt.x;
+      py = (uint32_t)pt.y;
+    }
+    return bytes;
+  }
+  SizeType        _total_bytes()const{return sizeof(SelfType) + m_bytes;}
+  SizeType        _data_bytes()const{return m_bytes;}
+public:
+  bool  assign(const std::vector<PointType>& src,segment_manager& segment)
+  {
+    size_t  bytes = encoded_bytes(src);
+    //点数与字节数超出 SizeType 时抛出 offset_overflow，而不是截断成损坏的容器
+    SizeType  size  = checked_offset<SizeType>((ptrdiff_t)src.size());
+    m_bytes = checked_offset<SizeType>((ptrdiff_t)bytes);
+    m_size  = size;
+    if(bytes == 0)
+      return true;
+    MMO_ALLOC_KIND(alloc_delta_payload);
+    char*   dst   = segment.alloc(bytes);
+    if(dst == nullptr)
+    {
+      m_size  = 0;
+      m_bytes = 0;
+      size_t free_size = segment.get_free_memory();
+      size_t used_size = segment.size();
+      std::string strErrMsg = "mmo_exception:: no enough memory,free:" + std::to_string(free_size) + ",used:"
+        + std::to_string(used_size) + ",alloc size:" + std::to_string(bytes) ;
+      throw mmo_exception((int32_t)mmo_exception::no_enough_memory,strErrMsg);
+      return false;
+    }
+    m_offset = checked_offset<SizeType>(dst - (char*)this);
+    if(segment.measuring())
+      return true;
+    uint8_t*  p   = (uint8_t*)dst;
+    uint32_t  px  = 0;
+    uint32_t  py  = 0;
+    for(auto& pt:src)
+    {
+      _write_varint(p,_zigzag((uint32_t)pt.x - px));
+      _write_varint(p,_zigzag((uint32_t)pt.y - py));
+      px = (uint32_t)pt.x;
+      py = (uint32_t)pt.y;
+    }
+    return true;
+  }
+  /**
+   * @brief 从另一个 delta_vector（可在其他内存段中）拷贝，编码数据原样复制，不重新编码
+   */
+  bool  assign(const SelfType& src,segment_manager& segment)
+  {
+    m_size  = src.m_size;
+    m_bytes = src.m_bytes;
+    if(m_bytes == 0)
+      return true;
+    MMO_ALLOC_KIND(alloc_delta_payload);
+    char*   dst   = segment.alloc(m_bytes);
+    if(dst == nullptr)
+    {
+      size_t bytes = m_bytes;
+      m_size  = 0;
+      m_bytes = 0;
+      size_t free_size = segment.get_free_memory();
+      size_t used_size = segment.size();
+      std::string strErrMsg = "mmo_exception:: no enough memory,free:" + std::to_string(free_size) + ",used:"
+        + std::to_string(used_size) + ",alloc size:" + std::to_string(bytes) ;
+      throw mmo_exception((int32_t)mmo_exception::no_enough_memory,strErrMsg);
+      return false;
+    }
+    m_offset = checked_offset<SizeType>(dst - (char*)this);
+    if(!segment.measuring())
+      memcpy(dst,src._data(),m_bytes);
+    return true;
+  }
+  SizeType        size()const{return m_size;}
+  bool            empty()const{return m_size==0;}
+  /**
+   * @brief 编码数据的字节数
+   */
+  SizeType        bytes()const{return m_bytes;}
+  iterator        begin()const{return iterator(_data(),_data() + m_bytes,m_size);}
+  iterator        end()const{return iterator(_data(),_data() + m_bytes,0);}
+  PointType       front()const{return *begin();}
+public:
+  /**
+   * @brief 全部解码到 out，out 需能容纳 size() 个点
+   */
+  void            decode(PointType* out)const
+  {
+    const uint8_t*  p     = _data();
+    const uint8_t*  last  = p + m_bytes;
+    SizeType        i     = 0;
+    uint32_t        x     = 0;
+    uint32_t        y     = 0;
+    uint32_t        block[16];
+    while(i < m_size)
+    {
+      if(_decode_block(p,last,x,y,block))
+      {
+        for(int k = 0;k < 8;k++)
+          out[i + k] = PointType((int32_t)block[k * 2],(int32_t)block[k * 2 + 1]);
+        i += 8;
+        continue;
+      }
+      x += _unzigzag(_read_varint(p));
+      y += _unzigzag(_read_varint(p));
+      out[i++] = PointType((int32_t)x,(int32_t)y);
+    }
+  }
+  void            to_std(std::vector<PointType>& dst)const
+  {
+    dst.resize(size());
+    if(m_size != 0)
+      decode(dst.data());
+  }
+public:
+  const uint8_t*  _data()const{return (const uint8_t*)this + m_offset;}
+  /**
+   * @brief 成块解码：p 起的 16 个字节都是单字节编码时（8 个点），用 SSE2 解出并在 (x,y) 上做前缀和，
+   *        结果 (x0,y0,...,x7,y7) 写入 out，p 前进 16 字节，(x,y) 更新为第 8 个点；否则什么都不做并返回 false
+   */
+  static bool     _decode_block(const uint8_t*& p,const uint8_t* last,uint32_t& x,uint32_t& y,uint32_t* out)
+  {
+#if defined(__SSE2__)
+    if(last - p < 16)
+      return false;
+    __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+    if(_mm_movemask_epi8(bytes) != 0)
+      return false;
+    //每个 __m128i 放两个点 (x0,y0,x1,y1)
+    __m128i zero = _mm_setzero_si128();
+    __m128i one  = _mm_set1_epi32(1);
+    __m128i base = _mm_set_epi32((int32_t)y,(int32_t)x,(int32_t)y,(int32_t)x);
+    __m128i lo16 = _mm_unpacklo_epi8(bytes,zero);
+    __m128i hi16 = _mm_unpackhi_epi8(bytes,zero);
+    __m128i v[4] = {_mm_unpacklo_epi16(lo16,zero),_mm_unpackhi_epi16(lo16,zero),
+                    _mm_unpacklo_epi16(hi16,zero),_mm_unpackhi_epi16(hi16,zero)};
+    for(int k = 0;k < 4;k++)
+    {
+      __m128i d = _mm_xor_si128(_mm_srli_epi32(v[k],1),_mm_sub_epi32(zero,_mm_and_si128(v[k],one)));
+      d     = _mm_add_epi32(d,_mm_slli_si128(d,8));
+      d     = _mm_add_epi32(d,base);
+      base  = _mm_shuffle_epi32(d,_MM_SHUFFLE(3,2,3,2));
+      _mm_storeu_si128((__m128i*)(out + k * 4),d);
+    }
+    p += 16;
+    x  = out[14];
+    y  = out[15];
+    return true;
+#else
+    (void)p;
+    (void)last;
+    (void)x;
+    (void)y;
+    (void)out;
+    return false;
+#endif
+  }
+  static uint32_t _zigzag(uint32_t v)
+  {
+    return (v << 1) ^ (uint32_t)((int32_t)v >> 31);
+  }
+  static uint32_t _unzigzag(uint32_t v)
+  {
+    return (v >> 1) ^ (0U - (v & 1));
+  }
+  static size_t   _varint_bytes(uint32_t v)
+  {
+    size_t n = 1;
+    while(v >= 0x80)
+    {
+      v >>= 7;
+      ++n;
+    }
+    return n;
+  }
+  static void     _write_varint(uint8_t*& p,uint32_t v)
+  {
+    while(v >= 0x80)
+    {
+      *p++ = (uint8_t)(v | 0x80);
+      v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+  }
+  static uint32_t _read_varint(const uint8_t*& p)
+  {
+    uint32_t v = *p++;
+    if(v < 0x80)
+      return v;
+    v &= 0x7F;
+    for(uint32_t shift = 7;;shift += 7)
+    {
+      uint32_t b = *p++;
+      v |= (b & 0x7F) << shift;
+      if(b < 0x80)
+        return v;
+    }
+  }
+};
+template<typename PointType,typename SizeType>
+struct has_relative_offset<delta_vector<PointType,SizeType>>:std::true_type{};
+
+MMO_PACK_END
+
+}//end namespace mmo
@@ -0,0 +1,369 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_flat_hash_map.h
+*           复杂对象--线性映射库--开放寻址、分组探测的 hash_map
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace mmo
+{
+
+MMO_PACK_BEGIN
+
+/**
+ * @brief 开放寻址 hash 表的槽位，键值连续存放
+ */
+template<typename KeyType,typename ValueType>
+class flat_slot
+{
+public:
+  KeyType     key;
+  ValueType   value;
+};
+
+/**
+ * @brief 无内存分配 ，内容相对地址存储，开放寻址的 hash_map 模板类
+ *        布局：[对象头][控制字节 bucket_count + 16][槽位数组 bucket_count]
+ *        每个桶一个控制字节：最高位为 1 表示空，否则低 7 位保存 hash 的一部分。
+ *        查找时一次比较 16 个控制字节（SSE2），只有控制字节命中的槽位才去比较键，
+ *        没有节点链表，也就没有逐个节点的指针追踪。
+ *        组宽固定为 16，与编译时是否启用 AVX2 无关，保证不同机器构造的镜像布局一致。
+ *
+ * @tparam KeyType    需可平凡拷贝
+ * @tparam ValueType
+ * @tparam SizeType   注意：类型最大值 需大于 寻址空间最大值
+ */
+template<typename KeyType,typename ValueType,typename SizeType>
+class flat_hash_map
+{
+public:
+  typedef flat_hash_map<KeyType,ValueType,SizeType>   SelfType;
+  typedef flat_slot<KeyType,ValueType>                SlotType;
+  enum
+  {
+    group_width = 16,
+  };
+  static const int8_t ctrl_empty = (int8_t)0x80;
+
+  class iresult
+  {
+  public:
+    bool           result{false};
+    SlotType*      pvalue{NULL};
+  public:
+    iresult(){}
+    iresult(bool ret,SlotType* pval):
+    result(ret),
+    pvalue(pval)
+    {
+    }
+  };
+  class iterator
+  {
+  public:
+    SizeType              index{0};
+    const SelfType*       self{nullptr};
+  public:
+    iterator(const SelfType* pSelf,SizeType pos)
+    {
+      index   =pos;
+      self    =pSelf;
+    }
+    bool operator==(const iterator& _rhs) const{return (index == _rhs.index && self == _rhs.self);}
+    bool operator!=(const iterator& _rhs) const{return (index != _rhs.index || self != _rhs.self);}
+    const KeyType&  key()const{return self->_slots()[index].key;}
+    ValueType&      value()const{return (ValueType&)self->_slots()[index].value;}
+    ValueType* operator->() const{return &value();}
+    ValueType& operator*() const{return value();}
+    iterator operator++(int)
+    {
+      iterator _Tmp = *this;
+      ++*this;
+      return (_Tmp);
+    }
+    iterator& operator++()
+    {
+      index = self->_next_full(index + 1);
+      return *this;
+    }
+  };
+protected:
+  SizeType    m_size{0};
+  SizeType    m_capacity{0};
+  SizeType    m_bucket_count{0};
+  SizeType    m_ctrl_offset{0};
+  SizeType    m_slot_offset{0};
+  ValueType   m_default_value;
+public:
+  flat_hash_map(){}
+  flat_hash_map(const SelfType&) = delete;
+  SelfType& operator=(const SelfType&) = delete;
+public:
+  /**
+   * @brief 容纳 capacity 个元素所需的桶数：负载不超过 7/8，按组宽取整，不按 2 的幂放大
+   *        桶数超出 SizeType 的表示范围时抛出 offset_overflow，而不是截断成过小的桶表
+   */
+  static SizeType  bucket_count_for(SizeType capacity)
+  {
+    size_t need  = (size_t)capacity + (size_t)capacity / 7 + 1;
+    return checked_offset<SizeType>((ptrdiff_t)((need + group_width - 1) / group_width * group_width));
+  }
+  static size_t    predict_capacity_bytes(SizeType capacity)
+  {
+    size_t buckets = bucket_count_for(capacity);
+    size_t bytes   = _ctrl_bytes(buckets) + sizeof(SlotType) * buckets;
+    return sizeof(SelfType) + bytes + layout_array_align<SlotType>(bytes) - 1;
+  }
+  bool  init_hash(SizeType capacity,segment_manager& segment)
+  {
+    if(m_bucket_count != 0)
+      return false;
+    SizeType  buckets = bucket_count_for(capacity);
+    size_t    ctrl    = _ctrl_bytes(buckets);
+    size_t    bytes   = ctrl + sizeof(SlotType) * (size_t)buckets;
+    MMO_ALLOC_KIND(alloc_flat_hash_slots);
+    char*     p       = segment.alloc(bytes,layout_array_align<SlotType>(bytes));
+    if(p == NULL)
+    {
+      size_t free_size = segment.get_free_memory();
+      size_t used_size = segment.size();
+      std::string strErrMsg = "mmo_exception:: no enough memory,free:" + std::to_string(free_size) + ",used:"
+        + std::to_string(used_size) + ",alloc size:" + std::to_string(bytes) ;
+      throw mmo_exception((int32_t)mmo_exception::no_enough_memory,strErrMsg);
+      return false;
+    }
+    m_capacity      = capacity;
+    m_bucket_count  = buckets;
+    m_ctrl_offset   = checked_offset<SizeType>(p - (char*)this);
+    m_slot_offset   = checked_offset<SizeType>(p + ctrl - (char*)this);
+    memset(p,(uint8_t)ctrl_empty,ctrl);
+    return true;
+  }
+  SizeType  capacity()const{return m_capacity;}
+  SizeType  hash_size()const{return m_bucket_count;}
+  SizeType  size()const{return m_size;}
+  bool      empty()const{return m_size==0;}
+  bool      add(KeyType key,const ValueType& value,segment_manager& segment)
+  {
+    return insert(key,value,segment).result;
+  }
+  iresult   insert(KeyType key,const ValueType& value,segment_manager& segment)
+  {
+    if(m_bucket_count == 0)
+      return iresult(false,NULL);
+    size_t    h     = _hash(key);
+    SizeType  found = _find(key,h);
+    if(found != m_bucket_count)
+      return iresult(false,_slots() + found);
+    if(m_size >= m_capacity)
+      return iresult(false,NULL);//no enough space
+
+    SizeType  index = _find_empty(h);
+    _set_ctrl(index,(int8_t)(h & 0x7F));
+    SlotType* slot  = _slots() + index;
+    slot->key   = key;
+    slot->value = value;
+    ++ m_size;
+    return iresult(true,slot);
+  }
+  ValueType&        operator[](const KeyType& key)
+  {
+    ValueType* p = get(key);
+    return (p == NULL) ? m_default_value : *p;
+  }
+  const ValueType&  operator[](const KeyType& key)const
+  {
+    const ValueType* p = get(key);
+    return (p == NULL) ? m_default_value : *p;
+  }
+  iterator  find(const KeyType& key)const
+  {
+    if(m_bucket_count == 0)
+      return end();
+    return iterator(this,_find(key,_hash(key)));
+  }
+  const ValueType* get(const KeyType& key)const
+  {
+    if(m_bucket_count == 0)
+      return NULL;
+    SizeType index = _find(key,_hash(key));
+    return (index == m_bucket_count) ? NULL : &_slots()[index].value;
+  }
+  ValueType* get(const KeyType& key)
+  {
+    return (ValueType*)((const SelfType*)this)->get(key);
+  }
+  /**
+   * @brief 批量查找，结果与逐个调用 get() 相同
+   *        先算出整批键的 hash 并预取各自的控制字节组和首个槽位，再逐个探测
+   *
+   * @return size_t 找到的个数
+   */
+  size_t    get_many(const KeyType* keys,size_t count,const ValueType** out)const
+  {
+    enum { batch = 16 };
+    size_t    hashes[batch];
+    size_t    found = 0;
+    if(m_bucket_count == 0)
+    {
+      for(size_t i = 0;i < count;i++)
+        out[i] = NULL;
+      return 0;
+    }
+    for(size_t base = 0;base < count;base += batch)
+    {
+      size_t n = (count - base < (size_t)batch) ? (count - base) : (size_t)batch;
+      for(size_t i = 0;i < n;i++)
+      {
+        hashes[i]   = _hash(keys[base + i]);
+        size_t pos  = _start(hashes[i]);
+        __builtin_prefetch(_ctrl() + pos);
+        __builtin_prefetch(_slots() + pos);
+      }
+      for(size_t i = 0;i < n;i++)
+      {
+        SizeType index = _find(keys[base + i],hashes[i]);
+        if(index == m_bucket_count)
+        {
+          out[base + i] = NULL;
+          continue;
+        }
+        out[base + i] = &_slots()[index].value;
+        ++ found;
+      }
+    }
+    return found;
+  }
+  size_t    get_many(const KeyType* keys,size_t count,ValueType** out)
+  {
+    return ((const SelfType*)this)->get_many(keys,count,(const ValueType**)out);
+  }
+  iterator  begin()const
+  {
+    return iterator(this,_next_full(0));
+  }
+  iterator  end()const
+  {
+    return iterator(this,m_bucket_count);
+  }
+public:
+  const int8_t*   _ctrl()const{return (const int8_t*)((const char*)this + m_ctrl_offset);}
+  int8_t*         _ctrl(){return (int8_t*)((char*)this + m_ctrl_offset);}
+  const SlotType* _slots()const{return (const SlotType*)((const char*)this + m_slot_offset);}
+  SlotType*       _slots(){return (SlotType*)((char*)this + m_slot_offset);}
+  const ValueType&  _default_value()const{return m_default_value;}
+  SizeType        _next_full(SizeType index)const
+  {
+    const int8_t* ctrl = _ctrl();
+    while(index < m_bucket_count && ctrl[index] < 0)
+      ++index;
+    return index;
+  }
+  /**
+   * @brief 键的 hash：在 std::hash 之上再做一次 64 位混合，整数键的 std::hash 是恒等映射，高低位都需要打散
+   */
+  static size_t   _hash(const KeyType& key)
+  {
+    uint64_t h = (uint64_t)std::hash<KeyType>()(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (size_t)h;
+  }
+protected:
+  /**
+   * @brief 控制字节（含尾部镜像）的字节数，对齐布局下补齐到槽位的对齐
+   */
+  static size_t   _ctrl_bytes(size_t buckets)
+  {
+    return layout_round(buckets + group_width,layout_align<SlotType>());
+  }
+  /**
+   * @brief 16 个控制字节与 v 比较，返回命中位掩码
+   */
+  static uint32_t _match(const int8_t* group,int8_t v)
+  {
+#if defined(__SSE2__)
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl,_mm_set1_epi8(v)));
+#else
+    uint32_t mask = 0;
+    for(uint32_t i = 0;i < group_width;i++)
+      mask |= (uint32_t)(group[i] == v) << i;
+    return mask;
+#endif
+  }
+  /**
+   * @brief 起始桶：用 hash 高 32 位做乘法映射到 [0,桶数)，避免取模的除法
+   */
+  size_t    _start(size_t h)const
+  {
+    return (size_t)((((uint64_t)h >> 32) * (uint64_t)m_bucket_count) >> 32);
+  }
+  size_t    _wrap(size_t index)const
+  {
+    return (index >= (size_t)m_bucket_count) ? index - (size_t)m_bucket_count : index;
+  }
+  /**
+   * @brief 按组线性探测，可遍历所有位置；负载不超过 7/8，必然遇到空位而结束
+   *
+   * @return SizeType 命中的槽位下标，未找到返回 m_bucket_count
+   */
+  SizeType  _find(const KeyType& key,size_t h)const
+  {
+    const int8_t*   ctrl  = _ctrl();
+    const SlotType* slots = _slots();
+    size_t  pos   = _start(h);
+    int8_t  h2    = (int8_t)(h & 0x7F);
+    for(;;)
+    {
+      uint32_t hits = _match(ctrl + pos,h2);
+      while(hits != 0)
+      {
+        size_t index = _wrap(pos + __builtin_ctz(hits));
+        if(slots[index].key == key)
+          return (SizeType)index;
+        hits &= hits - 1;
+      }
+      if(_match(ctrl + pos,ctrl_empty) != 0)
+        return m_bucket_count;
+      pos = _wrap(pos + group_width);
+    }
+  }
+  SizeType  _find_empty(size_t h)const
+  {
+    const int8_t* ctrl = _ctrl();
+    size_t  pos   = _start(h);
+    for(;;)
+    {
+      uint32_t empties = _match(ctrl + pos,ctrl_empty);
+      if(empties != 0)
+        return (SizeType)_wrap(pos + __builtin_ctz(empties));
+      pos = _wrap(pos + group_width);
+    }
+  }
+  /**
+   * @brief 设置控制字节；前 16 个控制字节在尾部有一份镜像，使任意位置起的 16 字节读取都不越界、不需回绕
+   */
+  void      _set_ctrl(SizeType index,int8_t v)
+  {
+    int8_t* ctrl = _ctrl();
+    ctrl[index] = v;
+    if(index < group_width)
+      ctrl[m_bucket_count + index] = v;
+  }
+};
+template<typename KeyType,typename ValueType,typename SizeType>
+struct has_relative_offset<flat_hash_map<KeyType,ValueType,SizeType>>:std::true_type{};
+
+MMO_PACK_END
+
+}//end namespace mmo
@@ -0,0 +1,286 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_image.h
+*           复杂对象--线性映射库--镜像文件的保存与零拷贝映射加载
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace mmo
+{
+
+#pragma pack(push,1)
+
+/**
+ * @brief 镜像文件头，固定 64 字节，保证映射后镜像数据按缓存行对齐
+ *        文件布局：[image_header][镜像数据 image_size 字节]
+ */
+struct image_header
+{
+  enum
+  {
+    header_magic    = 0x314F4D4D,  // "MMO1"
+    format_version  = 2,          //2：hash_map 桶下标先取模再收窄（见 hash_map::key2index），与 1 的镜像不兼容
+  };
+  enum
+  {
+    flag_aligned_layout = 0x1,        //镜像按 MMO_ALIGNED_LAYOUT 对齐布局构造
+#if defined(MMO_ALIGNED_LAYOUT)
+    layout_flags        = flag_aligned_layout,
+#else
+    layout_flags        = 0,
+#endif
+  };
+  uint32_t    magic{header_magic};
+  uint16_t    header_bytes{sizeof(image_header)};
+  uint16_t    format{format_version};
+  uint32_t    layout_version{0};    //使用方自定义的对象布局版本
+  uint32_t    flags{layout_flags};
+  uint64_t    root_offset{0};       //根对象相对镜像数据起始的偏移
+  uint64_t    image_size{0};        //镜像数据字节数，不含文件头
+  char        reserved[32]{0};
+public:
+  /**
+   * @brief 校验文件头与实际可用字节数是否匹配
+   *
+   * @param total_bytes 文件头加镜像数据的总字节数
+   * @return true
+   */
+  bool        valid(size_t total_bytes)const
+  {
+    return magic == (uint32_t)header_magic
+        && header_bytes == sizeof(image_header)
+        && format == (uint16_t)format_version
+        && (flags & flag_aligned_layout) == (uint32_t)layout_flags
+        && total_bytes >= sizeof(image_header)
+        && image_size <= total_bytes - sizeof(image_header)
+        && root_offset < image_size;
+  }
+  const char* data()const{return (const char*)this + header_bytes;}
+};
+
+#pragma pack(pop)
+static_assert(sizeof(image_header) == 64,"image_header must be 64 bytes");
+
+/**
+ * @brief fsync path 所在的目录，改名操作本身在掉电后才得以保留
+ */
+inline bool sync_parent_dir(const std::string& path)
+{
+  size_t      pos = path.find_last_of('/');
+  std::string dir = (pos == std::string::npos) ? "." : ((pos == 0) ? "/" : path.substr(0,pos));
+  int fd = ::open(dir.c_str(),O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  if(fd < 0)
+    return false;
+  bool ok = ::fsync(fd) == 0;
+  ::close(fd);
+  return ok;
+}
+
+/**
+ * @brief 在 path 所在目录创建唯一的临时文件 "<path>.XXXXXX"（mkstemp），权限 0644
+ *        同一路径的并发保存（如后台压实与用户保存）各写各的临时文件，不会互相截断
+ *
+ * @param tmp_path 输出：临时文件路径，交给 commit_temp_file 改名或清理
+ * @return int     以写方式打开的文件描述符
+ */
+inline int create_temp_file(const std::string& path,std::string& tmp_path)
+{
+  tmp_path = path + ".XXXXXX";
+  int fd = ::mkostemp(&tmp_path[0],O_CLOEXEC);
+  if(fd < 0)
+    throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: create temp file failed:" + path);
+  if(::fchmod(fd,0644) != 0)
+  {
+    ::close(fd);
+    unlink(tmp_path.c_str());
+    throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: create temp file failed:" + path);
+  }
+  return fd;
+}
+/**
+ * @brief 同上，返回 FILE*
+ */
+inline FILE* create_temp_stream(const std::string& path,std::string& tmp_path)
+{
+  int   fd = create_temp_file(path,tmp_path);
+  FILE* fp = ::fdopen(fd,"wb");
+  if(fp == NULL)
+  {
+    ::close(fd);
+    unlink(tmp_path.c_str());
+    throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: open file failed:" + tmp_path);
+  }
+  return fp;
+}
+
+/**
+ * @brief 临时文件已关闭后改名为 path，再 fsync 目录；失败时删除临时文件并抛出 io_error
+ */
+inline void _rename_temp_file(bool ok,const std::string& tmp_path,const std::string& path)
+{
+  if(!ok || rename(tmp_path.c_str(),path.c_str()) != 0)
+  {
+    unlink(tmp_path.c_str());
+    throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: write file failed:" + path);
+  }
+  if(!sync_parent_dir(path))
+    throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: sync directory failed:" + path);
+}
+
+/**
+ * @brief 提交 create_temp_file 写好的临时文件：先 fsync 内容再关闭、改名，最后 fsync 所在目录
+ *        崩溃或掉电后 path 要么是完整的旧文件，要么是完整的新文件，不会是内容尚未落盘的新名字
+ *        镜像、补丁、流式镜像的写出都经由这里
+ *
+ * @param fd        临时文件，由本函数关闭
+ * @param tmp_path  临时文件路径，失败时删除
+ * @param path      目标路径
+ * @param ok        调用者的写入是否都成功，false 时只做清理并抛出异常
+ */
+inline void commit_temp_file(int fd,const std::string& tmp_path,const std::string& path,bool ok = true)
+{
+  ok = ok && ::fsync(fd) == 0;
+  ok = (::close(fd) == 0) && ok;
+  _rename_temp_file(ok,tmp_path,path);
+}
+inline void commit_temp_file(FILE* fp,const std::string& tmp_path,const std::string& path,bool ok = true)
+{
+  ok = ok && fflush(fp) == 0 && ::fsync(fileno(fp)) == 0;
+  ok = (fclose(fp) == 0) && ok;
+  _rename_temp_file(ok,tmp_path,path);
+}
+
+/**
+ * @brief 保存镜像：写入文件头与内存段内容，先写临时文件再改名，正在映射旧文件的进程不受影响
+ *        经 commit_temp_file 落盘后才改名
+ *
+ * @param path            文件路径
+ * @param segment         构造完成的内存段
+ * @param root            根对象地址，需位于内存段内
+ * @param layout_version  使用方自定义的布局版本，加载时可校验
+ */
+inline void save_image(const std::string& path,const segment_manager& segment,const void* root,uint32_t layout_version = 0)
+{
+  if((const char*)root < segment.data() || (const char*)root >= segment.data() + segment.size())
+    throw mmo_exception((int32_t)mmo_exception::invalid_memory_address,"mmo_exception:: image root out of segment!");
+
+  image_header header;
+  header.layout_version = layout_version;
+  header.root_offset    = (const char*)root - segment.data();
+  header.image_size     = segment.size();
+
+  std::string tmp_path;
+  FILE* fp = create_temp_stream(path,tmp_path);
+  bool ok = fwrite(&header,sizeof(header),1,fp) == 1
+         && (segment.size() == 0 || fwrite(segment.data(),segment.size(),1,fp) == 1);
+  commit_temp_file(fp,tmp_path,path,ok);
+}
+
+/**
+ * @brief 只读映射的镜像文件
+ *        整个文件以 MAP_SHARED 只读映射，不做任何拷贝，多个进程映射同一文件时共享页缓存
+ */
+class mapped_image
+{
+protected:
+  char*         m_map{nullptr};
+  size_t        m_map_size{0};
+  const image_header* m_header{nullptr};
+public:
+  mapped_image(){}
+  explicit mapped_image(const std::string& path,uint32_t layout_version = 0){open(path,layout_version);}
+  mapped_image(const mapped_image&) = delete;
+  mapped_image& operator=(const mapped_image&) = delete;
+  mapped_image(mapped_image&& other)
+  {
+    swap(other);
+  }
+  mapped_image& operator=(mapped_image&& other)
+  {
+    close();
+    swap(other);
+    return *this;
+  }
+  ~mapped_image(){close();}
+public:
+  /**
+   * @brief 映射镜像文件并校验文件头
+   *
+   * @param path
+   * @param layout_version 期望的布局版本，为 0 时不校验
+   */
+  void    open(const std::string& path,uint32_t layout_version = 0)
+  {
+    close();
+    int fd = ::open(path.c_str(),O_RDONLY|O_CLOEXEC);
+    if(fd < 0)
+      throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: open file failed:" + path);
+    struct stat st;
+    if(::fstat(fd,&st) != 0 || (size_t)st.st_size < sizeof(image_header))
+    {
+      ::close(fd);
+      throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: invalid image file:" + path);
+    }
+    void* p = ::mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_SHARED,fd,0);
+    ::close(fd);
+    if(p == MAP_FAILED)
+      throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: mmap file failed:" + path);
+
+    m_map       = (char*)p;
+    m_map_size  = (size_t)st.st_size;
+    m_header    = (const image_header*)m_map;
+    if(!m_header->valid(m_map_size) || (layout_version != 0 && m_header->layout_version != layout_version))
+    {
+      close();
+      throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: invalid image header:" + path);
+    }
+  }
+  void    close()
+  {
+    if(m_map != nullptr)
+      ::munmap(m_map,m_map_size);
+    m_map       = nullptr;
+    m_map_size  = 0;
+    m_header    = nullptr;
+  }
+  /**
+   * @brief 提示内核预读整个镜像，适合随后要全量访问的场景
+   */
+  void    prefetch()const
+  {
+    if(m_map != nullptr)
+      ::madvise(m_map,m_map_size,MADV_WILLNEED);
+  }
+public:
+  bool                is_open()const{return m_map != nullptr;}
+  const image_header& header()const{return *m_header;}
+  const char*         data()const{return m_header->data();}
+  size_t              size()const{return m_header->image_size;}
+  /**
+   * @brief 获取根对象，映射为只读，因此只返回常量指针
+   */
+  template<typename T>
+  const T*            root()const
+  {
+    if(m_header == nullptr || m_header->root_offset + sizeof(T) > m_header->image_size)
+      throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: image root out of range!");
+    return (const T*)(data() + m_header->root_offset);
+  }
+protected:
+  void    swap(mapped_image& other)
+  {
+    std::swap(m_map,other.m_map);
+    std::swap(m_map_size,other.m_map_size);
+    std::swap(m_header,other.m_header);
+  }
+};
+
+}//end namespace mmo
@@ -12,9 +12,132 @@
 #include <exception>
 #include <string.h>
 #include <stdio.h>
+#include <type_traits>
+
+/**
+ * @brief 布局模式
+ *        默认为紧凑布局：全部容器按 1 字节对齐，镜像最小，适合网络传输等对体积敏感的场合；
+ *        定义 MMO_ALIGNED_LAYOUT 后为对齐布局：容器对象自然对齐，数组按元素类型对齐，
+ *        大数组按缓存行对齐，读取端访问对齐数据、便于编译器向量化，代价是少量填充字节。
+ *        对齐按相对内存段起始地址计算，镜像映射到页对齐地址后即为绝对对齐。
+ *        两种模式的镜像互不兼容，镜像文件头中有标记。
+ */
+#if defined(MMO_ALIGNED_LAYOUT)
+#define MMO_PACK_BEGIN
+#define MMO_PACK_END
+#define MMO_ALIGNAS(T)  alignas(T)
+#else
+#define MMO_PACK_BEGIN  _Pragma("pack(push,1)")
+#define MMO_PACK_END    _Pragma("pack(pop)")
+#define MMO_ALIGNAS(T)
+#endif
+
+/**
+ * @brief 分配统计模式
+ *        定义 MMO_ALLOC_TRACKING 后，容器的每次分配都带上用途标记（字串、桶表、节点等），
+ *        使用方可用 MMO_ALLOC_SITE 为一段构造代码命名，内存段挂上 alloc_tracker 后
+ *        即可按 调用点 x 用途 统计字节数与填充，见 mmo_report.h。
+ *        未定义时两个宏为空，不产生任何开销。
+ */
+#define MMO_ALLOC_CONCAT_(a,b)    a##b
+#define MMO_ALLOC_CONCAT(a,b)     MMO_ALLOC_CONCAT_(a,b)
+#define MMO_ALLOC_STRINGIZE_(x)   #x
+#define MMO_ALLOC_STRINGIZE(x)    MMO_ALLOC_STRINGIZE_(x)
+#if defined(MMO_ALLOC_TRACKING)
+#define MMO_ALLOC_KIND(...)       mmo::alloc_scope MMO_ALLOC_CONCAT(_mmo_alloc_kind_,__LINE__)(__VA_ARGS__)
+#define MMO_ALLOC_SITE(name)      mmo::alloc_scope MMO_ALLOC_CONCAT(_mmo_alloc_site_,__LINE__)((const char*)(name))
+#else
+#define MMO_ALLOC_KIND(...)
+#define MMO_ALLOC_SITE(name)
+#endif
+#define MMO_ALLOC_SITE_HERE()     MMO_ALLOC_SITE(__FILE__ ":" MMO_ALLOC_STRINGIZE(__LINE__))
+
 namespace mmo
 {
 
+enum
+{
+  cache_line_size   = 64,
+  large_array_bytes = 512,    //对齐布局下，不小于此字节数的数组按缓存行对齐
+};
+
+/**
+ * @brief 对象在内存段中的对齐要求，紧凑布局下恒为 1
+ */
+template<typename T>
+inline size_t layout_align()
+{
+#if defined(MMO_ALIGNED_LAYOUT)
+  return alignof(T);
+#else
+  return 1;
+#endif
+}
+/**
+ * @brief 元素类型为 T、共 bytes 字节的数组的对齐要求
+ */
+template<typename T>
+inline size_t layout_array_align(size_t bytes)
+{
+#if defined(MMO_ALIGNED_LAYOUT)
+  return (bytes >= (size_t)large_array_bytes && alignof(T) < (size_t)cache_line_size) ? (size_t)cache_line_size : alignof(T);
+#else
+  return 1;
+#endif
+}
+/**
+ * @brief 内存段中出现的最大对齐要求，整块搬移（如并行构造拼接）时需保持按此对齐
+ */
+inline size_t layout_max_align()
+{
+#if defined(MMO_ALIGNED_LAYOUT)
+  return cache_line_size;
+#else
+  return 1;
+#endif
+}
+/**
+ * @brief bytes 按 align 向上取整，用于一次分配中多个数组的衔接
+ */
+inline size_t layout_round(size_t bytes,size_t align)
+{
+  return (bytes + align - 1) / align * align;
+}
+
+/**
+ * @brief 类型内部是否含相对偏移：引用对象以外的内容，不能按字节搬到别处，接收时也需越界校验
+ *        各容器在定义处特化为 true。容器禁用了拷贝构造，但编译器仍视其为可平凡拷贝，
+ *        因此不能只用 std::is_trivially_copyable 判断
+ */
+template<typename T>
+struct has_relative_offset:std::false_type{};
+
+/**
+ * @brief 纯数据类型：不含任何相对偏移，可按字节拷贝，接收时无需逐个校验
+ *        整数、浮点、枚举及其数组默认为纯数据；其他类（如 Point2D）需用 MMO_PLAIN_DATA 显式声明。
+ *        含容器的结构体编译器也报告为可平凡拷贝、has_relative_offset 又无从得知其成员，
+ *        所以类类型一律不自动推断，未声明也未提供 MMO_SCHEMA/钩子时，拷贝与校验在编译期报错
+ */
+template<typename T>
+struct is_plain_data:std::integral_constant<bool,std::is_arithmetic<T>::value || std::is_enum<T>::value>{};
+template<typename T,size_t N>
+struct is_plain_data<T[N]>:is_plain_data<T>{};
+
+/**
+ * @brief 声明类为纯数据，需在全局命名空间中使用：MMO_PLAIN_DATA(Point2D)
+ *        只可用于成员全是数值的类，含 mmo 容器或偏移指针的类应使用 MMO_SCHEMA
+ */
+#define MMO_PLAIN_DATA(Type)                                                                          \
+namespace mmo                                                                                         \
+{                                                                                                     \
+template<>                                                                                            \
+struct is_plain_data<Type>:std::true_type                                                             \
+{                                                                                                     \
+  static_assert(std::is_trivially_copyable<Type>::value && !has_relative_offset<Type>::value,       \
+    "MMO_PLAIN_DATA: type must be trivially copyable and hold no relative offset");                   \
+};                                                                                                    \
+}
+
 /**
  * @brief 内存映射对象异常类
  * 
@@ -28,6 +151,9 @@ public:
     ok               = 0,
     no_enough_memory = 1001,
     invalid_memory_address = 1002,
+    io_error         = 1003,
+    invalid_image    = 1004,
+    offset_overflow  = 1005,
     unknown_exception= 9999,
   };
 protected:
@@ -49,6 +175,117 @@ public:
   
 };
 
+/**
+ * @brief 相对偏移 offset 能否用 OffsetType 表示
+ */
+template<typename OffsetType>
+inline bool offset_fits(ptrdiff_t offset)
+{
+  return sizeof(OffsetType) >= sizeof(ptrdiff_t) || (ptrdiff_t)(OffsetType)offset == offset;
+}
+/**
+ * @brief 相对偏移收窄为 OffsetType，超出表示范围时抛出 offset_overflow，而不是截断后指向错误的位置
+ *        在测量段中同样会抛出，可借此在正式构造前试出够用的最小偏移宽度，见 mmo_offset.h
+ */
+template<typename OffsetType>
+inline OffsetType checked_offset(ptrdiff_t offset)
+{
+  if(!offset_fits<OffsetType>(offset))
+    throw mmo_exception((int32_t)mmo_exception::offset_overflow,"mmo_exception:: offset out of range,offset:" + std::to_string(offset)
+      + ",offset bytes:" + std::to_string(sizeof(OffsetType)));
+  return (OffsetType)offset;
+}
+
+/**
+ * @brief 内存分配的用途
+ */
+enum alloc_kind
+{
+  alloc_object = 0,         //construct 构造的对象本体，及未标记的分配
+  alloc_string,             //string 的字串内容
+  alloc_vector,             //vector 的数组内容
+  alloc_var_element,        //var_vector 的元素头
+  alloc_var_block,          //var_vector::append_elements 整块搬入的元素
+  alloc_index_table,        //indexed_var_vector 的偏移表
+  alloc_hash_table,         //hash_map 的桶表
+  alloc_hash_node,          //hash_map 的节点
+  alloc_delta_payload,      //delta_vector 的编码内容
+  alloc_flat_hash_slots,    //flat_hash_map 的槽位数组
+  alloc_perfect_hash_table, //perfect_hash_map 的表
+  alloc_sorted_map_table,   //sorted_map 的键值数组
+  alloc_rtree_nodes,        //packed_rtree 的节点
+  alloc_far_slot,           //far_ptr 的远程偏移槽
+  alloc_kind_count
+};
+
+/**
+ * @brief 当前线程的分配标记，由 alloc_scope 设置
+ *        split 不为 0 时，每次分配只有开头 split 字节计入 kind，其余计入 alloc_object，
+ *        用于元素头与元素对象一次分配的情形（var_vector）
+ */
+class alloc_context
+{
+public:
+  alloc_kind    kind{alloc_object};
+  const char*   site{nullptr};
+  size_t        split{0};
+public:
+  static alloc_context& current()
+  {
+    static thread_local alloc_context s_context;
+    return s_context;
+  }
+};
+
+/**
+ * @brief 在作用域内设置分配用途或调用点，析构时恢复，一般通过 MMO_ALLOC_KIND / MMO_ALLOC_SITE 使用
+ */
+class alloc_scope
+{
+protected:
+  alloc_context     m_saved;
+public:
+  alloc_scope(alloc_kind kind,size_t split = 0):
+    m_saved(alloc_context::current())
+  {
+    alloc_context::current().kind   = kind;
+    alloc_context::current().split  = split;
+  }
+  explicit alloc_scope(const char* site):
+    m_saved(alloc_context::current())
+  {
+    alloc_context::current().site   = site;
+  }
+  /**
+   * @brief 整体换成另一线程的标记，用于把调用线程的标记带进工作线程
+   */
+  explicit alloc_scope(const alloc_context& context):
+    m_saved(alloc_context::current())
+  {
+    alloc_context::current() = context;
+  }
+  ~alloc_scope()
+  {
+    alloc_context::current() = m_saved;
+  }
+  alloc_scope(const alloc_scope&) = delete;
+  alloc_scope& operator=(const alloc_scope&) = delete;
+};
+
+/**
+ * @brief 分配观察者，挂到内存段上后每次成功分配都会收到通知，标记从 alloc_context::current() 读取
+ */
+class alloc_observer
+{
+public:
+  virtual ~alloc_observer(){}
+  /**
+   * @param size    分配的字节数
+   * @param padding 为对齐跳过的字节数
+   */
+  virtual void on_alloc(size_t size,size_t padding) = 0;
+};
+
 /**
  * @brief 内存映射对象内存段管理器
  * 
@@ -60,10 +297,12 @@ protected:
   size_t      m_capacity{0};
   char*       m_current{nullptr};
   char*       m_end{nullptr};
+  bool        m_measuring{false};
+  alloc_observer* m_observer{nullptr};
 public:
   segment_manager(){}
   segment_manager(char* buffer,size_t capacity){reset(buffer,capacity);}
-  ~segment_manager() {}
+  virtual ~segment_manager() {}
 public:
   void    reset(char* buffer,size_t capacity)
   {
@@ -75,35 +314,101 @@ public:
 public:
   char*     alloc(size_t size)
   {
-    char* p = m_current;
-    if( (m_current + size) > m_end)
+    if( (m_current + size) > m_end && !grow(size))
       return NULL;
+    char* p = m_current;
+    m_current += size;
+    if(m_observer != nullptr)
+      m_observer->on_alloc(size,0);
+    return p;
+  }
+  /**
+   * @brief 按 align 对齐分配，对齐相对内存段起始地址计算，填充字节计入已用空间
+   */
+  char*     alloc(size_t size,size_t align)
+  {
+    if(align <= 1)
+      return alloc(size);
+    size_t pad = _padding(align);
+    if( (m_current + pad + size) > m_end )
+    {
+      if(!grow(size + align - 1))
+        return NULL;
+      pad = _padding(align);
+    }
+    m_current += pad;
+    char* p = m_current;
     m_current += size;
+    if(m_observer != nullptr)
+      m_observer->on_alloc(size,pad);
     return p;
   }
+  /**
+   * @brief 把当前位置推进到 align 的整数倍
+   */
+  bool      align(size_t align)
+  {
+    return (align <= 1) || alloc(0,align) != NULL;
+  }
   size_t    calc_offset(void* obj_addr){return (m_current - (char*)obj_addr); }  
   bool      enough(size_t size)const{ return ( (m_current + size) <= m_end); }
   char*     current()const{return m_current;}
   size_t    capacity()const{return m_capacity;}
+  /**
+   * @brief 直接推进 size 字节，与 alloc 一样通知分配观察者
+   */
   bool      advance(size_t size)
   {
-    if(!enough(size))
+    if(!enough(size) && !grow(size))
       return false;
     m_current += size;
+    if(m_observer != nullptr)
+      m_observer->on_alloc(size,0);
     return true;
   }
+  /**
+   * @brief 保证从 current() 起有 size 字节连续可用，用于必须连续存放的内容（如 var_vector 的全部元素）
+   *        分块分配的内存段（如 concurrent_segment::view）中，连续性只在块内成立，需先预留
+   */
+  bool      reserve(size_t size){return enough(size) || grow(size);}
   size_t    get_free_memory()const{return (m_end-m_current);}
+  /**
+   * @brief 是否为测量模式：只统计字节数，容器跳过字串、数组等负载内容的写入
+   */
+  bool      measuring()const{return m_measuring;}
+  /**
+   * @brief 挂上分配观察者（如 alloc_tracker），传 nullptr 取消
+   */
+  void      set_observer(alloc_observer* observer){m_observer = observer;}
+  alloc_observer* observer()const{return m_observer;}
   size_t    size()const{return (m_current-m_buffer);}
   const char* data()const{return m_buffer;}
   bool       verify_addr(void* addr)
   {
     return (addr >= m_buffer && addr < m_end);
   }
+  size_t    _padding(size_t align)const
+  {
+    size_t r = (size_t)(m_current - m_buffer) % align;
+    return (r == 0) ? 0 : align - r;
+  }
   void      exception_addr(void* addr)
   {
     if(addr < m_buffer || addr >= m_end)
       throw mmo_exception((int32_t)mmo_exception::invalid_memory_address,"mmo_exception:: invalid memory address!");
   }
+protected:
+  /**
+   * @brief 空间不足时的扩展点，派生的内存段可在此追加可用空间
+   *        要求：扩展后 m_current 起始的 size 字节连续可用，且已分配的地址保持不变（偏移寻址依赖于此）
+   * 
+   * @param size 本次需要的连续字节数
+   * @return true 扩展成功
+   */
+  virtual bool grow(size_t size)
+  {
+    return false;
+  }
 };
 
 /**
@@ -116,7 +421,7 @@ public:
 template<typename T> 
 T* construct(segment_manager& segment)
 {
-  void* p = segment.alloc(sizeof(T));
+  void* p = segment.alloc(sizeof(T),layout_align<T>());
   if(p == NULL)
   {
     size_t free_size = segment.get_free_memory();
@@ -132,7 +437,7 @@ T* construct(segment_manager& segment)
 }
 
 //====================================================================================================
-#pragma pack(push,1)
+MMO_PACK_BEGIN
 
 /**
  * @brief 相对寻址指针模板类
@@ -233,9 +538,13 @@ protected:
    */
   inline OffsetType raw_to_offset(AddrType base,AddrType raw)const
   {
+    if(raw != 0)
+      checked_offset<OffsetType>((ptrdiff_t)(raw - base));
     return OffsetType(( AddrType(raw - base - 1) & -AddrType(raw != 0) ) + 1);
   }
 };
+template<typename ValueType,typename OffsetType>
+struct has_relative_offset<offset_ptr<ValueType,OffsetType>>:std::true_type{};
 
 /**
  * @brief 无内存分配，内容相对地址存储，托管对象定长的vector模板类
@@ -273,8 +582,10 @@ public:
   bool              resize(SizeType size,segment_manager& segment)
   {
     m_size    = size;
-    m_offset  = (SizeType)segment.calc_offset(this);
-    if(!segment.advance(_data_bytes()))
+    MMO_ALLOC_KIND(alloc_vector);
+    //偏移取自实际分配到的地址：内存段在 alloc 中切换到新块时，分配前的 current() 已不是数据所在位置
+    char* p   = segment.alloc(_data_bytes(),layout_array_align<ValueType>(_data_bytes()));
+    if(p == NULL)
     {
       size_t free_size = segment.get_free_memory();
       size_t used_size = segment.size();
@@ -284,16 +595,23 @@ public:
       throw mmo_exception((int32_t)mmo_exception::no_enough_memory,strErrMsg);
       return false;
     }
+    //空数组的偏移不会被使用，不做范围检查
+    m_offset  = (size == 0) ? (SizeType)(p - (char*)this) : checked_offset<SizeType>(p - (char*)this);
     
-    ValueType* p=data();
+    //测量模式下平凡类型的数组不写入；含容器头等成员的元素仍要构造，否则其后的 init 会读到上一次测量残留的内容
+    if(segment.measuring() && std::is_trivially_default_constructible<ValueType>::value)
+      return true;
+    ValueType* v=data();
     for(SizeType i=0;i<m_size;i++)
-      ::new((void*)(p+i))ValueType();
+      ::new((void*)(v+i))ValueType();
     return true;
   }
   bool              assign(const std::vector<ValueType>& src,segment_manager& segment)
   {
     if(!resize(src.size(),segment))
       return false;
+    if(segment.measuring())
+      return true;
     SizeType i=0;
     for(auto& it:src)
       data()[i++] = it;
@@ -303,6 +621,8 @@ public:
   {
     if(!resize(src.size(),segment))
       return false;
+    if(segment.measuring())
+      return true;
     SizeType i=0;
     for(auto& it:src)
       data()[i++] = it;
@@ -329,6 +649,8 @@ protected:
   ValueType*        _get_data_addr(){return (ValueType*)((char*)this + m_offset); }  
   const ValueType*  _get_data_addr()const{return (const ValueType*)((char*)this + m_offset); }  
 };
+template<typename ValueType,typename SizeType>
+struct has_relative_offset<vector<ValueType,SizeType>>:std::true_type{};
 
 
 /**
@@ -364,6 +686,22 @@ public:
   {
     m_offset = offset;
   }
+  /**
+   * @brief 引用同一内存段中已存在的字串内容（需以 0 结尾），不再拷贝，用于字串去重
+   * 
+   * @param payload 已存在的内容地址
+   * @param size    内容长度，不含结尾的 0
+   * @return false  相对偏移超出 SizeType 的表示范围，调用方应改为拷贝
+   */
+  bool              _share(const char* payload,SizeType size)
+  {
+    ptrdiff_t offset = payload - (const char*)this;
+    if(size == 0 || (ptrdiff_t)(SizeType)offset != offset)
+      return false;
+    m_size   = size;
+    m_offset = (SizeType)offset;
+    return true;
+  }
 public:
   void  to_std(std::string& dst)const
   {
@@ -372,10 +710,17 @@ public:
 public:
   bool  assign(const std::string& src,segment_manager& segment)
   {
-    m_size   = src.size();
+    return assign(src.data(),(SizeType)src.size(),segment);
+  }
+  /**
+   * @brief 由任意内存中的内容赋值，可来自另一个内存段中的 mmo::string，无需经 std::string 中转
+   */
+  bool  assign(const char* src,SizeType size,segment_manager& segment)
+  {
+    m_size   = size;
     if(m_size == 0)
       return true;
-    m_offset = segment.calc_offset(this);
+    MMO_ALLOC_KIND(alloc_string);
     char* dst = segment.alloc(m_size+1);
     if(dst == nullptr)
     {
@@ -388,8 +733,11 @@ public:
       throw mmo_exception((int32_t)mmo_exception::no_enough_memory,strErrMsg);
       return false;
     }
+    m_offset = checked_offset<SizeType>(dst - (char*)this);
 
-    memcpy(dst , src.data() , m_size );
+    if(segment.measuring())
+      return true;
+    memcpy(dst , src , m_size );
     dst[m_size]=0;  
 
     return true;
@@ -416,6 +764,8 @@ protected:
     return (const char*)this + m_offset;
   }    
 };
+template<typename SizeType>
+struct has_relative_offset<string<SizeType>>:std::true_type{};
 
 
 
@@ -430,6 +780,8 @@ class var_element
 {
   typedef var_element<ValueType,SizeType>  SelfType;
 protected:
+  //对齐布局下元素头按对象的对齐补齐，紧随其后的对象因此对齐
+  MMO_ALIGNAS(ValueType) MMO_ALIGNAS(SizeType)
   SizeType        m_bytes;
 public:
   var_element()
@@ -559,8 +911,27 @@ public:
 public:
   ElementType*      begin_append_element(segment_manager& segment)
   {
-    ElementType* new_element = (ElementType*)segment.current();
-    if(!segment.advance( sizeof(ElementType) + sizeof(ValueType) ))
+    ElementType* new_element = _begin_element(segment);
+    //元素必须连续存放，第一个元素以实际分配到的地址为准
+    if(m_size == 0)
+      _set_offset(checked_offset<SizeType>((char*)new_element - (char*)this));
+    return new_element;
+  }
+  bool              end_append_element(ElementType* element,segment_manager& segment)
+  {
+    _end_element(element,segment);
+    m_size ++;
+    
+    return true;
+  }
+  /**
+   * @brief 只在内存段中分配并构造一个元素，不记入任何 vector，用于在别处构造元素再整块搬入（见 mmo_parallel.h）
+   */
+  static ElementType* _begin_element(segment_manager& segment)
+  {
+    MMO_ALLOC_KIND(alloc_var_element,sizeof(ElementType));
+    ElementType* new_element = (ElementType*)segment.alloc( sizeof(ElementType) + sizeof(ValueType) ,layout_align<ElementType>() );
+    if(new_element == NULL)
     {
       size_t free_size = segment.get_free_memory();
       size_t used_size = segment.size();
@@ -577,12 +948,51 @@ public:
     ::new((void*)new_element->data())ValueType();
     return new_element;
   }
-  bool              end_append_element(ElementType* element,segment_manager& segment)
+  static void       _end_element(ElementType* element,segment_manager& segment)
   {
+    //对齐布局下，尾部填充计入本元素，使下一个元素紧接其后且对齐
+    MMO_ALLOC_KIND(alloc_var_element);
+    segment.align(layout_align<ElementType>());
     size_t size = (segment.current() - ((char*)element + sizeof(ElementType)) );
-    element->_set_data_size(size);
-    m_size ++;
-    
+    element->_set_data_size(checked_offset<SizeType>((ptrdiff_t)size));
+  }
+  /**
+   * @brief 追加一段在别处构造好的连续元素（如其他线程的子内存段），按字节原样拷贝
+   *        元素内部全部是相对偏移，只要不引用自身范围以外的内容，整体搬移后依然有效
+   * 
+   * @param data  count 个连续元素的起始地址
+   * @param bytes 这些元素（含其负载）的总字节数
+   * @param count 元素个数
+   *        对齐布局下 data 相对其所在内存段须按 layout_max_align() 对齐、bytes 为其整数倍；
+   *        已有元素时，为对齐插入的填充计入最后一个元素，要求已有元素之后没有其他分配
+   */
+  bool              append_elements(const char* data,size_t bytes,SizeType count,segment_manager& segment)
+  {
+    MMO_ALLOC_KIND(alloc_var_block);
+    char* before = segment.current();
+    char* dst = segment.alloc(bytes,layout_max_align());
+    if(dst == NULL)
+    {
+      size_t free_size = segment.get_free_memory();
+      size_t used_size = segment.size();
+      std::string strErrMsg = "mmo_exception:: no enough memory,free:" + std::to_string(free_size) + ",used:"
+        + std::to_string(used_size) + ",alloc size:" + std::to_string(bytes) ;
+      throw mmo_exception((int32_t)mmo_exception::no_enough_memory,strErrMsg);
+      return false;
+    }
+    if(m_size == 0)
+      _set_offset(checked_offset<SizeType>(dst - (char*)this));
+    else if(dst != before && !segment.measuring())
+    {
+      //元素逐个首尾相接，对齐填充并入前一个元素的负载，遍历时才能跳到新元素
+      ElementType* last = _get_element(m_size - 1);
+      if(last->_get_data_addr() + last->_data_bytes() != before)
+        throw mmo_exception((int32_t)mmo_exception::invalid_memory_address,"mmo_exception:: var_vector elements are not contiguous!");
+      last->_set_data_size(checked_offset<SizeType>((ptrdiff_t)(dst - last->_get_data_addr())));
+    }
+    if(!segment.measuring())
+      memcpy(dst,data,bytes);
+    m_size += count;
     return true;
   }
 public:
@@ -618,7 +1028,7 @@ public:
   }
 	iterator					end()const	{return iterator(NULL,m_size,m_size);}
 public:
-  //在这个实现中，下标访问是低效的，不建议使用，推荐使用迭代器遍历
+  //在这个实现中，下标访问是低效的，不建议使用，推荐使用迭代器遍历；需要随机访问时使用 indexed_var_vector
   ValueType&        operator[](SizeType index) {return _get_element(index)->object();}
   const ValueType&  operator[](SizeType index)const {return _get_element(index)->object();}
   ValueType&        at(SizeType index) {return _get_element(index)->object();}
@@ -638,6 +1048,158 @@ protected:
     return (ElementType*)((char*)this + m_offset);
   }
 };
+template<typename ValueType,typename SizeType>
+struct has_relative_offset<var_vector<ValueType,SizeType>>:std::true_type{};
+
+/**
+ * @brief 带偏移索引的变长 vector：在全部元素之后追加一张偏移表，下标访问 O(1)，有序时可二分查找
+ *        元素仍连续存放，布局与 var_vector 相同，只是对象头多一个索引表偏移；
+ *        偏移表每项为元素相对首元素的偏移，宽度与 SizeType 相同。
+ *        用法：prepare_append_elements / begin_append_element / end_append_element 之后，
+ *        调用 finish_append_elements 生成索引；不调用则退化为 var_vector 的顺序访问。
+ * 
+ * @tparam ValueType 
+ * @tparam SizeType 
+ */
+template<typename ValueType,typename SizeType>
+class indexed_var_vector:
+  public var_vector<ValueType,SizeType>
+{
+  typedef var_vector<ValueType,SizeType>          BaseType;
+  typedef indexed_var_vector<ValueType,SizeType>  SelfType;
+  typedef var_element<ValueType,SizeType>         ElementType;
+protected:
+  SizeType        m_index_offset;
+public:
+  indexed_var_vector()
+  {
+    m_index_offset = 0;
+  }
+  indexed_var_vector(const SelfType&) = delete; 
+  SelfType& operator=(const SelfType&) = delete;
+public:
+  void              prepare_append_elements(segment_manager& segment)
+  {
+    m_index_offset = 0;
+    BaseType::prepare_append_elements(segment);
+  }
+  /**
+   * @brief 全部元素追加完毕后生成偏移表
+   */
+  bool              finish_append_elements(segment_manager& segment)
+  {
+    size_t    bytes = sizeof(SizeType) * (size_t)this->m_size;
+    MMO_ALLOC_KIND(alloc_index_table);
+    SizeType* table = (SizeType*)segment.alloc(bytes,layout_array_align<SizeType>(bytes));
+    if(table == NULL)
+    {
+      size_t free_size = segment.get_free_memory();
+      size_t used_size = segment.size();
+      std::string strErrMsg = "mmo_exception:: no enough memory,free:" + std::to_string(free_size) + ",used:"
+        + std::to_string(used_size) + ",alloc size:" + std::to_string(bytes) ;
+      throw mmo_exception((int32_t)mmo_exception::no_enough_memory,strErrMsg);
+      return false;
+    }
+    m_index_offset = (this->m_size == 0) ? (SizeType)((char*)table - (char*)this) : checked_offset<SizeType>((char*)table - (char*)this);
+    if(segment.measuring())
+      return true;
+    const char*         first   = (const char*)this->_get_data_addr();
+    const ElementType*  element = this->_get_data_addr();
+    for(SizeType i = 0;i < this->m_size;i++)
+    {
+      table[i] = checked_offset<SizeType>((const char*)element - first);
+      element  = (const ElementType*)( element->_get_data_addr() + element->_data_bytes() );
+    }
+    return true;
+  }
+  void              assign(const std::vector<ValueType>& src,segment_manager& segment)
+  {
+    prepare_append_elements(segment);
+    BaseType::assign(src,segment);
+    finish_append_elements(segment);
+  }
+  void              assign(const std::list<ValueType>& src,segment_manager& segment)
+  {
+    prepare_append_elements(segment);
+    BaseType::assign(src,segment);
+    finish_append_elements(segment);
+  }
+  bool              indexed()const{return m_index_offset != 0;}
+public:
+  ElementType*       _get_element(SizeType index)
+  {
+    if(!indexed())
+      return BaseType::_get_element(index);
+    return (ElementType*)((char*)this->_get_data_addr() + _index_table()[index]);
+  }
+  const ElementType* _get_element(SizeType index)const
+  {
+    if(!indexed())
+      return BaseType::_get_element(index);
+    return (const ElementType*)((const char*)this->_get_data_addr() + _index_table()[index]);
+  }
+public:
+  ValueType&        operator[](SizeType index) {return _get_element(index)->object();}
+  const ValueType&  operator[](SizeType index)const {return _get_element(index)->object();}
+  ValueType&        at(SizeType index) {return _get_element(index)->object();}
+  const ValueType&  at(SizeType index)const{return _get_element(index)->object();}
+  ValueType&        front(){return _get_element(0)->object();}
+  const ValueType&  front()const {return _get_element(0)->object();}
+  ValueType&        back(){return _get_element(this->m_size-1)->object();}
+  const ValueType&  back()const {return _get_element(this->m_size-1)->object();}
+public:
+  /**
+   * @brief 元素按 less 有序时，二分查找第一个不小于 key 的下标，找不到返回 size()
+   * 
+   * @param key 
+   * @param less 可调用对象：bool(const ValueType&,const Key&)
+   */
+  template<typename Key,typename Compare>
+  SizeType          lower_bound(const Key& key,Compare less)const
+  {
+    SizeType first = 0;
+    SizeType count = this->m_size;
+    while(count > 0)
+    {
+      SizeType step = count / 2;
+      if(less(at(first + step),key))
+      {
+        first = first + step + 1;
+        count = count - step - 1;
+      }
+      else
+        count = step;
+    }
+    return first;
+  }
+  /**
+   * @brief 元素按 less 有序时，二分查找第一个大于 key 的下标，找不到返回 size()
+   * 
+   * @param less 可调用对象：bool(const Key&,const ValueType&)
+   */
+  template<typename Key,typename Compare>
+  SizeType          upper_bound(const Key& key,Compare less)const
+  {
+    SizeType first = 0;
+    SizeType count = this->m_size;
+    while(count > 0)
+    {
+      SizeType step = count / 2;
+      if(!less(key,at(first + step)))
+      {
+        first = first + step + 1;
+        count = count - step - 1;
+      }
+      else
+        count = step;
+    }
+    return first;
+  }
+public:
+  const SizeType*   _index_table()const{return (const SizeType*)((const char*)this + m_index_offset);}
+};
+template<typename ValueType,typename SizeType>
+struct has_relative_offset<indexed_var_vector<ValueType,SizeType>>:std::true_type{};
 
 template<typename KeyType,typename ValueType,typename SizeType>
 class hash_node
@@ -774,7 +1336,8 @@ public:
   {
     if(hash_size <= 0)
       hash_size = capacity;
-    return sizeof(SelfType) + sizeof(NodePtr)*hash_size + sizeof(NodeType)*capacity ;
+    return sizeof(SelfType) + sizeof(NodePtr)*hash_size + sizeof(NodeType)*capacity
+      + (layout_array_align<NodePtr>(sizeof(NodePtr)*hash_size) - 1) + (layout_align<NodeType>() - 1)*capacity;
   }
   bool  init_hash(SizeType capacity,segment_manager& segment,SizeType hash_size=0)
   {
@@ -782,8 +1345,9 @@ public:
       return false;
     m_capacity        = capacity;    
     m_key_table_size  = (hash_size <= 0)?capacity:hash_size;
+    MMO_ALLOC_KIND(alloc_hash_table);
 
-    NodePtr* pNodes = (NodePtr*)segment.alloc(m_key_table_size*sizeof(NodePtr));
+    NodePtr* pNodes = (NodePtr*)segment.alloc(m_key_table_size*sizeof(NodePtr),layout_array_align<NodePtr>(m_key_table_size*sizeof(NodePtr)));
     if(pNodes == NULL)
     {
       m_capacity        = 0;
@@ -792,7 +1356,7 @@ public:
       return false;
     }
     m_key_table         = pNodes;
-    for(SizeType i=0;i<capacity;i++)
+    for(SizeType i=0;i<m_key_table_size;i++)
       pNodes[i]=NULL;
     return true;
   }
@@ -806,6 +1370,7 @@ public:
   }
   bool     add(KeyType key,const ValueType& value,segment_manager& segment)
   {
+    MMO_ALLOC_KIND(alloc_hash_node);
     if(m_size >= m_capacity)
       return false;//no enough space
 
@@ -813,7 +1378,7 @@ public:
     NodeType*   n     = seek(index);
     if(n == NULL)
     {
-      NodeType* v = (NodeType*)segment.alloc(sizeof(NodeType));
+      NodeType* v = (NodeType*)segment.alloc(sizeof(NodeType),layout_align<NodeType>());
       if(v == NULL)
       {
         throw mmo_exception((int32_t)mmo_exception::no_enough_memory,"mmo_exception:: no enough memory!");
@@ -833,7 +1398,7 @@ public:
     {
       if(n->next == NULL)
       {
-        NodeType* v = (NodeType*)segment.alloc(sizeof(NodeType));
+        NodeType* v = (NodeType*)segment.alloc(sizeof(NodeType),layout_align<NodeType>());
         if(v == NULL)          
         {
           throw mmo_exception((int32_t)mmo_exception::no_enough_memory,"mmo_exception:: no enough memory!");
@@ -854,6 +1419,7 @@ public:
   }
   iresult  insert(KeyType key,const ValueType& value,segment_manager& segment)
   {
+    MMO_ALLOC_KIND(alloc_hash_node);
     if(m_size >= m_capacity)
       return iresult(false,NULL);//no enough space
 
@@ -930,6 +1496,77 @@ public:
       n = n->next.get();
     return (n==NULL)?NULL:&n->value;
   }
+  /**
+   * @brief 批量查找，结果与逐个调用 get() 相同
+   *        按批先算出全部桶下标并预取桶，再读桶头并预取节点，最后各条链交错前进，
+   *        每步都预取下一节点，使一批查找的缓存未命中相互重叠，而不是逐个串行等待
+   * 
+   * @param keys  待查的键
+   * @param count 键的个数
+   * @param out   输出：每个键对应值的地址，未找到为 NULL
+   * @return size_t 找到的个数
+   */
+  size_t    get_many(const KeyType* keys,size_t count,const ValueType** out)const
+  {
+    enum { batch = 16 };
+    const NodePtr*  heads[batch];
+    const NodeType* nodes[batch];
+    uint8_t         active[batch];
+    const NodePtr*  table = (const NodePtr*)m_key_table.get();
+    size_t          found = 0;
+    for(size_t base = 0;base < count;base += batch)
+    {
+      size_t          n     = (count - base < (size_t)batch) ? (count - base) : (size_t)batch;
+      const KeyType*  kp    = keys + base;
+      const ValueType** op  = out + base;
+      for(size_t i = 0;i < n;i++)
+      {
+        SizeType index = key2index(kp[i]);
+        heads[i] = (index < m_key_table_size) ? (table + index) : NULL;
+        if(heads[i] != NULL)
+          __builtin_prefetch(heads[i]);
+      }
+      size_t pending = 0;
+      for(size_t i = 0;i < n;i++)
+      {
+        const NodeType* node = (heads[i] != NULL) ? heads[i]->get() : NULL;
+        nodes[i] = node;
+        op[i]    = NULL;
+        if(node != NULL)
+        {
+          __builtin_prefetch(node);
+          active[pending++] = (uint8_t)i;
+        }
+      }
+      while(pending != 0)
+      {
+        size_t remain = 0;
+        for(size_t k = 0;k < pending;k++)
+        {
+          size_t          i     = active[k];
+          const NodeType* node  = nodes[i];
+          if(node->key == kp[i])
+          {
+            op[i] = &node->value;
+            ++ found;
+            continue;
+          }
+          node = node->next.get();
+          if(node == NULL)
+            continue;
+          __builtin_prefetch(node);
+          nodes[i]          = node;
+          active[remain++]  = (uint8_t)i;
+        }
+        pending = remain;
+      }
+    }
+    return found;
+  }
+  size_t    get_many(const KeyType* keys,size_t count,ValueType** out)
+  {
+    return ((const SelfType*)this)->get_many(keys,count,(const ValueType**)out);
+  }
   bool      empty()const
   {
     return m_size==0;
@@ -955,6 +1592,9 @@ public:
   {
     return iterator((SelfType*)this,m_key_table_size,(NodeType*)NULL);
   }
+public:
+  const NodePtr*    _key_table()const{return m_key_table.get();}
+  const ValueType&  _default_value()const{return m_default_value;}
 protected:
   NodeType*     seek(SizeType index)const
   {
@@ -968,16 +1608,21 @@ protected:
     if(m_key_table_size != 0)
     {
       std::hash<KeyType>  key_hash;
-      return SizeType( key_hash(key) )%m_key_table_size;
+      //先按 size_t 取模再收窄，有符号的 SizeType 截断 hash 后可能为负
+      //注意：hash 超出 SizeType 范围的键（如 int32_t SizeType 下 >= 2^31 的 uint64_t 键）落入的桶与旧算法不同，
+      //      旧镜像中的这类键查不到，因此镜像格式版本升为 2（image_header::format_version），旧镜像需重新构造
+      return SizeType( key_hash(key) % (size_t)m_key_table_size );
     } 
     return 1;
   }
 
 
 };
+template<typename KeyType,typename ValueType,typename SizeType>
+struct has_relative_offset<hash_map<KeyType,ValueType,SizeType>>:std::true_type{};
 
 
-#pragma pack(pop)
+MMO_PACK_END
 
 
 
@@ -0,0 +1,448 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_net.h
+*           复杂对象--线性映射库--镜像的分散/聚集收发
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include "mmo_segment.h"
+#include "mmo_image.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <linux/errqueue.h>
+
+namespace mmo
+{
+
+/**
+ * @brief 线上格式与镜像文件相同：[image_header][镜像数据 image_size 字节]
+ *        因此 send_image 发送内存中的镜像，send_image_file 用 sendfile 直接发送保存好的镜像文件，
+ *        接收端都用 receive_image 读入，也可以把收到的字节原样存成文件再 mapped_image 映射。
+ *        边构造边发送的镜像（send_stream_image，mmo_stream.h）大小事先未知，另用顺序流格式，由 receive_stream_image 读入。
+ */
+enum
+{
+  send_zerocopy = 0x1,    //使用 MSG_ZEROCOPY，内核直接引用用户页，返回前等待全部完成通知；不支持时退化为普通发送
+};
+
+/**
+ * @brief 接收到的镜像，数据位于按页对齐的独立映射中，对象可直接在其上使用
+ */
+class received_image
+{
+protected:
+  char*         m_map{nullptr};
+  size_t        m_map_size{0};
+  image_header  m_header;
+public:
+  received_image(){}
+  received_image(const received_image&) = delete;
+  received_image& operator=(const received_image&) = delete;
+  received_image(received_image&& other)
+  {
+    swap(other);
+  }
+  received_image& operator=(received_image&& other)
+  {
+    close();
+    swap(other);
+    return *this;
+  }
+  ~received_image(){close();}
+public:
+  /**
+   * @brief 从 fd 读取一个镜像：先读文件头并校验，再按 image_size 分配对齐的缓冲区，数据直接读入其中
+   *
+   * @param fd              套接字、管道或文件
+   * @param layout_version  期望的布局版本，为 0 时不校验
+   * @param max_bytes       允许的最大镜像字节数，防止对端声明超大长度
+   */
+  void    receive(int fd,uint32_t layout_version = 0,size_t max_bytes = (size_t)1 << 34)
+  {
+    close();
+    image_header header;
+    if(!_read_all(fd,(char*)&header,sizeof(header)))
+      throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: receive image header failed,errno:" + std::to_string(errno));
+    if(header.image_size > max_bytes || !header.valid(sizeof(image_header) + (size_t)header.image_size)
+      || (layout_version != 0 && header.layout_version != layout_version))
+      throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: invalid image header!");
+
+    size_t page = (size_t)::sysconf(_SC_PAGESIZE);
+    size_t size = ((size_t)header.image_size + page - 1) / page * page;
+    void*  p    = ::mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+    if(p == MAP_FAILED)
+      throw mmo_exception((int32_t)mmo_exception::no_enough_memory,"mmo_exception:: no enough memory,alloc size:" + std::to_string(size));
+    m_map       = (char*)p;
+    m_map_size  = size;
+    m_header    = header;
+    if(!_read_all(fd,m_map,(size_t)header.image_size))
+    {
+      int error = errno;
+      close();
+      throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: receive image failed,errno:" + std::to_string(error));
+    }
+  }
+  /**
+   * @brief 从 fd 读取 send_stream_image（mmo_stream.h）按顺序流格式发出的镜像：
+   *        镜像大小事先未知，先按 max_bytes 预留地址空间（只占虚拟地址）逐块读入，
+   *        再按尾部记录回填钉住区，最后读文件头并核对镜像大小，未用的预留随即归还
+   *
+   * @param fd              套接字或管道
+   * @param layout_version  期望的布局版本，为 0 时不校验
+   * @param max_bytes       允许的最大镜像字节数，防止对端发送超长的流
+   */
+  void    receive_stream(int fd,uint32_t layout_version = 0,size_t max_bytes = (size_t)1 << 34)
+  {
+    close();
+    size_t page     = (size_t)::sysconf(_SC_PAGESIZE);
+    size_t reserve  = (max_bytes + page - 1) / page * page;
+    if(reserve == 0)
+      reserve = page;
+    void*  p        = ::mmap(NULL,reserve,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE,-1,0);
+    if(p == MAP_FAILED)
+      throw mmo_exception((int32_t)mmo_exception::no_enough_memory,"mmo_exception:: reserve address space failed,size:" + std::to_string(reserve));
+    m_map       = (char*)p;
+    m_map_size  = reserve;
+    auto fail = [this](int code,const std::string& msg)
+    {
+      close();
+      throw mmo_exception(code,"mmo_exception:: " + msg);
+    };
+
+    size_t size = 0;
+    for(;;)
+    {
+      uint64_t len = 0;
+      if(!_read_all(fd,(char*)&len,sizeof(len)))
+        fail((int32_t)mmo_exception::io_error,"receive stream block failed,errno:" + std::to_string(errno));
+      if(len == 0)
+        break;
+      if(len > max_bytes - size)
+        fail((int32_t)mmo_exception::invalid_image,"stream image exceeds max bytes:" + std::to_string(max_bytes));
+      if(!_read_all(fd,m_map + size,(size_t)len))
+        fail((int32_t)mmo_exception::io_error,"receive stream block failed,errno:" + std::to_string(errno));
+      size += (size_t)len;
+    }
+    uint64_t count = 0;
+    if(!_read_all(fd,(char*)&count,sizeof(count)))
+      fail((int32_t)mmo_exception::io_error,"receive stream trailer failed,errno:" + std::to_string(errno));
+    for(uint64_t i = 0;i < count;i++)
+    {
+      uint64_t record[2] = {0,0};
+      if(!_read_all(fd,(char*)record,sizeof(record)))
+        fail((int32_t)mmo_exception::io_error,"receive stream trailer failed,errno:" + std::to_string(errno));
+      if(record[0] > size || record[1] > size - record[0])
+        fail((int32_t)mmo_exception::invalid_image,"stream pin out of image");
+      if(!_read_all(fd,m_map + record[0],(size_t)record[1]))
+        fail((int32_t)mmo_exception::io_error,"receive stream trailer failed,errno:" + std::to_string(errno));
+    }
+    image_header header;
+    if(!_read_all(fd,(char*)&header,sizeof(header)))
+      fail((int32_t)mmo_exception::io_error,"receive image header failed,errno:" + std::to_string(errno));
+    if(header.image_size != size || !header.valid(sizeof(image_header) + size)
+      || (layout_version != 0 && header.layout_version != layout_version))
+      fail((int32_t)mmo_exception::invalid_image,"invalid image header!");
+    m_header = header;
+
+    size_t used = (size + page - 1) / page * page;
+    if(used < page)
+      used = page;
+    if(used < m_map_size)
+    {
+      ::munmap(m_map + used,m_map_size - used);
+      m_map_size = used;
+    }
+  }
+  void    close()
+  {
+    if(m_map != nullptr)
+      ::munmap(m_map,m_map_size);
+    m_map       = nullptr;
+    m_map_size  = 0;
+    m_header    = image_header();
+  }
+public:
+  bool                is_open()const{return m_map != nullptr;}
+  const image_header& header()const{return m_header;}
+  const char*         data()const{return m_map;}
+  char*               data(){return m_map;}
+  size_t              size()const{return (size_t)m_header.image_size;}
+  /**
+   * @brief 获取根对象；数据来自网络时，先用 mmo::verified_root<T>(data(),size(),header().root_offset) 校验
+   */
+  template<typename T>
+  const T*            root()const
+  {
+    if(m_map == nullptr || m_header.root_offset + sizeof(T) > m_header.image_size)
+      throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: image root out of range!");
+    return (const T*)(m_map + m_header.root_offset);
+  }
+protected:
+  void    swap(received_image& other)
+  {
+    std::swap(m_map,other.m_map);
+    std::swap(m_map_size,other.m_map_size);
+    std::swap(m_header,other.m_header);
+  }
+  /**
+   * @brief 读满 bytes 字节，对端提前关闭视为失败
+   */
+  static bool _read_all(int fd,char* p,size_t bytes)
+  {
+    while(bytes > 0)
+    {
+      ssize_t n = ::read(fd,p,bytes);
+      if(n < 0 && errno == EINTR)
+        continue;
+      if(n <= 0)
+      {
+        if(n == 0)
+          errno = ECONNRESET;
+        return false;
+      }
+      p     += n;
+      bytes -= (size_t)n;
+    }
+    return true;
+  }
+};
+
+/**
+ * @brief 从 fd 读取一个镜像
+ */
+inline received_image receive_image(int fd,uint32_t layout_version = 0,size_t max_bytes = (size_t)1 << 34)
+{
+  received_image image;
+  image.receive(fd,layout_version,max_bytes);
+  return image;
+}
+
+/**
+ * @brief 从 fd 读取一个按顺序流格式发出的镜像（send_stream_image）
+ */
+inline received_image receive_stream_image(int fd,uint32_t layout_version = 0,size_t max_bytes = (size_t)1 << 34)
+{
+  received_image image;
+  image.receive_stream(fd,layout_version,max_bytes);
+  return image;
+}
+
+/**
+ * @brief 一次 sendmsg/writev 把分散的块写完，部分写入时推进 iovec 继续；不修改调用方的数组
+ *
+ * @return int 0 成功，否则为 errno
+ */
+inline int _send_blocks(int fd,const struct iovec* blocks,size_t count,bool& zerocopy,size_t& zerocopy_calls)
+{
+  std::vector<struct iovec> iov(blocks,blocks + count);
+  size_t first = 0;
+  while(first < iov.size())
+  {
+    if(iov[first].iov_len == 0)
+    {
+      first++;
+      continue;
+    }
+    size_t n_iov = iov.size() - first;
+    if(n_iov > (size_t)IOV_MAX)
+      n_iov = IOV_MAX;
+    struct msghdr msg;
+    memset(&msg,0,sizeof(msg));
+    msg.msg_iov     = &iov[first];
+    msg.msg_iovlen  = n_iov;
+    int     flags   = MSG_NOSIGNAL;
+#if defined(MSG_ZEROCOPY)
+    if(zerocopy)
+      flags |= MSG_ZEROCOPY;
+#endif
+    ssize_t n = ::sendmsg(fd,&msg,flags);
+    if(n < 0 && errno == ENOTSOCK)
+      n = ::writev(fd,&iov[first],(int)n_iov);
+    if(n < 0)
+    {
+      if(errno == EINTR)
+        continue;
+      //零拷贝锁定页数超过 optmem 限制时退化为普通发送
+      if(errno == ENOBUFS && zerocopy)
+      {
+        zerocopy = false;
+        continue;
+      }
+      return errno;
+    }
+    if(zerocopy)
+      zerocopy_calls++;
+    size_t sent = (size_t)n;
+    while(sent > 0 && first < iov.size())
+    {
+      if(sent >= iov[first].iov_len)
+      {
+        sent -= iov[first].iov_len;
+        first++;
+      }
+      else
+      {
+        iov[first].iov_base  = (char*)iov[first].iov_base + sent;
+        iov[first].iov_len  -= sent;
+        sent = 0;
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief 等待 calls 次零拷贝发送的完成通知，之后缓冲区才可修改或释放
+ *        要求期间没有其他线程在同一套接字上做零拷贝发送
+ */
+inline int _wait_zerocopy(int fd,size_t calls)
+{
+#if defined(SO_EE_ORIGIN_ZEROCOPY)
+  size_t done = 0;
+  while(done < calls)
+  {
+    char            control[128];
+    struct msghdr   msg;
+    memset(&msg,0,sizeof(msg));
+    msg.msg_control     = control;
+    msg.msg_controllen  = sizeof(control);
+    if(::recvmsg(fd,&msg,MSG_ERRQUEUE) < 0)
+    {
+      if(errno == EINTR)
+        continue;
+      if(errno != EAGAIN && errno != EWOULDBLOCK)
+        return errno;
+      struct pollfd pfd = {fd,0,0};
+      ::poll(&pfd,1,-1);     //错误队列非空时报告 POLLERR
+      continue;
+    }
+    for(struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);cm != NULL;cm = CMSG_NXTHDR(&msg,cm))
+    {
+      const struct sock_extended_err* ee = (const struct sock_extended_err*)CMSG_DATA(cm);
+      if(ee->ee_errno == 0 && ee->ee_origin == SO_EE_ORIGIN_ZEROCOPY)
+        done += (size_t)(ee->ee_data - ee->ee_info) + 1;    //[ee_info,ee_data] 区间内的发送均已完成
+    }
+  }
+#else
+  (void)fd;
+  (void)calls;
+#endif
+  return 0;
+}
+
+/**
+ * @brief 发送由若干块组成的镜像：文件头与各块一起交给 sendmsg，不在用户态拼接
+ *
+ * @param fd              套接字、管道或文件
+ * @param blocks          镜像数据的各块，按顺序首尾相接即为完整镜像
+ * @param root_offset     根对象相对镜像起始的偏移
+ * @param flags           send_zerocopy 等
+ * @return size_t 发送的总字节数（含文件头）
+ */
+inline size_t send_image(int fd,const struct iovec* blocks,size_t count,size_t root_offset,
+                         uint32_t layout_version = 0,int flags = 0)
+{
+  image_header header;
+  header.layout_version = layout_version;
+  header.root_offset    = root_offset;
+  header.image_size     = 0;
+  for(size_t i = 0;i < count;i++)
+    header.image_size  += blocks[i].iov_len;
+  if(root_offset >= header.image_size)
+    throw mmo_exception((int32_t)mmo_exception::invalid_memory_address,"mmo_exception:: image root out of segment!");
+
+  std::vector<struct iovec> iov;
+  iov.reserve(count + 1);
+  struct iovec head = {&header,sizeof(header)};
+  iov.push_back(head);
+  iov.insert(iov.end(),blocks,blocks + count);
+
+  bool zerocopy = false;
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+  int one = 1;
+  if((flags & send_zerocopy) != 0)
+    zerocopy = (::setsockopt(fd,SOL_SOCKET,SO_ZEROCOPY,&one,sizeof(one)) == 0);
+#else
+  (void)flags;
+#endif
+  size_t calls = 0;
+  int    error = _send_blocks(fd,iov.data(),iov.size(),zerocopy,calls);
+  if(error == 0 && calls > 0)
+    error = _wait_zerocopy(fd,calls);
+  if(error != 0)
+    throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: send image failed,errno:" + std::to_string(error));
+  return sizeof(header) + (size_t)header.image_size;
+}
+
+/**
+ * @brief 发送构造完成的内存段
+ */
+inline size_t send_image(int fd,const segment_manager& segment,const void* root,uint32_t layout_version = 0,int flags = 0)
+{
+  if((const char*)root < segment.data() || (const char*)root >= segment.data() + segment.size())
+    throw mmo_exception((int32_t)mmo_exception::invalid_memory_address,"mmo_exception:: image root out of segment!");
+  struct iovec block = {(void*)segment.data(),segment.size()};
+  return send_image(fd,&block,1,(size_t)((const char*)root - segment.data()),layout_version,flags);
+}
+
+/**
+ * @brief 发送可增长内存段，按提交块分散发送
+ */
+inline size_t send_image(int fd,const growable_segment& segment,const void* root,uint32_t layout_version = 0,int flags = 0)
+{
+  if((const char*)root < segment.data() || (const char*)root >= segment.data() + segment.size())
+    throw mmo_exception((int32_t)mmo_exception::invalid_memory_address,"mmo_exception:: image root out of segment!");
+  std::vector<struct iovec> blocks;
+  segment.scatter(blocks);
+  return send_image(fd,blocks.data(),blocks.size(),(size_t)((const char*)root - segment.data()),layout_version,flags);
+}
+
+/**
+ * @brief 用 sendfile 发送 save_image/stream_image 保存的镜像文件，数据不经过用户态
+ *
+ * @return size_t 发送的总字节数
+ */
+inline size_t send_image_file(int fd,const std::string& path)
+{
+  int file = ::open(path.c_str(),O_RDONLY|O_CLOEXEC);
+  if(file < 0)
+    throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: open file failed:" + path);
+  struct stat st;
+  image_header header;
+  if(::fstat(file,&st) != 0 || ::pread(file,&header,sizeof(header),0) != (ssize_t)sizeof(header)
+    || !header.valid((size_t)st.st_size))
+  {
+    ::close(file);
+    throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: invalid image file:" + path);
+  }
+  size_t  total   = sizeof(header) + (size_t)header.image_size;
+  off_t   offset  = 0;
+  int     error   = 0;
+  while((size_t)offset < total)
+  {
+    ssize_t n = ::sendfile(fd,file,&offset,total - (size_t)offset);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n <= 0)
+    {
+      error = (n < 0) ? errno : EIO;
+      break;
+    }
+  }
+  ::close(file);
+  if(error != 0)
+    throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: send image file failed,errno:" + std::to_string(error));
+  return total;
+}
+
+}//end namespace mmo
@@ -0,0 +1,251 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_offset.h
+*           复杂对象--线性映射库--偏移宽度选择与远近指针
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include "mmo_segment.h"
+#include <type_traits>
+#include <cstdint>
+
+namespace mmo
+{
+
+/**
+ * @brief 偏移类型的标签，用于把偏移类型作为参数传给泛型构造函数
+ */
+template<typename OffsetType>
+struct offset_tag
+{
+  typedef OffsetType type;
+};
+
+/**
+ * @brief 编译期选择：能表示 [-MaxDistance,MaxDistance] 的最小有符号偏移类型
+ */
+template<uint64_t MaxDistance>
+struct offset_type_for
+{
+  typedef typename std::conditional<MaxDistance <= (uint64_t)INT16_MAX,int16_t,
+          typename std::conditional<MaxDistance <= (uint64_t)INT32_MAX,int32_t,int64_t>::type>::type type;
+};
+
+/**
+ * @brief 按偏移宽度（字节数 2/4/8）以对应的 offset_tag 调用 func
+ */
+template<typename Func>
+void  dispatch_offset_type(size_t offset_bytes,Func&& func)
+{
+  if(offset_bytes <= sizeof(int16_t))
+    func(offset_tag<int16_t>());
+  else if(offset_bytes <= sizeof(int32_t))
+    func(offset_tag<int32_t>());
+  else
+    func(offset_tag<int64_t>());
+}
+
+/**
+ * @brief 从最终布局试出够用的最小偏移宽度
+ *        依次以 int16_t、int32_t、int64_t 作为偏移类型在测量段中试构造，
+ *        各容器写入偏移时都会检查范围（checked_offset），第一个不抛出 offset_overflow 的宽度即为所需。
+ *        需要的是实际出现的最大偏移，而不是镜像大小：子对象紧随父对象构造时，大镜像也可能只需 16 位偏移。
+ *
+ * @tparam Builder      可调用对象：void(segment_manager&,offset_tag<T>)，按 T 实例化全部容器后执行构造，
+ *                      通常写成泛型 lambda：[&](mmo::segment_manager& segment,auto tag){...}
+ * @param image_bytes   输出：该宽度下镜像的字节数，可为 nullptr
+ * @return size_t       偏移宽度的字节数
+ *
+ *   template<typename O> class CRoadMapT{ mmo::indexed_var_vector<CRoadT<O>,O> m_road_map; ... };
+ *   auto build = [&](mmo::segment_manager& segment,auto tag)
+ *   {
+ *     mmo::construct<CRoadMapT<typename decltype(tag)::type>>(segment)->init(count,segment);
+ *   };
+ *   size_t bytes = 0;
+ *   size_t width = mmo::select_offset_bytes(build,&bytes);
+ *   std::vector<char> buf(bytes);
+ *   mmo::segment_manager segment(buf.data(),buf.size());
+ *   mmo::dispatch_offset_type(width,[&](auto tag){build(segment,tag);});
+ */
+template<typename Builder>
+size_t  select_offset_bytes(Builder&& build,size_t* image_bytes = nullptr)
+{
+  size_t widths[] = {sizeof(int16_t),sizeof(int32_t)};
+  for(size_t width:widths)
+  {
+    try
+    {
+      size_t bytes = 0;
+      dispatch_offset_type(width,[&](auto tag)
+      {
+        bytes = measure([&](segment_manager& segment){build(segment,tag);});
+      });
+      if(image_bytes != nullptr)
+        *image_bytes = bytes;
+      return width;
+    }
+    catch(const mmo_exception& e)
+    {
+      if(e.code() != (int32_t)mmo_exception::offset_overflow)
+        throw;
+    }
+  }
+  if(image_bytes != nullptr)
+    *image_bytes = measure([&](segment_manager& segment){build(segment,offset_tag<int64_t>());});
+  return sizeof(int64_t);
+}
+
+MMO_PACK_BEGIN
+
+/**
+ * @brief 远近两级的相对寻址指针
+ *        目标在 NearType 可表示的范围内时为近指针，只占 sizeof(NearType) 字节（int16_t 时约 ±16KB）；
+ *        超出时在内存段中分配一个 FarType 的远程偏移槽，指针改存到该槽的近偏移，槽中再存到目标的宽偏移。
+ *        这样镜像可以超过 4GB，而绝大多数指向邻近子对象的指针仍是 16 位，只有少数远指针多占一个槽。
+ *        编码：0 为空；最低位为 0 时其余位是到目标的偏移；最低位为 1 时其余位是到远程偏移槽的偏移，槽中为 0 表示空。
+ *        注意：
+ *          1. 远程偏移槽分配在内存段的当前位置，须在指针本身附近（NearType 范围内）。
+ *             目标可能在远处时，应在含 far_ptr 的对象构造后、构造其他成员之前先 reserve，
+ *             之后不论再分配多少内容，assign 都写入这个预留的槽：
+ *               Node* node = mmo::construct<Node>(segment);
+ *               node->m_next.reserve(segment);
+ *               node->m_payload.resize(40000,segment);
+ *               node->m_next.assign(target,segment);
+ *             未预留时 assign 只能在当前位置仍在近范围内时临时分配槽，否则抛出 offset_overflow；
+ *          2. 深拷贝时同理，须在 mmo_copy 钩子的开头调用 copy.reserve(m_next,src.m_next)（见 mmo_copy.h）；
+ *          3. 拷贝与 operator= 只能生成近指针，目标超出近范围时抛出 offset_overflow，需要远指针时用 assign。
+ *
+ * @tparam ValueType
+ * @tparam NearType 指针本身的偏移类型
+ * @tparam FarType  远程偏移槽的偏移类型
+ */
+template<typename ValueType,typename NearType = int16_t,typename FarType = int64_t>
+class far_ptr
+{
+  typedef far_ptr<ValueType,NearType,FarType>   SelfType;
+protected:
+  NearType      m_value;
+public:
+  far_ptr()
+  {
+    m_value = 0;
+  }
+  far_ptr(const SelfType& other)
+  {
+    _set_near(other.get());
+  }
+  SelfType& operator=(const SelfType& other)
+  {
+    _set_near(other.get());
+    return *this;
+  }
+public:
+  /**
+   * @brief 在 segment 的当前位置预留远程偏移槽，之后的 assign/reset 都经由该槽，见类说明
+   *        已预留时不重复分配。
+   */
+  void  reserve(segment_manager& segment)
+  {
+    if(_is_far())
+      return;
+    FarType* slot = _alloc_slot(segment);
+    *slot   = 0;
+    m_value = checked_offset<NearType>(((const char*)slot - (const char*)this) * 2 + 1);
+  }
+  /**
+   * @brief 指向 target：已预留槽时写入槽中；否则在近范围内存为近指针，存不下时在 segment 中分配远程偏移槽
+   */
+  void  assign(const ValueType* target,segment_manager& segment)
+  {
+    if(_is_far())
+    {
+      _set_slot(target);
+      return;
+    }
+    ptrdiff_t distance = (const char*)target - (const char*)this;
+    if(target == NULL || (distance != 0 && offset_fits<NearType>(distance * 2)))
+    {
+      _set_near(target);
+      return;
+    }
+    reserve(segment);
+    _set_slot(target);
+  }
+  /**
+   * @brief 置空，已预留的槽保留
+   */
+  void  reset()
+  {
+    if(_is_far())
+      _set_slot(NULL);
+    else
+      m_value = 0;
+  }
+public:
+  ValueType* get()
+  {
+    return (ValueType*)((const SelfType*)this)->get();
+  }
+  const ValueType* get()const
+  {
+    if(m_value == 0)
+      return NULL;
+    if(!_is_far())
+      return (const ValueType*)((const char*)this + _distance());
+    const FarType* slot = _slot();
+    return (*slot == 0) ? NULL : (const ValueType*)((const char*)slot + *slot);
+  }
+  ValueType* operator->(){return get();}
+  const ValueType* operator->()const{return get();}
+  ValueType& operator* (){return *get();}
+  const ValueType& operator* ()const{return *get();}
+  bool operator==(const ValueType* other)const{return get() == other;}
+  bool operator!=(const ValueType* other)const{return get() != other;}
+  bool operator==(const SelfType& other)const{return get() == other.get();}
+  bool operator!=(const SelfType& other)const{return get() != other.get();}
+public:
+  bool              _is_far()const{return (m_value & 1) != 0;}
+  /**
+   * @brief 远程偏移槽的地址，仅在 _is_far() 时有效
+   */
+  const FarType*    _slot()const{return (const FarType*)((const char*)this + _distance());}
+protected:
+  ptrdiff_t         _distance()const
+  {
+    ptrdiff_t value = (ptrdiff_t)m_value;
+    return (value - (value & 1)) / 2;
+  }
+  FarType*          _alloc_slot(segment_manager& segment)
+  {
+    MMO_ALLOC_KIND(alloc_far_slot);
+    FarType* slot = (FarType*)segment.alloc(sizeof(FarType),layout_align<FarType>());
+    if(slot == NULL)
+      throw mmo_exception((int32_t)mmo_exception::no_enough_memory,"mmo_exception:: no enough memory!");
+    return slot;
+  }
+  void              _set_slot(const ValueType* target)
+  {
+    FarType* slot = (FarType*)_slot();
+    *slot = (target == NULL) ? 0 : checked_offset<FarType>((const char*)target - (const char*)slot);
+  }
+  void              _set_near(const ValueType* target)
+  {
+    if(target == NULL)
+    {
+      m_value = 0;
+      return;
+    }
+    ptrdiff_t distance = (const char*)target - (const char*)this;
+    if(distance == 0)
+      throw mmo_exception((int32_t)mmo_exception::offset_overflow,"mmo_exception:: far_ptr can not point to itself without a slot!");
+    m_value = checked_offset<NearType>(distance * 2);
+  }
+};
+template<typename ValueType,typename NearType,typename FarType>
+struct has_relative_offset<far_ptr<ValueType,NearType,FarType>>:std::true_type{};
+
+MMO_PACK_END
+
+}//end namespace mmo
@@ -0,0 +1,580 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_overlay.h
+*           复杂对象--线性映射库--只读镜像上的可写覆盖层与后台压实
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include "mmo_segment.h"
+#include "mmo_image.h"
+#include "mmo_copy.h"
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mmo
+{
+
+/**
+ * @brief 覆盖层下的基础容器：位于只读镜像中的容器地址，以及使其保持有效的持有者（如 mapped_image）
+ */
+template<typename BaseType>
+class overlay_base
+{
+public:
+  const BaseType*             base{nullptr};
+  std::shared_ptr<const void> owner;
+public:
+  overlay_base(){}
+  overlay_base(const BaseType* pbase,std::shared_ptr<const void> powner = nullptr):
+    base(pbase),
+    owner(std::move(powner))
+  {
+  }
+};
+
+/**
+ * @brief 一层覆盖：一段只追加的旁路内存段存放写入的值，另有 键 -> 值 的索引，删除记为值为 NULL 的墓碑
+ *        值在旁路段中按普通方式构造，内部仍是相对偏移，旁路段地址不变，写入后的值一直有效，直到本层被丢弃。
+ */
+template<typename KeyType,typename ValueType>
+class overlay_layer
+{
+public:
+  typedef std::unordered_map<KeyType,const ValueType*>  EntryMap;
+protected:
+  growable_segment    m_segment;
+  EntryMap            m_entries;
+  size_t              m_size{0};      //写入本层后，合并视图中的元素个数
+public:
+  overlay_layer(size_t size,size_t reserve_size):
+    m_segment(reserve_size),
+    m_size(size)
+  {
+  }
+  overlay_layer(const overlay_layer&) = delete;
+  overlay_layer& operator=(const overlay_layer&) = delete;
+public:
+  /**
+   * @brief 本层是否写过 key；写过时 value 为其值，删除时为 NULL
+   */
+  bool              find(const KeyType& key,const ValueType*& value)const
+  {
+    auto it = m_entries.find(key);
+    if(it == m_entries.end())
+      return false;
+    value = it->second;
+    return true;
+  }
+  const EntryMap&   entries()const{return m_entries;}
+  size_t            size()const{return m_size;}
+  size_t            bytes()const{return m_segment.size();}
+  segment_manager&  segment(){return m_segment;}
+  void              set(const KeyType& key,const ValueType* value){m_entries[key] = value;}
+  void              set_size(size_t size){m_size = size;}
+};
+
+/**
+ * @brief 合并视图的公共部分：基础容器 + 由旧到新的若干覆盖层，查找时从最新的一层往下找，最后找基础容器
+ *        视图持有各层与基础镜像的引用，复制视图不复制数据。
+ */
+template<typename KeyType,typename ValueType,typename BaseType>
+class overlay_view_base
+{
+public:
+  typedef overlay_layer<KeyType,ValueType>        LayerType;
+  typedef std::shared_ptr<const LayerType>        LayerPtr;
+protected:
+  const BaseType*             m_base{nullptr};
+  std::shared_ptr<const void> m_owner;
+  std::vector<LayerPtr>       m_layers;
+public:
+  const BaseType*   base()const{return m_base;}
+  size_t            layer_count()const{return m_layers.size();}
+  const std::vector<LayerPtr>& layers()const{return m_layers;}
+  size_t            size()const
+  {
+    if(!m_layers.empty())
+      return m_layers.back()->size();
+    return (m_base == nullptr) ? 0 : (size_t)m_base->size();
+  }
+  /**
+   * @brief 各覆盖层写入的条目数之和（含被更新的层覆盖的旧值与墓碑）
+   */
+  size_t            overlay_entries()const
+  {
+    size_t n = 0;
+    for(auto& layer:m_layers)
+      n += layer->entries().size();
+    return n;
+  }
+  /**
+   * @brief 各覆盖层旁路内存段的字节数之和
+   */
+  size_t            overlay_bytes()const
+  {
+    size_t n = 0;
+    for(auto& layer:m_layers)
+      n += layer->bytes();
+    return n;
+  }
+public:
+  /**
+   * @brief 在第 [0,end) 层中由新到旧查找 key
+   */
+  bool              _find_layer(const KeyType& key,const ValueType*& value,size_t end)const
+  {
+    for(size_t i = end;i > 0;i--)
+    {
+      if(m_layers[i - 1]->find(key,value))
+        return true;
+    }
+    return false;
+  }
+  void              _push_layer(LayerPtr layer){m_layers.push_back(std::move(layer));}
+  /**
+   * @brief 压实完成：最旧的 count 层已并入 base，换上新的基础容器并丢弃这些层
+   */
+  void              _install(const overlay_base<BaseType>& base,size_t count)
+  {
+    m_base  = base.base;
+    m_owner = base.owner;
+    m_layers.erase(m_layers.begin(),m_layers.begin() + count);
+  }
+};
+
+/**
+ * @brief hash_map 的合并视图
+ */
+template<typename KeyType,typename ValueType,typename SizeType>
+class overlay_hash_view:
+  public overlay_view_base<KeyType,ValueType,hash_map<KeyType,ValueType,SizeType>>
+{
+  typedef overlay_view_base<KeyType,ValueType,hash_map<KeyType,ValueType,SizeType>> BaseClass;
+public:
+  typedef KeyType                               key_type;
+  typedef ValueType                             value_type;
+  typedef hash_map<KeyType,ValueType,SizeType>  BaseType;
+  typedef typename BaseClass::LayerType         LayerType;
+public:
+  overlay_hash_view(const BaseType* base = nullptr,std::shared_ptr<const void> owner = nullptr)
+  {
+    this->m_base  = base;
+    this->m_owner = std::move(owner);
+  }
+public:
+  const ValueType*  get(const KeyType& key)const
+  {
+    const ValueType* value = NULL;
+    if(this->_find_layer(key,value,this->m_layers.size()))
+      return value;
+    return (this->m_base == nullptr) ? NULL : this->m_base->get(key);
+  }
+  /**
+   * @brief 遍历合并后的全部键值：先按基础容器的顺序（被更新的取新值，已删除的跳过），再遍历新增的键
+   *
+   * @tparam Func 可调用对象：void(const KeyType&,const ValueType&)
+   */
+  template<typename Func>
+  void              for_each(Func&& func)const
+  {
+    const ValueType* value = NULL;
+    if(this->m_base != nullptr)
+    {
+      for(auto it = this->m_base->begin();it != this->m_base->end();++it)
+      {
+        if(!this->_find_layer(it.node->key,value,this->m_layers.size()))
+          func(it.node->key,it.node->value);
+        else if(value != NULL)
+          func(it.node->key,*value);
+      }
+    }
+    for(size_t i = this->m_layers.size();i > 0;i--)
+    {
+      for(auto& entry:this->m_layers[i - 1]->entries())
+      {
+        if(entry.second == NULL)
+          continue;
+        //只取最新一层的值；基础容器中已有的键在上面已经遍历过
+        this->_find_layer(entry.first,value,this->m_layers.size());
+        if(value != entry.second || (this->m_base != nullptr && this->m_base->get(entry.first) != NULL))
+          continue;
+        func(entry.first,*entry.second);
+      }
+    }
+  }
+  /**
+   * @brief 把合并后的内容深拷贝构造到 dst，dst 须位于 segment 中且为默认构造状态
+   *
+   * @param hash_size 桶数，为 0 时取元素个数
+   */
+  void              build(BaseType& dst,segment_manager& segment,SizeType hash_size = 0)const
+  {
+    size_t count = this->size();
+    if(count == 0)
+      return;
+    dst.init_hash((SizeType)count,segment,hash_size);
+    copier copy(segment);
+    for_each([&](const KeyType& key,const ValueType& value)
+    {
+      //值可能是偏移指针等不能经栈中转的类型，先插入默认值再原地拷贝
+      auto ret = dst.insert(key,ValueType(),segment);
+      if(ret.pvalue != NULL)
+        copy(ret.pvalue->value,value);
+    });
+  }
+};
+
+/**
+ * @brief indexed_var_vector 的合并视图，键为元素下标
+ */
+template<typename ValueType,typename SizeType>
+class overlay_vector_view:
+  public overlay_view_base<size_t,ValueType,indexed_var_vector<ValueType,SizeType>>
+{
+  typedef overlay_view_base<size_t,ValueType,indexed_var_vector<ValueType,SizeType>> BaseClass;
+public:
+  typedef size_t                                  key_type;
+  typedef ValueType                               value_type;
+  typedef indexed_var_vector<ValueType,SizeType>  BaseType;
+  typedef typename BaseClass::LayerType           LayerType;
+public:
+  overlay_vector_view(const BaseType* base = nullptr,std::shared_ptr<const void> owner = nullptr)
+  {
+    this->m_base  = base;
+    this->m_owner = std::move(owner);
+  }
+public:
+  /**
+   * @brief 下标越界时返回 NULL
+   */
+  const ValueType*  get(size_t index)const
+  {
+    if(index >= this->size())
+      return NULL;
+    const ValueType* value = NULL;
+    if(this->_find_layer(index,value,this->m_layers.size()))
+      return value;
+    return (this->m_base == nullptr || index >= (size_t)this->m_base->size()) ? NULL : &(*this->m_base)[(SizeType)index];
+  }
+  /**
+   * @brief 按下标顺序遍历
+   *
+   * @tparam Func 可调用对象：void(size_t index,const ValueType&)
+   */
+  template<typename Func>
+  void              for_each(Func&& func)const
+  {
+    size_t count = this->size();
+    for(size_t i = 0;i < count;i++)
+      func(i,*get(i));
+  }
+  /**
+   * @brief 把合并后的内容深拷贝构造到 dst，dst 须位于 segment 中且为默认构造状态
+   */
+  void              build(BaseType& dst,segment_manager& segment)const
+  {
+    copier copy(segment);
+    dst.prepare_append_elements(segment);
+    for_each([&](size_t,const ValueType& value)
+    {
+      auto element = dst.begin_append_element(segment);
+      copy(element->object(),value);
+      dst.end_append_element(element,segment);
+    });
+    dst.finish_append_elements(segment);
+  }
+};
+
+/**
+ * @brief 覆盖层容器的公共部分：写入进最新一层，后台把冻结的各层与基础容器压实成新镜像
+ *        与库中其他容器一样不加锁，写入、查找、压实的开始与完成须在同一线程（或由使用方加锁）；
+ *        需要在其他线程读取时，用 snapshot() 冻结当前层并取得只读视图，视图可交给任意线程。
+ *        后台压实只读取已冻结的层与基础镜像，不会与写入冲突。
+ *        查找返回的地址在其所在层或基础镜像被丢弃之前有效，即下一次 finish_compaction() 之前；
+ *        视图持有引用，通过视图取得的地址在视图存在期间一直有效。
+ */
+template<typename ViewType>
+class overlay_container
+{
+public:
+  typedef typename ViewType::key_type     KeyType;
+  typedef typename ViewType::value_type   ValueType;
+  typedef typename ViewType::BaseType     BaseType;
+  typedef typename ViewType::LayerType    LayerType;
+  enum
+  {
+    default_layer_reserve = 256UL << 20,   //每层旁路段预留的地址空间，只占虚拟地址
+  };
+protected:
+  ViewType                                m_view;
+  std::shared_ptr<LayerType>              m_active;
+  size_t                                  m_layer_reserve{default_layer_reserve};
+  std::future<overlay_base<BaseType>>     m_compaction;
+  size_t                                  m_compacting_layers{0};
+  size_t                                  m_compacting_size{0};
+public:
+  overlay_container(const BaseType* base,std::shared_ptr<const void> owner,size_t layer_reserve):
+    m_view(base,std::move(owner)),
+    m_layer_reserve(layer_reserve)
+  {
+  }
+  overlay_container(const overlay_container&) = delete;
+  overlay_container& operator=(const overlay_container&) = delete;
+  ~overlay_container()
+  {
+    if(m_compaction.valid())
+      m_compaction.wait();
+  }
+public:
+  size_t            size()const{return m_view.size();}
+  bool              empty()const{return size() == 0;}
+  const BaseType*   base()const{return m_view.base();}
+  size_t            layer_count()const{return m_view.layer_count();}
+  size_t            overlay_entries()const{return m_view.overlay_entries();}
+  size_t            overlay_bytes()const{return m_view.overlay_bytes();}
+  /**
+   * @brief 当前的合并视图，包含仍在写入的层，只能在写入线程中使用
+   */
+  const ViewType&   view()const{return m_view;}
+  /**
+   * @brief 冻结当前层并返回只读视图，之后的写入进入新的一层；视图可交给其他线程读取
+   */
+  ViewType          snapshot()
+  {
+    m_active.reset();
+    return m_view;
+  }
+public:
+  bool              compacting()const{return m_compaction.valid();}
+  /**
+   * @brief 开始后台压实：冻结当前全部覆盖层，在后台线程中以其合并视图调用 compact 构造新镜像
+   *        压实期间写入进入新的一层，查找不受影响。
+   *
+   * @tparam Compact 可调用对象：overlay_base<BaseType>(const ViewType& merged)，
+   *                 用 merged.build(...) 构造新镜像，返回新镜像中基础容器的地址与持有者，
+   *                 容器本身即为镜像根对象时可直接用 compact_image()
+   * @return true    已开始；已有压实在进行或没有覆盖层时返回 false
+   */
+  template<typename Compact>
+  bool              start_compaction(Compact compact)
+  {
+    if(m_compaction.valid() || m_view.layer_count() == 0)
+      return false;
+    ViewType merged     = snapshot();
+    m_compacting_layers = merged.layer_count();
+    m_compacting_size   = merged.size();
+    m_compaction        = std::async(std::launch::async,[merged,compact]() mutable
+    {
+      return compact((const ViewType&)merged);
+    });
+    return true;
+  }
+  /**
+   * @brief 完成压实：换上新的基础容器，丢弃已并入的层
+   *        压实失败时抛出其异常，各层保留不变，可再次开始压实。
+   *
+   * @param wait 为 false 时不等待，压实尚未结束则直接返回 false
+   * @return true 已换上新的基础容器
+   */
+  bool              finish_compaction(bool wait = true)
+  {
+    if(!m_compaction.valid())
+      return false;
+    if(!wait && m_compaction.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      return false;
+    size_t count = m_compacting_layers;
+    size_t size  = m_compacting_size;
+    m_compacting_layers = 0;
+    m_compacting_size   = 0;
+    overlay_base<BaseType> result = m_compaction.get();
+    if(size != 0 && (result.base == nullptr || (size_t)result.base->size() != size))
+      throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: compacted image does not match the overlay!");
+    m_view._install(result,count);
+    return true;
+  }
+protected:
+  LayerType&        _active()
+  {
+    if(!m_active)
+    {
+      m_active = std::make_shared<LayerType>(m_view.size(),m_layer_reserve);
+      m_view._push_layer(m_active);
+    }
+    return *m_active;
+  }
+  /**
+   * @brief 在当前层中构造一个新值，再由 build 填充；build 抛出异常时不记录写入
+   */
+  template<typename Builder>
+  const ValueType*  _make_value(Builder&& build)
+  {
+    LayerType&  layer = _active();
+    ValueType*  value = construct<ValueType>(layer.segment());
+    build(*value,layer.segment());
+    return value;
+  }
+};
+
+/**
+ * @brief 只读 hash_map 上的可写覆盖层
+ *        新增与修改的值深拷贝到旁路段中，删除记为墓碑，查找先找覆盖层再找基础镜像，基础镜像始终零拷贝访问；
+ *        覆盖层积累到一定大小后，在后台把它与基础镜像合并成新镜像，再换上新镜像、丢弃覆盖层。
+ *
+ *   auto image = std::make_shared<mmo::mapped_image>("labels.dat");
+ *   mmo::overlay_hash_map<int32_t,Label,int32_t> labels(image->root<LabelMap>(),image);
+ *   labels.put(7,label);                  //值深拷贝到覆盖层
+ *   labels.erase(9);
+ *   const Label* p = labels.get(7);
+ *   if(labels.overlay_bytes() > (64 << 20))
+ *     labels.start_compaction([](const decltype(labels)::ViewType& merged)
+ *     {
+ *       return mmo::compact_image(merged,"labels.dat");
+ *     });
+ *   ...
+ *   labels.finish_compaction(false);      //在写入线程中定期调用，压实完成时换上新镜像
+ *
+ *   基础容器嵌在更大的根对象中时，compact 中自行构造根对象，以 merged.build(root->m_labels,segment) 构造其中的容器，
+ *   返回 overlay_base 时给出新镜像中该容器的地址。
+ */
+template<typename KeyType,typename ValueType,typename SizeType>
+class overlay_hash_map:
+  public overlay_container<overlay_hash_view<KeyType,ValueType,SizeType>>
+{
+  typedef overlay_container<overlay_hash_view<KeyType,ValueType,SizeType>> BaseClass;
+public:
+  typedef overlay_hash_view<KeyType,ValueType,SizeType>  ViewType;
+  typedef hash_map<KeyType,ValueType,SizeType>           MapType;
+public:
+  overlay_hash_map(const MapType* base = nullptr,std::shared_ptr<const void> owner = nullptr,
+                   size_t layer_reserve = BaseClass::default_layer_reserve):
+    BaseClass(base,std::move(owner),layer_reserve)
+  {
+  }
+public:
+  const ValueType*  get(const KeyType& key)const{return this->m_view.get(key);}
+  bool              contains(const KeyType& key)const{return get(key) != NULL;}
+  /**
+   * @brief 写入 key 的值，value 深拷贝到覆盖层（可以来自基础镜像）
+   */
+  void              put(const KeyType& key,const ValueType& value)
+  {
+    _put(key,this->_make_value([&value](ValueType& dst,segment_manager& segment){deep_copy(dst,value,segment);}));
+  }
+  /**
+   * @brief 在覆盖层中直接构造 key 的值
+   *
+   * @tparam Builder 可调用对象：void(ValueType& value,segment_manager& segment)，value 已默认构造
+   */
+  template<typename Builder>
+  void              emplace(const KeyType& key,Builder&& build)
+  {
+    _put(key,this->_make_value(build));
+  }
+  /**
+   * @brief 删除 key，不存在时返回 false
+   */
+  bool              erase(const KeyType& key)
+  {
+    if(get(key) == NULL)
+      return false;
+    auto& layer = this->_active();
+    layer.set(key,NULL);
+    layer.set_size(layer.size() - 1);
+    return true;
+  }
+  template<typename Func>
+  void              for_each(Func&& func)const{this->m_view.for_each(func);}
+protected:
+  void              _put(const KeyType& key,const ValueType* value)
+  {
+    bool  exists  = get(key) != NULL;
+    auto& layer   = this->_active();
+    layer.set(key,value);
+    if(!exists)
+      layer.set_size(layer.size() + 1);
+  }
+};
+
+/**
+ * @brief 只读 indexed_var_vector 上的可写覆盖层：按下标替换元素、在末尾追加元素
+ *        用法与 overlay_hash_map 相同，压实时按下标顺序重新构造整个 vector。
+ */
+template<typename ValueType,typename SizeType>
+class overlay_vector:
+  public overlay_container<overlay_vector_view<ValueType,SizeType>>
+{
+  typedef overlay_container<overlay_vector_view<ValueType,SizeType>> BaseClass;
+public:
+  typedef overlay_vector_view<ValueType,SizeType>   ViewType;
+  typedef indexed_var_vector<ValueType,SizeType>    VectorType;
+public:
+  overlay_vector(const VectorType* base = nullptr,std::shared_ptr<const void> owner = nullptr,
+                 size_t layer_reserve = BaseClass::default_layer_reserve):
+    BaseClass(base,std::move(owner),layer_reserve)
+  {
+  }
+public:
+  const ValueType*  get(size_t index)const{return this->m_view.get(index);}
+  const ValueType&  operator[](size_t index)const{return *get(index);}
+  /**
+   * @brief 替换第 index 个元素，下标越界时返回 false
+   */
+  bool              set(size_t index,const ValueType& value)
+  {
+    return emplace(index,[&value](ValueType& dst,segment_manager& segment){deep_copy(dst,value,segment);});
+  }
+  template<typename Builder>
+  bool              emplace(size_t index,Builder&& build)
+  {
+    if(index >= this->size())
+      return false;
+    this->_active().set(index,this->_make_value(build));
+    return true;
+  }
+  void              push_back(const ValueType& value)
+  {
+    emplace_back([&value](ValueType& dst,segment_manager& segment){deep_copy(dst,value,segment);});
+  }
+  template<typename Builder>
+  void              emplace_back(Builder&& build)
+  {
+    const ValueType* value = this->_make_value(build);
+    auto& layer = this->_active();
+    layer.set(layer.size(),value);
+    layer.set_size(layer.size() + 1);
+  }
+  template<typename Func>
+  void              for_each(Func&& func)const{this->m_view.for_each(func);}
+};
+
+/**
+ * @brief 常用的压实方式：覆盖的容器本身就是镜像根对象，合并后保存为镜像文件并映射为新的基础镜像
+ *        保存时先写临时文件再改名，仍在映射旧文件的视图不受影响。
+ *
+ * @param merged          start_compaction 交给 compact 的合并视图
+ * @param path            镜像文件路径，通常就是旧镜像的路径
+ * @param layout_version  使用方自定义的布局版本
+ * @param reserve_size    构造新镜像的内存段最多可增长到的字节数
+ */
+template<typename ViewType>
+overlay_base<typename ViewType::BaseType> compact_image(const ViewType& merged,const std::string& path,uint32_t layout_version = 0,
+  size_t reserve_size = growable_segment::default_reserve_size)
+{
+  typedef typename ViewType::BaseType BaseType;
+  std::shared_ptr<mapped_image> image;
+  {
+    growable_segment  segment(reserve_size);
+    BaseType*         root = construct<BaseType>(segment);
+    merged.build(*root,segment);
+    save_image(path,segment,root,layout_version);
+  }
+  image = std::make_shared<mapped_image>(path,layout_version);
+  return overlay_base<BaseType>(image->root<BaseType>(),image);
+}
+
+}//end namespace mmo
@@ -0,0 +1,160 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_parallel.h
+*           复杂对象--线性映射库--多线程并行构造
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include "mmo_segment.h"
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <thread>
+
+namespace mmo
+{
+
+/**
+ * @brief 拼接时挂在目标内存段上的观察者：各块的分配已由工作线程逐次上报，这里只转发拼接产生的对齐填充
+ */
+class _padding_observer:
+  public alloc_observer
+{
+protected:
+  alloc_observer* m_target{nullptr};
+public:
+  explicit _padding_observer(alloc_observer* target):m_target(target){}
+  virtual void on_alloc(size_t size,size_t padding) override
+  {
+    (void)size;
+    if(padding != 0)
+      m_target->on_alloc(0,padding);
+  }
+};
+
+/**
+ * @brief 多线程并行构造 var_vector 的元素
+ *        元素按块分给工作线程，每个工作线程在自己的一个可增长子内存段中依次构造分到的块，互不加锁；
+ *        全部完成后按元素下标顺序把各块逐字节拼接到 segment 中。
+ *        一个元素及其全部负载是一段连续字节，内部只有相对偏移，整体搬移后无需修正。
+ *        要求：
+ *          1. build 只能引用本元素自己构造出来的内容，不能指向父对象或其他元素（如跨元素共享的 string_pool）；
+ *          2. build 可被多个线程同时调用，其捕获的状态需线程安全；
+ *          3. 与串行用法一样，调用前先 prepare_append_elements，调用后（indexed_var_vector）再 finish_append_elements。
+ *        segment 处于测量模式时，各块也以测量模式构造，只统计字节数。
+ *        segment 挂有分配观察者时，子内存段挂同一个观察者，调用线程的 MMO_ALLOC_SITE 等标记也带进工作线程，
+ *        每次分配按原本的用途与调用点上报；拼接时只补报对齐填充，不重复计数。
+ *
+ *   m_road_map.prepare_append_elements(segment);
+ *   mmo::parallel_append_elements(m_road_map,count,[](size_t i,CRoad& road,mmo::segment_manager& seg)
+ *   {
+ *     road.init(i+1,"road_"+std::to_string(i+1),coors_of(i),seg);
+ *   },segment);
+ *   m_road_map.finish_append_elements(segment);
+ *
+ * @tparam Builder  可调用对象：void(size_t index,ValueType& object,segment_manager& segment)
+ * @param dst       目标 vector，元素追加在已有元素之后；对齐布局下首块前的对齐填充计入已有的最后一个元素，
+ *                  因此已有元素之后、调用之前不能有其他分配
+ * @param count     元素个数，build 的 index 取值为 [0,count)
+ * @param segment   dst 所在的内存段
+ * @param threads   线程数，0 表示按 CPU 核数
+ * @return true
+ */
+template<typename ValueType,typename SizeType,typename Builder>
+bool parallel_append_elements(var_vector<ValueType,SizeType>& dst,size_t count,Builder build,
+                              segment_manager& segment,size_t threads = 0)
+{
+  if(count == 0)
+    return true;
+  if(threads == 0)
+    threads = std::thread::hardware_concurrency();
+  if(threads == 0)
+    threads = 1;
+  //块数多于线程数，元素大小不均时也能较好地平衡负载
+  size_t chunks = threads * 4;
+  if(chunks > count)
+    chunks = count;
+  if(threads > chunks)
+    threads = chunks;
+
+  //每个工作线程一个子内存段，分到的块依次构造在其中；每块补齐到最大对齐，块的起点也就保持对齐
+  std::vector<std::unique_ptr<growable_segment>>  parts(threads);
+  std::vector<size_t>                             owner(chunks);
+  std::vector<std::pair<size_t,size_t>>           ranges(chunks);   //块在所属子内存段中的 [起,止) 字节位置
+  std::atomic<size_t>                             next(0);
+  std::exception_ptr                              error;
+  std::atomic<bool>                               failed(false);
+  bool                                            measuring = segment.measuring();
+  alloc_context                                   context   = alloc_context::current();
+  for(auto& part:parts)
+  {
+    part.reset(measuring ? new measure_segment() : new growable_segment());
+    part->set_observer(segment.observer());
+  }
+
+  auto worker = [&](size_t id)
+  {
+    alloc_scope       scope(context);
+    growable_segment* part = parts[id].get();
+    for(size_t chunk = next++;chunk < chunks && !failed;chunk = next++)
+    {
+      try
+      {
+        size_t first = count * chunk / chunks;
+        size_t last  = count * (chunk + 1) / chunks;
+        size_t begin = part->size();
+        for(size_t i = first;i < last;i++)
+        {
+          auto element = var_vector<ValueType,SizeType>::_begin_element(*part);
+          build(i,element->object(),(segment_manager&)*part);
+          //对齐布局下，块的字节数补齐到最大对齐，拼接后各块仍然对齐且首尾相接
+          if(i + 1 == last)
+            part->align(layout_max_align());
+          var_vector<ValueType,SizeType>::_end_element(element,*part);
+        }
+        owner[chunk]  = id;
+        ranges[chunk] = std::make_pair(begin,part->size());
+      }
+      catch(...)
+      {
+        if(!failed.exchange(true))
+          error = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for(size_t i = 1;i < threads;i++)
+    pool.emplace_back(worker,i);
+  worker(0);
+  for(auto& t:pool)
+    t.join();
+  if(failed)
+    std::rethrow_exception(error);
+
+  alloc_observer*   observer = segment.observer();
+  _padding_observer padding(observer);
+  if(observer != nullptr)
+    segment.set_observer(&padding);
+  try
+  {
+    for(size_t chunk = 0;chunk < chunks;chunk++)
+    {
+      size_t first = count * chunk / chunks;
+      size_t last  = count * (chunk + 1) / chunks;
+      const growable_segment* part = parts[owner[chunk]].get();
+      dst.append_elements(part->data() + ranges[chunk].first,ranges[chunk].second - ranges[chunk].first,(SizeType)(last - first),segment);
+    }
+  }
+  catch(...)
+  {
+    segment.set_observer(observer);
+    throw;
+  }
+  segment.set_observer(observer);
+  return true;
+}
+
+}//end namespace mmo
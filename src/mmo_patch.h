@@ -0,0 +1,535 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_patch.h
+*           复杂对象--线性映射库--镜像的增量补丁
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include "mmo_image.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+
+namespace mmo
+{
+
+#pragma pack(push,1)
+
+/**
+ * @brief 补丁头，固定 64 字节
+ *        补丁布局：[patch_header][操作序列 ops_bytes 字节]
+ *        操作为变长整数 (len << 2) | type：
+ *          type = 0 COPY：后跟一个 zigzag 变长整数，为旧数据起点相对上一次 COPY/ADD 结束位置的差，拷贝 len 字节；
+ *          type = 1 DATA：后跟 len 字节新内容；
+ *          type = 2 ADD ：后跟字宽 W（1 字节，2/4/8）、同 COPY 的旧数据起点、zigzag 变长整数 delta，
+ *                         拷贝 len 字节并给每个 W 字节的小端整数加上 delta，用于整体平移后的偏移表。
+ *        依次执行全部操作恰好得到 new_size 字节的新数据。
+ */
+struct patch_header
+{
+  enum
+  {
+    header_magic    = 0x31504D4D,  // "MMP1"
+    format_version  = 1,
+  };
+  uint32_t    magic{header_magic};
+  uint16_t    header_bytes{sizeof(patch_header)};
+  uint16_t    format{format_version};
+  uint32_t    block_size{0};        //生成补丁时匹配的块大小，仅供参考
+  uint32_t    reserved0{0};
+  uint64_t    old_size{0};
+  uint64_t    new_size{0};
+  uint64_t    old_hash{0};          //旧数据的校验值，应用时核对，避免打到错误的基准上
+  uint64_t    new_hash{0};          //新数据的校验值，应用后核对
+  uint64_t    ops_bytes{0};
+  char        reserved[8]{0};
+public:
+  bool        valid(size_t total_bytes)const
+  {
+    return magic == (uint32_t)header_magic
+        && header_bytes == sizeof(patch_header)
+        && format == (uint16_t)format_version
+        && total_bytes >= sizeof(patch_header)
+        && ops_bytes == total_bytes - sizeof(patch_header);
+  }
+  const char* ops()const{return (const char*)this + header_bytes;}
+};
+
+#pragma pack(pop)
+static_assert(sizeof(patch_header) == 64,"patch_header must be 64 bytes");
+
+/**
+ * @brief 数据的 64 位校验值，按 8 字节一组乘法散列，用于识别补丁的基准与结果
+ */
+inline uint64_t patch_hash(const char* data,size_t size)
+{
+  const uint64_t prime = 0x100000001B3ULL;
+  uint64_t h = 0xCBF29CE484222325ULL ^ (uint64_t)size;
+  size_t   i = 0;
+  for(;i + 8 <= size;i += 8)
+  {
+    uint64_t word;
+    memcpy(&word,data + i,8);
+    h = (h ^ word) * prime;
+    h ^= h >> 29;
+  }
+  for(;i < size;i++)
+    h = (h ^ (uint8_t)data[i]) * prime;
+  return h ^ (h >> 32);
+}
+
+/**
+ * @brief 补丁生成器：对新数据做滚动散列，在旧数据中按块查找相同内容，相同部分记为 COPY，其余记为 DATA
+ *        镜像内部全部是相对偏移，改动一条道路后，其后的对象虽然整体平移，内容却逐字节不变，
+ *        因此能按块匹配上，补丁大小与改动量相当，而不是与数据总量相当。
+ *        indexed_var_vector 的偏移表等记录到同一基准位置的部分，改动点之后的各项都加了同一个数，
+ *        在 COPY 结束处检查这种情形并记为 ADD，一段偏移表只占几个字节。
+ *        旧数据按块建立索引，额外内存约为 旧数据字节数 / block_size * 16 字节。
+ */
+class patch_builder
+{
+public:
+  enum
+  {
+    default_block_size = 32,
+    min_block_size     = 8,
+    min_add_words      = 8,     //ADD 至少覆盖的字数，过短时不如直接 DATA
+  };
+  enum
+  {
+    op_copy = 0,
+    op_data = 1,
+    op_add  = 2,
+  };
+protected:
+  const char*             m_old{nullptr};
+  size_t                  m_old_size{0};
+  size_t                  m_block{default_block_size};
+  std::vector<uint64_t>   m_table;        //散列 -> 旧数据块位置 + 1，0 表示空
+  uint64_t                m_table_mask{0};
+  uint64_t                m_power{1};     //BASE^(block-1)，滚动时移出首字节用
+public:
+  static const uint64_t   hash_base = 0x9E3779B97F4A7C15ULL;
+public:
+  patch_builder(const char* old_data,size_t old_size,size_t block_size = default_block_size):
+    m_old(old_data),
+    m_old_size(old_size),
+    m_block(block_size < (size_t)min_block_size ? (size_t)min_block_size : block_size)
+  {
+    for(size_t i = 1;i < m_block;i++)
+      m_power *= hash_base;
+    _index();
+  }
+public:
+  /**
+   * @brief 生成从旧数据到 new_data 的补丁，同一个生成器可对多个新版本反复使用
+   */
+  std::string diff(const char* new_data,size_t new_size)const
+  {
+    patch_header header;
+    header.block_size = (uint32_t)m_block;
+    header.old_size   = m_old_size;
+    header.new_size   = new_size;
+    header.old_hash   = patch_hash(m_old,m_old_size);
+    header.new_hash   = patch_hash(new_data,new_size);
+
+    std::string out((const char*)&header,sizeof(header));
+    size_t      pos       = 0;      //新数据中的当前位置
+    size_t      literal   = 0;      //尚未输出的 DATA 起点
+    size_t      next_old  = 0;      //上一次 COPY 在旧数据中的结束位置
+    uint64_t    h         = (new_size >= m_block) ? _hash(new_data) : 0;
+    while(pos + m_block <= new_size)
+    {
+      size_t from = _match(new_data + pos,h,next_old);
+      if(from == (size_t)-1 && pos - literal < 8)
+      {
+        //刚结束一段 COPY/ADD：按原有的对应关系试一下是否只是每个字都加了同一个数
+        size_t  expected  = next_old + (pos - literal);
+        int64_t delta     = 0;
+        size_t  width     = 0;
+        size_t  len       = _word_shift(new_data + pos,new_size - pos,expected,delta,width);
+        if(len != 0)
+        {
+          _emit_data(out,new_data + literal,pos - literal);
+          _put_varint(out,((uint64_t)len << 2) | op_add);
+          out.push_back((char)width);
+          _put_varint(out,_zigzag((int64_t)expected - (int64_t)next_old));
+          _put_varint(out,_zigzag(delta));
+          pos      += len;
+          literal   = pos;
+          next_old  = expected + len;
+          if(pos + m_block <= new_size)
+            h = _hash(new_data + pos);
+          continue;
+        }
+      }
+      if(from == (size_t)-1)
+      {
+        if(pos + m_block < new_size)
+          h = (h - (uint8_t)new_data[pos] * m_power) * hash_base + (uint8_t)new_data[pos + m_block];
+        pos ++;
+        continue;
+      }
+      //向前并入尚未输出的 DATA，向后尽量延长
+      while(pos > literal && from > 0 && new_data[pos - 1] == m_old[from - 1])
+      {
+        pos --;
+        from --;
+      }
+      size_t len = _common(new_data + pos,new_size - pos,m_old + from,m_old_size - from);
+      _emit_data(out,new_data + literal,pos - literal);
+      _put_varint(out,((uint64_t)len << 2) | op_copy);
+      _put_varint(out,_zigzag((int64_t)from - (int64_t)next_old));
+      pos      += len;
+      literal   = pos;
+      next_old  = from + len;
+      if(pos + m_block <= new_size)
+        h = _hash(new_data + pos);
+    }
+    _emit_data(out,new_data + literal,new_size - literal);
+    ((patch_header*)&out[0])->ops_bytes = out.size() - sizeof(patch_header);
+    return out;
+  }
+protected:
+  void      _index()
+  {
+    size_t blocks = m_old_size / m_block;
+    size_t slots  = 16;
+    while(slots < blocks * 2)
+      slots <<= 1;
+    m_table.assign(slots,0);
+    m_table_mask = slots - 1;
+    //同一散列只保留第一个块，重复内容（如全零区）匹配到哪一处都一样
+    for(size_t i = 0;i < blocks;i++)
+    {
+      size_t    at    = i * m_block;
+      uint64_t  slot  = _slot(_hash(m_old + at));
+      for(size_t probe = 0;probe < 8;probe++,slot = (slot + 1) & m_table_mask)
+      {
+        if(m_table[slot] == 0)
+        {
+          m_table[slot] = at + 1;
+          break;
+        }
+        if(memcmp(m_old + m_table[slot] - 1,m_old + at,m_block) == 0)
+          break;
+      }
+    }
+  }
+  /**
+   * @brief 先试上一次 COPY 的延续位置（最常见的情形），再查索引，返回旧数据中的位置，找不到返回 -1
+   */
+  size_t    _match(const char* p,uint64_t h,size_t next_old)const
+  {
+    if(next_old + m_block <= m_old_size && memcmp(p,m_old + next_old,m_block) == 0)
+      return next_old;
+    uint64_t slot = _slot(h);
+    for(size_t probe = 0;probe < 8;probe++,slot = (slot + 1) & m_table_mask)
+    {
+      uint64_t at = m_table[slot];
+      if(at == 0)
+        break;
+      if(memcmp(p,m_old + at - 1,m_block) == 0)
+        return (size_t)(at - 1);
+    }
+    return (size_t)-1;
+  }
+  /**
+   * @brief 检查 p 与旧数据 from 处是否为每个 W 字节整数都相差同一个非零常数，依次试 4/8/2 字节字宽
+   *
+   * @return size_t 匹配的字节数，不足 min_add_words 个字时返回 0
+   */
+  size_t    _word_shift(const char* p,size_t size,size_t from,int64_t& delta,size_t& width)const
+  {
+    if(from >= m_old_size)
+      return 0;
+    size_t limit = size < m_old_size - from ? size : m_old_size - from;
+    for(size_t w:{(size_t)4,(size_t)8,(size_t)2})
+    {
+      size_t words = limit / w;
+      if(words < (size_t)min_add_words)
+        continue;
+      uint64_t d = _word(p,w) - _word(m_old + from,w);
+      if((d & _mask(w)) == 0)
+        continue;
+      size_t n = 1;
+      while(n < words && ((_word(p + n * w,w) - _word(m_old + from + n * w,w) - d) & _mask(w)) == 0)
+        n ++;
+      if(n < (size_t)min_add_words)
+        continue;
+      width = w;
+      delta = _sign_extend(d & _mask(w),w);
+      return n * w;
+    }
+    return 0;
+  }
+public:
+  static uint64_t _word(const char* p,size_t w)
+  {
+    uint64_t v = 0;
+    memcpy(&v,p,w);   //小端
+    return v;
+  }
+  static uint64_t _mask(size_t w){return (w >= 8) ? ~(uint64_t)0 : (((uint64_t)1 << (w * 8)) - 1);}
+  static int64_t  _sign_extend(uint64_t v,size_t w)
+  {
+    if(w >= 8)
+      return (int64_t)v;
+    uint64_t sign = (uint64_t)1 << (w * 8 - 1);
+    return (int64_t)((v ^ sign) - sign);
+  }
+protected:
+  uint64_t  _hash(const char* p)const
+  {
+    uint64_t h = 0;
+    for(size_t i = 0;i < m_block;i++)
+      h = h * hash_base + (uint8_t)p[i];
+    return h;
+  }
+  uint64_t  _slot(uint64_t h)const
+  {
+    return (h ^ (h >> 31)) & m_table_mask;
+  }
+  static size_t _common(const char* a,size_t a_size,const char* b,size_t b_size)
+  {
+    size_t limit = a_size < b_size ? a_size : b_size;
+    size_t n     = 0;
+    while(n + 8 <= limit && memcmp(a + n,b + n,8) == 0)
+      n += 8;
+    while(n < limit && a[n] == b[n])
+      n ++;
+    return n;
+  }
+  static void   _emit_data(std::string& out,const char* data,size_t len)
+  {
+    if(len == 0)
+      return;
+    _put_varint(out,((uint64_t)len << 2) | op_data);
+    out.append(data,len);
+  }
+  static uint64_t _zigzag(int64_t v){return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);}
+  static void   _put_varint(std::string& out,uint64_t v)
+  {
+    while(v >= 0x80)
+    {
+      out.push_back((char)(v | 0x80));
+      v >>= 7;
+    }
+    out.push_back((char)v);
+  }
+};
+
+/**
+ * @brief 生成从 old_data 到 new_data 的补丁
+ */
+inline std::string make_patch(const char* old_data,size_t old_size,const char* new_data,size_t new_size,
+  size_t block_size = patch_builder::default_block_size)
+{
+  return patch_builder(old_data,old_size,block_size).diff(new_data,new_size);
+}
+
+/**
+ * @brief 应用补丁时允许的新数据最大字节数
+ *        新数据只由补丁中的 DATA 与旧数据的拷贝组成，未指定 max_new_size 时上限取 旧数据字节数 x 2 + 补丁字节数，
+ *        避免按补丁头中伪造的 new_size 分配巨大的缓冲区；新版本确实增长更多时由调用方传入 max_new_size
+ */
+inline size_t patch_size_limit(size_t old_size,size_t patch_size,size_t max_new_size = 0)
+{
+  if(max_new_size != 0)
+    return max_new_size;
+  if(old_size > (SIZE_MAX - patch_size) / 2)
+    return SIZE_MAX;
+  return old_size * 2 + patch_size;
+}
+
+/**
+ * @brief 校验补丁头与其基准，返回应用后新数据的字节数
+ *        补丁无效、基准的字节数不是 old_size、或新数据超出 patch_size_limit() 时抛出 invalid_image
+ */
+inline size_t patched_size(const char* patch,size_t patch_size,size_t old_size,size_t max_new_size = 0)
+{
+  if(patch_size < sizeof(patch_header) || !((const patch_header*)patch)->valid(patch_size))
+    throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: invalid patch header!");
+  const patch_header* header = (const patch_header*)patch;
+  if(header->old_size != old_size)
+    throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: patch does not match the old image!");
+  size_t limit = patch_size_limit(old_size,patch_size,max_new_size);
+  if(header->new_size > limit)
+    throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: patch new size exceeds limit,new size:"
+      + std::to_string(header->new_size) + ",limit:" + std::to_string(limit));
+  return (size_t)header->new_size;
+}
+
+/**
+ * @brief 把补丁应用到旧数据上，在 segment 中分配并写出新数据
+ *        未改动的部分直接从旧数据（可以是只读映射的旧镜像）整段拷贝。
+ *        补丁可能来自网络，每个操作都做越界检查；旧数据与补丁的基准不符、新数据超出上限、或结果校验不符时抛出 invalid_image。
+ *
+ * @param max_new_size  新数据的最大字节数，0 表示按 patch_size_limit() 的默认上限
+ * @return char* 新数据在 segment 中的起始地址，按 layout_max_align() 对齐
+ */
+inline char* apply_patch(const char* old_data,size_t old_size,const char* patch,size_t patch_size,segment_manager& segment,
+  size_t max_new_size = 0)
+{
+  size_t              new_size  = patched_size(patch,patch_size,old_size,max_new_size);
+  const patch_header* header    = (const patch_header*)patch;
+  if(header->old_hash != patch_hash(old_data,old_size))
+    throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: patch does not match the old image!");
+
+  char* dst = segment.alloc(new_size,layout_max_align());
+  if(dst == NULL)
+    throw mmo_exception((int32_t)mmo_exception::no_enough_memory,"mmo_exception:: no enough memory,alloc size:" + std::to_string(new_size));
+  if(segment.measuring())
+    return dst;
+
+  const uint8_t*  p         = (const uint8_t*)header->ops();
+  const uint8_t*  end       = p + header->ops_bytes;
+  size_t          pos       = 0;
+  size_t          next_old  = 0;
+  auto get_varint = [&](uint64_t& v)
+  {
+    v = 0;
+    for(int shift = 0;p < end && shift < 64;shift += 7)
+    {
+      uint8_t b = *p++;
+      v |= (uint64_t)(b & 0x7f) << shift;
+      if((b & 0x80) == 0)
+        return true;
+    }
+    return false;
+  };
+  while(p < end)
+  {
+    uint64_t op = 0;
+    if(!get_varint(op))
+      break;
+    uint64_t len  = op >> 2;
+    uint64_t type = op & 3;
+    if(len > new_size - pos)
+      break;
+    if(type == patch_builder::op_data)
+    {
+      if(len > (uint64_t)(end - p))
+        break;
+      memcpy(dst + pos,p,(size_t)len);
+      p += len;
+    }
+    else if(type == patch_builder::op_copy || type == patch_builder::op_add)
+    {
+      size_t width = 1;
+      if(type == patch_builder::op_add)
+      {
+        if(p >= end)
+          break;
+        width = (size_t)*p++;
+        if((width != 2 && width != 4 && width != 8) || len % width != 0)
+          break;
+      }
+      uint64_t shift = 0;
+      uint64_t delta = 0;
+      if(!get_varint(shift) || (type == patch_builder::op_add && !get_varint(delta)))
+        break;
+      uint64_t from = (uint64_t)next_old + ((shift >> 1) ^ (~(shift & 1) + 1));
+      if(from > old_size || len > old_size - from)
+        break;
+      memcpy(dst + pos,old_data + from,(size_t)len);
+      if(type == patch_builder::op_add)
+      {
+        uint64_t add = (delta >> 1) ^ (~(delta & 1) + 1);
+        for(size_t i = 0;i < (size_t)len;i += width)
+        {
+          uint64_t v = patch_builder::_word(dst + pos + i,width) + add;
+          memcpy(dst + pos + i,&v,width);
+        }
+      }
+      next_old = (size_t)(from + len);
+    }
+    else
+      break;
+    pos += (size_t)len;
+  }
+  if(p != end || pos != new_size || patch_hash(dst,new_size) != header->new_hash)
+    throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: corrupted patch!");
+  return dst;
+}
+
+/**
+ * @brief 由两个镜像文件生成补丁文件，补丁覆盖文件头与镜像数据，根对象位置、布局版本随之更新
+ */
+inline void make_patch_file(const std::string& old_path,const std::string& new_path,const std::string& patch_path,
+  size_t block_size = patch_builder::default_block_size)
+{
+  mapped_image old_image(old_path);
+  mapped_image new_image(new_path);
+  std::string patch = make_patch((const char*)&old_image.header(),old_image.header().header_bytes + old_image.size(),
+    (const char*)&new_image.header(),new_image.header().header_bytes + new_image.size(),block_size);
+
+  std::string tmp_path;
+  FILE* fp = create_temp_stream(patch_path,tmp_path);
+  bool ok = fwrite(patch.data(),patch.size(),1,fp) == 1;
+  commit_temp_file(fp,tmp_path,patch_path,ok);
+}
+
+/**
+ * @brief 把补丁 patch 应用到镜像文件 old_path 上，写出新镜像文件 new_path（先写临时文件再改名）
+ *        new_path 可以与 old_path 相同，正在映射旧文件的进程不受影响
+ *        新镜像在内存中整体生成，其字节数受 max_new_size（0 表示按 patch_size_limit() 的默认上限）限制，
+ *        超出上限或分配失败时抛出 invalid_image
+ */
+inline void apply_patch_file(const std::string& old_path,const char* patch,size_t patch_size,const std::string& new_path,
+  size_t max_new_size = 0)
+{
+  mapped_image      old_image(old_path);
+  const char*       old_data  = (const char*)&old_image.header();
+  size_t            old_size  = old_image.header().header_bytes + old_image.size();
+  size_t            new_size  = patched_size(patch,patch_size,old_size,max_new_size);
+  std::vector<char> buf;
+  try
+  {
+    buf.resize(new_size);
+  }
+  catch(const std::bad_alloc&)
+  {
+    throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: patched image too large,new size:" + std::to_string(new_size));
+  }
+  catch(const std::length_error&)
+  {
+    throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: patched image too large,new size:" + std::to_string(new_size));
+  }
+  segment_manager   segment(buf.data(),buf.size());
+  apply_patch(old_data,old_size,patch,patch_size,segment,max_new_size);
+  if(buf.size() < sizeof(image_header) || !((const image_header*)buf.data())->valid(buf.size()))
+    throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: patched image header invalid!");
+
+  std::string tmp_path;
+  FILE* fp = create_temp_stream(new_path,tmp_path);
+  bool ok = buf.empty() || fwrite(buf.data(),buf.size(),1,fp) == 1;
+  commit_temp_file(fp,tmp_path,new_path,ok);
+}
+
+/**
+ * @brief 同上，补丁从文件 patch_path 读取
+ */
+inline void apply_patch_file(const std::string& old_path,const std::string& patch_path,const std::string& new_path,
+  size_t max_new_size = 0)
+{
+  FILE* fp = fopen(patch_path.c_str(),"rb");
+  if(fp == NULL)
+    throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: open file failed:" + patch_path);
+  std::vector<char> patch;
+  char  buf[65536];
+  size_t n = 0;
+  while((n = fread(buf,1,sizeof(buf),fp)) > 0)
+    patch.insert(patch.end(),buf,buf + n);
+  bool ok = ferror(fp) == 0;
+  fclose(fp);
+  if(!ok)
+    throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: read patch failed:" + patch_path);
+  apply_patch_file(old_path,patch.data(),patch.size(),new_path,max_new_size);
+}
+
+}//end namespace mmo
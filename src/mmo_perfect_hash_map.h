@@ -0,0 +1,368 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_perfect_hash_map.h
+*           复杂对象--线性映射库--构造期生成最小完美 hash 的只读 hash_map
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include <algorithm>
+
+namespace mmo
+{
+
+MMO_PACK_BEGIN
+
+/**
+ * @brief 无内存分配 ，内容相对地址存储，最小完美 hash 的只读 hash_map 模板类
+ *        构造时一次性给出全部键，按 CHD（hash-displace）算法为每个小桶选一个位移，
+ *        使 n 个键恰好落在 n 个槽位上：没有空槽、没有冲突链，查找只读一个位移和一个槽位。
+ *        只有一个键的桶放在最后，直接把剩余空槽的下标记入位移表（最高位置 1），
+ *        避免满载时为最后几个键反复试探。
+ *        布局：[对象头][位移表 uint32_t * bucket_count][槽位数组 {key,value} * size]
+ *
+ * @tparam KeyType    需可平凡拷贝且支持 std::hash
+ * @tparam ValueType
+ * @tparam SizeType   注意：类型最大值 需大于 寻址空间最大值
+ */
+template<typename KeyType,typename ValueType,typename SizeType>
+class perfect_hash_map
+{
+public:
+  typedef perfect_hash_map<KeyType,ValueType,SizeType>  SelfType;
+  class SlotType
+  {
+  public:
+    KeyType     key;
+    ValueType   value;
+  };
+  enum
+  {
+    keys_per_bucket = 4,        //平均每桶键数，越大位移表越小、构造越慢
+    max_displace    = 1 << 20,
+    max_seed_retry  = 32,
+  };
+  enum : uint32_t
+  {
+    direct_flag     = 0x80000000U,
+  };
+  class iterator
+  {
+  public:
+    SizeType              index{0};
+    const SelfType*       self{nullptr};
+  public:
+    iterator(const SelfType* pSelf,SizeType pos)
+    {
+      index   =pos;
+      self    =pSelf;
+    }
+    bool operator==(const iterator& _rhs) const{return (index == _rhs.index && self == _rhs.self);}
+    bool operator!=(const iterator& _rhs) const{return (index != _rhs.index || self != _rhs.self);}
+    const KeyType&  key()const{return self->_slots()[index].key;}
+    ValueType&      value()const{return (ValueType&)self->_slots()[index].value;}
+    ValueType* operator->() const{return &value();}
+    ValueType& operator*() const{return value();}
+    iterator operator++(int)
+    {
+      iterator _Tmp = *this;
+      ++*this;
+      return (_Tmp);
+    }
+    iterator& operator++()
+    {
+      ++index;
+      return *this;
+    }
+  };
+protected:
+  SizeType    m_size{0};
+  SizeType    m_bucket_count{0};
+  uint32_t    m_seed{0};
+  SizeType    m_displace_offset{0};
+  SizeType    m_slot_offset{0};
+  ValueType   m_default_value;
+public:
+  perfect_hash_map(){}
+  perfect_hash_map(const SelfType&) = delete;
+  SelfType& operator=(const SelfType&) = delete;
+public:
+  /**
+   * @brief 桶数超出 SizeType 的表示范围时抛出 offset_overflow
+   */
+  static SizeType  bucket_count_for(size_t size)
+  {
+    return checked_offset<SizeType>((ptrdiff_t)((size + keys_per_bucket - 1) / keys_per_bucket));
+  }
+  static size_t    predict_capacity_bytes(size_t size)
+  {
+    size_t bytes = _displace_bytes(bucket_count_for(size)) + sizeof(SlotType) * size;
+    return sizeof(SelfType) + bytes + _array_align(bytes) - 1;
+  }
+  /**
+   * @brief 由全部键构造完美 hash，值为默认构造，之后可通过 get()/迭代器原地赋值
+   *        值是偏移指针等不能经栈中转的类型时，应使用这种方式
+   *
+   * @tparam Container  键的容器，元素为 KeyType
+   * @return true 构造成功；有重复键时返回 false
+   */
+  template<typename Container>
+  bool  build_keys(const Container& keys,segment_manager& segment)
+  {
+    if(m_slot_offset != 0)
+      return false;
+    std::vector<KeyType>  key_list(keys.begin(),keys.end());
+    size_t                size    = key_list.size();
+    SizeType              count   = checked_offset<SizeType>((ptrdiff_t)size);
+    SizeType              buckets = bucket_count_for(size);
+    std::vector<uint32_t> displace(buckets,0);
+    std::vector<SizeType> order;
+    if(size != 0 && !_search(key_list,buckets,displace,order))
+      return false;
+
+    size_t  head  = _displace_bytes(buckets);
+    size_t  bytes = head + sizeof(SlotType) * size;
+    MMO_ALLOC_KIND(alloc_perfect_hash_table);
+    char*   p     = segment.alloc(bytes,_array_align(bytes));
+    if(p == NULL)
+    {
+      size_t free_size = segment.get_free_memory();
+      size_t used_size = segment.size();
+      std::string strErrMsg = "mmo_exception:: no enough memory,free:" + std::to_string(free_size) + ",used:"
+        + std::to_string(used_size) + ",alloc size:" + std::to_string(bytes) ;
+      throw mmo_exception((int32_t)mmo_exception::no_enough_memory,strErrMsg);
+      return false;
+    }
+    m_size            = count;
+    m_bucket_count    = buckets;
+    m_displace_offset = checked_offset<SizeType>(p - (char*)this);
+    m_slot_offset     = checked_offset<SizeType>(p + head - (char*)this);
+    if(buckets != 0)
+      memcpy(p,displace.data(),sizeof(uint32_t) * (size_t)buckets);
+    SlotType* slots = _slots();
+    for(size_t i = 0;i < size;i++)
+    {
+      SlotType* slot = slots + order[i];
+      ::new((void*)&slot->value)ValueType();
+      slot->key = key_list[i];
+    }
+    return true;
+  }
+  /**
+   * @brief 由全部键值对构造
+   *
+   * @tparam Container  元素为 std::pair<KeyType,ValueType> 的容器，如 std::vector / std::map / std::unordered_map
+   */
+  template<typename Container>
+  bool  build(const Container& items,segment_manager& segment)
+  {
+    std::vector<KeyType> keys;
+    keys.reserve(items.size());
+    for(auto& it:items)
+      keys.push_back(it.first);
+    if(!build_keys(keys,segment))
+      return false;
+    if(segment.measuring())
+      return true;
+    for(auto& it:items)
+      *get(it.first) = it.second;
+    return true;
+  }
+  SizeType  size()const{return m_size;}
+  bool      empty()const{return m_size==0;}
+  SizeType  hash_size()const{return m_bucket_count;}
+  ValueType&        operator[](const KeyType& key)
+  {
+    ValueType* p = get(key);
+    return (p == NULL) ? m_default_value : *p;
+  }
+  const ValueType&  operator[](const KeyType& key)const
+  {
+    const ValueType* p = get(key);
+    return (p == NULL) ? m_default_value : *p;
+  }
+  iterator  find(const KeyType& key)const
+  {
+    SizeType index = _index(key);
+    return (index == m_size) ? end() : iterator(this,index);
+  }
+  const ValueType* get(const KeyType& key)const
+  {
+    SizeType index = _index(key);
+    return (index == m_size) ? NULL : &_slots()[index].value;
+  }
+  ValueType* get(const KeyType& key)
+  {
+    return (ValueType*)((const SelfType*)this)->get(key);
+  }
+  iterator  begin()const{return iterator(this,0);}
+  iterator  end()const{return iterator(this,m_size);}
+public:
+  const uint32_t* _displace()const{return (const uint32_t*)((const char*)this + m_displace_offset);}
+  const SlotType* _slots()const{return (const SlotType*)((const char*)this + m_slot_offset);}
+  SlotType*       _slots(){return (SlotType*)((char*)this + m_slot_offset);}
+  const ValueType&  _default_value()const{return m_default_value;}
+protected:
+  /**
+   * @brief 位移表字节数，对齐布局下补齐到槽位的对齐
+   */
+  static size_t   _displace_bytes(size_t buckets)
+  {
+    return layout_round(sizeof(uint32_t) * buckets,layout_align<SlotType>());
+  }
+  static size_t   _array_align(size_t bytes)
+  {
+    size_t a = layout_array_align<SlotType>(bytes);
+    return (a < layout_align<uint32_t>()) ? layout_align<uint32_t>() : a;
+  }
+  static uint64_t _mix(uint64_t h)
+  {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+  static uint64_t _hash(const KeyType& key,uint32_t seed)
+  {
+    return _mix((uint64_t)std::hash<KeyType>()(key) ^ ((uint64_t)seed * 0x9E3779B97F4A7C15ULL));
+  }
+  static size_t   _range(uint64_t h,size_t n)
+  {
+    return (size_t)(((h & 0xFFFFFFFFULL) * (uint64_t)n) >> 32);
+  }
+  static size_t   _bucket(uint64_t h,size_t buckets)
+  {
+    return (size_t)(((h >> 32) * (uint64_t)buckets) >> 32);
+  }
+  static size_t   _slot(uint64_t h,uint32_t displace,size_t n)
+  {
+    if(displace & direct_flag)
+      return displace & ~direct_flag;
+    return _range(_mix(h + (uint64_t)displace * 0xC2B2AE3D27D4EB4FULL),n);
+  }
+  /**
+   * @brief 键到槽位：一次位移表读取 + 一次槽位比较
+   *
+   * @return SizeType 槽位下标，未命中返回 m_size
+   */
+  SizeType  _index(const KeyType& key)const
+  {
+    if(m_size == 0)
+      return m_size;
+    uint64_t  h     = _hash(key,m_seed);
+    size_t    index = _slot(h,_displace()[_bucket(h,m_bucket_count)],m_size);
+    return (_slots()[index].key == key) ? (SizeType)index : m_size;
+  }
+  /**
+   * @brief CHD 搜索：桶按大小降序逐个放置，为每个桶找到第一个使其所有键都落在空槽的位移
+   *        个别种子下可能放不下，则换种子重来
+   *
+   * @param order 输出：每个键对应的槽位
+   */
+  bool      _search(const std::vector<KeyType>& keys,size_t buckets,std::vector<uint32_t>& displace,std::vector<SizeType>& order)
+  {
+    size_t n = keys.size();
+    if(n > (size_t)direct_flag)
+      throw mmo_exception((int32_t)mmo_exception::no_enough_memory,"mmo_exception:: too many keys for perfect hash!");
+    std::vector<uint64_t> hashes(n);
+    std::vector<size_t>   slots;
+    std::vector<char>     used(n);
+    order.assign(n,0);
+    for(uint32_t seed = 0;seed < max_seed_retry;seed++)
+    {
+      std::vector<std::vector<size_t>> members(buckets);
+      for(size_t i = 0;i < n;i++)
+      {
+        hashes[i] = _hash(keys[i],seed);
+        members[_bucket(hashes[i],buckets)].push_back(i);
+      }
+      std::vector<size_t> bucket_order(buckets);
+      for(size_t b = 0;b < buckets;b++)
+        bucket_order[b] = b;
+      std::stable_sort(bucket_order.begin(),bucket_order.end(),[&members](size_t a,size_t b)
+      {
+        return members[a].size() > members[b].size();
+      });
+
+      //相同的键必然落入同一个桶，任何种子与位移都放不下，放置之前先在桶内比较
+      for(size_t b = 0;b < buckets && seed == 0;b++)
+      {
+        const std::vector<size_t>& m = members[b];
+        for(size_t i = 1;i < m.size();i++)
+        {
+          for(size_t j = 0;j < i;j++)
+          {
+            if(keys[m[i]] == keys[m[j]])
+              return false;
+          }
+        }
+      }
+
+      std::fill(used.begin(),used.end(),0);
+      bool    ok    = true;
+      size_t  next  = 0;
+      for(size_t b:bucket_order)
+      {
+        std::vector<size_t>& m = members[b];
+        if(m.empty())
+          break;
+        if(m.size() == 1)
+        {
+          while(used[next])
+            ++next;
+          used[next]    = 1;
+          displace[b]   = direct_flag | (uint32_t)next;
+          order[m[0]]   = (SizeType)next;
+          continue;
+        }
+        bool placed = false;
+        for(uint32_t d = 0;d < max_displace && !placed;d++)
+        {
+          slots.clear();
+          placed = true;
+          for(size_t i:m)
+          {
+            size_t s = _slot(hashes[i],d,n);
+            if(used[s] || std::find(slots.begin(),slots.end(),s) != slots.end())
+            {
+              placed = false;
+              break;
+            }
+            slots.push_back(s);
+          }
+          if(placed)
+          {
+            displace[b] = d;
+            for(size_t k = 0;k < m.size();k++)
+            {
+              used[slots[k]]  = 1;
+              order[m[k]]     = (SizeType)slots[k];
+            }
+          }
+        }
+        if(!placed)
+        {
+          ok = false;
+          break;
+        }
+      }
+      if(ok)
+      {
+        m_seed = seed;
+        return true;
+      }
+      std::fill(displace.begin(),displace.end(),0);
+    }
+    throw mmo_exception((int32_t)mmo_exception::unknown_exception,"mmo_exception:: perfect hash build failed!");
+    return false;
+  }
+};
+template<typename KeyType,typename ValueType,typename SizeType>
+struct has_relative_offset<perfect_hash_map<KeyType,ValueType,SizeType>>:std::true_type{};
+
+MMO_PACK_END
+
+}//end namespace mmo
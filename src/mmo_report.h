@@ -0,0 +1,287 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_report.h
+*           复杂对象--线性映射库--分配统计与布局报告
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include "mmo_segment.h"
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+namespace mmo
+{
+
+inline const char* alloc_kind_name(alloc_kind kind)
+{
+  static const char* s_names[alloc_kind_count] =
+  {
+    "object",
+    "string",
+    "vector",
+    "var_element",
+    "var_block",
+    "index_table",
+    "hash_table",
+    "hash_node",
+    "delta_payload",
+    "flat_hash_slots",
+    "perfect_hash_table",
+    "sorted_map_table",
+    "rtree_nodes",
+    "far_slot",
+  };
+  return ((int)kind >= 0 && kind < alloc_kind_count) ? s_names[kind] : "unknown";
+}
+
+/**
+ * @brief 分配统计：挂到内存段上，按 用途 与 调用点 x 用途 累计分配次数、字节数、对齐填充和大小分布
+ *        用途标记需以 MMO_ALLOC_TRACKING 编译，否则全部计入 object；不影响字节数与填充的统计。
+ *        调用点由使用方用 MMO_ALLOC_SITE("名字") 或 MMO_ALLOC_SITE_HERE() 标在构造代码中，
+ *        名字须为字串常量（只保存指针），未标记的分配调用点为 "-"。
+ *        多个线程的内存段可挂同一个统计对象。
+ *
+ *   mmo::alloc_tracker tracker;
+ *   size_t bytes = mmo::track([](mmo::segment_manager& segment)
+ *   {
+ *     mmo::construct<CRoadMap>(segment)->init(3,segment);
+ *   },tracker);
+ *   printf("%s",tracker.report(bytes).c_str());
+ */
+class alloc_tracker:
+  public alloc_observer
+{
+public:
+  enum
+  {
+    size_classes = 33,  //按 2 的幂分档：第 0 档为 [0,2)，第 i 档为 [2^i,2^(i+1))，最后一档不设上限
+  };
+  class stat
+  {
+  public:
+    size_t    count{0};
+    size_t    bytes{0};
+    size_t    padding{0};
+    size_t    max_size{0};
+    size_t    histogram[size_classes]{};
+  public:
+    void  add(size_t size,size_t pad,bool counted)
+    {
+      padding += pad;
+      if(!counted)
+        return;
+      count ++;
+      bytes += size;
+      max_size = std::max(max_size,size);
+      histogram[size_class(size)] ++;
+    }
+    void  merge(const stat& other)
+    {
+      count     += other.count;
+      bytes     += other.bytes;
+      padding   += other.padding;
+      max_size  = std::max(max_size,other.max_size);
+      for(int i = 0;i < size_classes;i++)
+        histogram[i] += other.histogram[i];
+    }
+  };
+  typedef std::pair<const char*,alloc_kind> SiteKey;
+protected:
+  mutable std::mutex            m_lock;
+  stat                          m_kinds[alloc_kind_count];
+  std::map<SiteKey,stat>        m_sites;
+public:
+  alloc_tracker(){}
+  alloc_tracker(const alloc_tracker&) = delete;
+  alloc_tracker& operator=(const alloc_tracker&) = delete;
+public:
+  virtual void on_alloc(size_t size,size_t padding) override
+  {
+    const alloc_context& context = alloc_context::current();
+    std::lock_guard<std::mutex> lock(m_lock);
+    //不计数 size 为 0 的分配（对齐推进），只累计其填充
+    if(context.split != 0 && size > context.split)
+    {
+      _add(context.site,context.kind,context.split,padding,true);
+      _add(context.site,alloc_object,size - context.split,0,true);
+    }
+    else
+      _add(context.site,context.kind,size,padding,size != 0);
+  }
+  void    clear()
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    for(auto& kind:m_kinds)
+      kind = stat();
+    m_sites.clear();
+  }
+  stat    kind_stat(alloc_kind kind)const
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_kinds[kind];
+  }
+  stat    total()const
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    stat sum;
+    for(auto& kind:m_kinds)
+      sum.merge(kind);
+    return sum;
+  }
+  /**
+   * @brief 按调用点名字（字串内容）与用途合并后的统计，按字节数从大到小排列
+   */
+  std::vector<std::pair<std::pair<std::string,alloc_kind>,stat>> sites()const
+  {
+    std::map<std::pair<std::string,alloc_kind>,stat> merged;
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      for(auto& it:m_sites)
+        merged[std::make_pair(std::string(it.first.first == nullptr ? "-" : it.first.first),it.first.second)].merge(it.second);
+    }
+    std::vector<std::pair<std::pair<std::string,alloc_kind>,stat>> result(merged.begin(),merged.end());
+    std::stable_sort(result.begin(),result.end(),[](const std::pair<std::pair<std::string,alloc_kind>,stat>& a,const std::pair<std::pair<std::string,alloc_kind>,stat>& b)
+    {
+      return (a.second.bytes + a.second.padding) > (b.second.bytes + b.second.padding);
+    });
+    return result;
+  }
+  /**
+   * @brief 生成文本报告：总览、按用途、按调用点、各用途的大小分布
+   *
+   * @param image_size 镜像总字节数（内存段的 size()），不为 0 时同时给出未经统计的字节数，
+   *                   即挂上统计之前占用的部分
+   */
+  std::string report(size_t image_size = 0)const
+  {
+    stat        sum     = total();
+    size_t      used    = sum.bytes + sum.padding;
+    size_t      base    = std::max(image_size,used);
+    std::string out;
+
+    out += "== mmo allocation report ==\n";
+    if(image_size != 0)
+      _line(out,"%-18s %14zu\n","image bytes",image_size);
+    _line(out,"%-18s %14zu %6.1f%%  (%zu allocations)\n","allocated bytes",sum.bytes,_percent(sum.bytes,base),sum.count);
+    _line(out,"%-18s %14zu %6.1f%%\n","padding bytes",sum.padding,_percent(sum.padding,base));
+    if(image_size != 0)
+    {
+      size_t untracked = image_size > used ? image_size - used : 0;
+      _line(out,"%-18s %14zu %6.1f%%\n","untracked bytes",untracked,_percent(untracked,base));
+    }
+
+    out += "\n-- by kind --\n";
+    _line(out,"%-18s %10s %14s %7s %12s %10s %10s\n","kind","count","bytes","share","padding","avg","max");
+    std::vector<int> kinds;
+    for(int i = 0;i < alloc_kind_count;i++)
+      kinds.push_back(i);
+    stat snapshot[alloc_kind_count];
+    for(int i = 0;i < alloc_kind_count;i++)
+      snapshot[i] = kind_stat((alloc_kind)i);
+    std::stable_sort(kinds.begin(),kinds.end(),[&snapshot](int a,int b){return snapshot[a].bytes > snapshot[b].bytes;});
+    for(int i:kinds)
+    {
+      const stat& s = snapshot[i];
+      if(s.count == 0 && s.padding == 0)
+        continue;
+      _line(out,"%-18s %10zu %14zu %6.1f%% %12zu %10.1f %10zu\n",alloc_kind_name((alloc_kind)i),s.count,s.bytes,_percent(s.bytes,base),
+        s.padding,s.count == 0 ? 0.0 : (double)s.bytes / s.count,s.max_size);
+    }
+
+    out += "\n-- by site --\n";
+    _line(out,"%-32s %-18s %10s %14s %7s %12s\n","site","kind","count","bytes","share","padding");
+    for(auto& it:sites())
+    {
+      const stat& s = it.second;
+      _line(out,"%-32s %-18s %10zu %14zu %6.1f%% %12zu\n",it.first.first.c_str(),alloc_kind_name(it.first.second),s.count,s.bytes,
+        _percent(s.bytes,base),s.padding);
+    }
+
+    out += "\n-- size classes (bytes:count) --\n";
+    for(int i:kinds)
+    {
+      const stat& s = snapshot[i];
+      if(s.count == 0)
+        continue;
+      _line(out,"%-18s",alloc_kind_name((alloc_kind)i));
+      for(int c = 0;c < size_classes;c++)
+      {
+        if(s.histogram[c] == 0)
+          continue;
+        if(c == 0)
+          _line(out," 0-1:%zu",s.histogram[c]);
+        else if(c == size_classes - 1)
+          _line(out," %zu+:%zu",(size_t)1 << c,s.histogram[c]);
+        else
+          _line(out," %zu-%zu:%zu",(size_t)1 << c,((size_t)1 << (c + 1)) - 1,s.histogram[c]);
+      }
+      out += "\n";
+    }
+    return out;
+  }
+public:
+  static int    size_class(size_t size)
+  {
+    int c = 0;
+    while(size > 1 && c < size_classes - 1)
+    {
+      size >>= 1;
+      c ++;
+    }
+    return c;
+  }
+protected:
+  void  _add(const char* site,alloc_kind kind,size_t size,size_t padding,bool counted)
+  {
+    m_kinds[kind].add(size,padding,counted);
+    m_sites[SiteKey(site,kind)].add(size,padding,counted);
+  }
+  static double _percent(size_t part,size_t whole)
+  {
+    return whole == 0 ? 0.0 : 100.0 * (double)part / (double)whole;
+  }
+  template<typename... Args>
+  static void   _line(std::string& out,const char* format,Args... args)
+  {
+    char buf[256];
+    int  n = snprintf(buf,sizeof(buf),format,args...);
+    if(n > 0)
+      out.append(buf,std::min((size_t)n,sizeof(buf) - 1));
+  }
+};
+
+/**
+ * @brief 以测量方式试运行一遍构造过程，期间的分配全部计入 tracker，返回镜像字节数
+ *        与 measure() 相同，字串、数组等负载内容不写入、不占物理内存，可用于分析大规模的真实数据
+ *
+ * @tparam Builder  可调用对象：void(segment_manager&)
+ */
+template<typename Builder>
+size_t track(Builder&& build,alloc_tracker& tracker)
+{
+  measure_segment& segment = measure_segment::local();
+  segment.clear();
+  segment.set_observer(&tracker);
+  try
+  {
+    build((segment_manager&)segment);
+  }
+  catch(...)
+  {
+    segment.set_observer(nullptr);
+    segment.clear();
+    throw;
+  }
+  size_t bytes = segment.size();
+  segment.set_observer(nullptr);
+  segment.clear();
+  return bytes;
+}
+
+}//end namespace mmo
@@ -0,0 +1,455 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_rtree.h
+*           复杂对象--线性映射库--Hilbert 排序的静态 R 树空间索引
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include <algorithm>
+#include <queue>
+#include <limits>
+
+namespace mmo
+{
+
+MMO_PACK_BEGIN
+
+/**
+ * @brief 二维外包矩形，闭区间 [min,max]
+ *
+ * @tparam CoordType 坐标类型
+ */
+template<typename CoordType>
+class box2d
+{
+public:
+  CoordType   min_x;
+  CoordType   min_y;
+  CoordType   max_x;
+  CoordType   max_y;
+public:
+  box2d()
+  {
+    min_x = min_y = std::numeric_limits<CoordType>::max();
+    max_x = max_y = std::numeric_limits<CoordType>::lowest();
+  }
+  box2d(CoordType x0,CoordType y0,CoordType x1,CoordType y1)
+  {
+    min_x = x0; min_y = y0;
+    max_x = x1; max_y = y1;
+  }
+public:
+  bool    valid()const{return (min_x <= max_x && min_y <= max_y);}
+  bool    intersects(const box2d& o)const
+  {
+    return !(o.min_x > max_x || o.max_x < min_x || o.min_y > max_y || o.max_y < min_y);
+  }
+  bool    contains(CoordType x,CoordType y)const
+  {
+    return (x >= min_x && x <= max_x && y >= min_y && y <= max_y);
+  }
+  void    expand(CoordType x,CoordType y)
+  {
+    if(x < min_x) min_x = x;
+    if(y < min_y) min_y = y;
+    if(x > max_x) max_x = x;
+    if(y > max_y) max_y = y;
+  }
+  void    expand(const box2d& o)
+  {
+    if(o.min_x < min_x) min_x = o.min_x;
+    if(o.min_y < min_y) min_y = o.min_y;
+    if(o.max_x > max_x) max_x = o.max_x;
+    if(o.max_y > max_y) max_y = o.max_y;
+  }
+  /**
+   * @brief 点到矩形的距离平方，点在矩形内为 0
+   */
+  double  distance2(CoordType x,CoordType y)const
+  {
+    double dx = (x < min_x) ? (double)min_x - x : ((x > max_x) ? (double)x - max_x : 0.0);
+    double dy = (y < min_y) ? (double)min_y - y : ((y > max_y) ? (double)y - max_y : 0.0);
+    return dx * dx + dy * dy;
+  }
+};
+
+/**
+ * @brief 无内存分配 ，内容相对地址存储，只读静态 R 树模板类（packed Hilbert R-tree）
+ *        构造时一次性给出全部 {外包矩形,值}，按矩形中心的 Hilbert 值排序后自底向上打包，
+ *        每个节点固定 node_size 个孩子，空间上相邻的对象落在同一叶节点中。
+ *        各层节点按层连续存放，父子关系由层边界直接算出，不存孩子指针：
+ *        第 L 层第 j 个节点的孩子是第 L-1 层的 [j*node_size,(j+1)*node_size)。
+ *        布局：[对象头][矩形数组 node_count：叶子在前，根在最后][值数组 size，与叶子一一对应]
+ *
+ * @tparam ValueType  叶子上的值，如对象在 var_vector 中的下标
+ * @tparam SizeType   注意：类型最大值 需大于 寻址空间最大值
+ * @tparam CoordType  坐标类型
+ */
+template<typename ValueType,typename SizeType,typename CoordType = int32_t>
+class packed_rtree
+{
+public:
+  typedef packed_rtree<ValueType,SizeType,CoordType>  SelfType;
+  typedef box2d<CoordType>                            BoxType;
+  enum
+  {
+    node_size   = 16,
+    max_levels  = 9,             //含叶子层：8 层内部节点可容纳 16^8 个叶子，已超过 uint32_t 的表示范围
+  };
+protected:
+  uint32_t    m_size{0};
+  uint32_t    m_node_count{0};
+  uint8_t     m_level_count{0};
+  uint32_t    m_level_end[max_levels];   //第 L 层节点在矩形数组中的结束位置，第 0 层为叶子
+  SizeType    m_box_offset{0};
+  SizeType    m_value_offset{0};
+public:
+  packed_rtree(){memset(m_level_end,0,sizeof(m_level_end));}
+  packed_rtree(const SelfType&) = delete;
+  SelfType& operator=(const SelfType&) = delete;
+public:
+  /**
+   * @brief 全部层的节点总数
+   */
+  static size_t    node_count_for(size_t size)
+  {
+    size_t total = size;
+    size_t n     = size;
+    while(n > 1)
+    {
+      n      = (n + node_size - 1) / node_size;
+      total += n;
+    }
+    return total;
+  }
+  /**
+   * @brief 含叶子层在内的层数
+   */
+  static size_t    level_count_for(size_t size)
+  {
+    size_t levels = 1;
+    for(size_t n = size;n > 1;levels++)
+      n = (n + node_size - 1) / node_size;
+    return levels;
+  }
+  static size_t    predict_capacity_bytes(size_t size)
+  {
+    size_t bytes = _box_bytes(node_count_for(size)) + sizeof(ValueType) * size;
+    return sizeof(SelfType) + bytes + _array_align(bytes) - 1;
+  }
+  /**
+   * @brief 由全部 {外包矩形,值} 构造，输入顺序无关
+   *
+   * @tparam Container  元素为 std::pair<BoxType,ValueType> 的容器
+   * @return true
+   */
+  template<typename Container>
+  bool  build(const Container& items,segment_manager& segment)
+  {
+    if(m_box_offset != 0)
+      return false;
+    size_t size  = items.size();
+    size_t nodes = node_count_for(size);
+    if(size > (size_t)0xFFFFFFFFU || nodes > (size_t)0xFFFFFFFFU || level_count_for(size) > (size_t)max_levels)
+      throw mmo_exception((int32_t)mmo_exception::no_enough_memory,"mmo_exception:: too many items for rtree!");
+
+    size_t  head  = _box_bytes(nodes);
+    size_t  bytes = head + sizeof(ValueType) * size;
+    MMO_ALLOC_KIND(alloc_rtree_nodes);
+    char*   p     = segment.alloc(bytes,_array_align(bytes));
+    if(p == NULL)
+    {
+      size_t free_size = segment.get_free_memory();
+      size_t used_size = segment.size();
+      std::string strErrMsg = "mmo_exception:: no enough memory,free:" + std::to_string(free_size) + ",used:"
+        + std::to_string(used_size) + ",alloc size:" + std::to_string(bytes) ;
+      throw mmo_exception((int32_t)mmo_exception::no_enough_memory,strErrMsg);
+      return false;
+    }
+    m_size          = (uint32_t)size;
+    m_node_count    = (uint32_t)nodes;
+    m_box_offset    = checked_offset<SizeType>(p - (char*)this);
+    m_value_offset  = checked_offset<SizeType>(p + head - (char*)this);
+    m_level_count   = 0;
+    size_t n = size;
+    size_t e = size;
+    m_level_end[m_level_count++] = (uint32_t)e;
+    while(n > 1)
+    {
+      n = (n + node_size - 1) / node_size;
+      e += n;
+      m_level_end[m_level_count++] = (uint32_t)e;
+    }
+    if(segment.measuring() || size == 0)
+      return true;
+
+    //叶子：按中心点的 Hilbert 值排序
+    BoxType extent;
+    for(auto& it:items)
+      extent.expand(it.first);
+    double w = (double)extent.max_x - (double)extent.min_x;
+    double h = (double)extent.max_y - (double)extent.min_y;
+    std::vector<std::pair<uint32_t,const typename Container::value_type*>> order;
+    order.reserve(size);
+    for(auto& it:items)
+    {
+      double cx = ((double)it.first.min_x + (double)it.first.max_x) / 2 - (double)extent.min_x;
+      double cy = ((double)it.first.min_y + (double)it.first.max_y) / 2 - (double)extent.min_y;
+      uint32_t hx = (w > 0) ? (uint32_t)(65535.0 * cx / w) : 0;
+      uint32_t hy = (h > 0) ? (uint32_t)(65535.0 * cy / h) : 0;
+      order.emplace_back(_hilbert(hx,hy),&it);
+    }
+    std::stable_sort(order.begin(),order.end(),[](const std::pair<uint32_t,const typename Container::value_type*>& a,
+                                                  const std::pair<uint32_t,const typename Container::value_type*>& b)
+    {
+      return a.first < b.first;
+    });
+    BoxType*    boxes   = _boxes();
+    ValueType*  values  = _values();
+    for(size_t i = 0;i < size;i++)
+    {
+      boxes[i] = order[i].second->first;
+      ::new((void*)(values + i))ValueType(order[i].second->second);
+    }
+    //上层：每 node_size 个相邻节点合并为一个父节点
+    for(uint8_t level = 1;level < m_level_count;level++)
+    {
+      size_t child = (level == 1) ? 0 : m_level_end[level - 2];
+      size_t child_end = m_level_end[level - 1];
+      for(size_t pos = m_level_end[level - 1];pos < m_level_end[level];pos++)
+      {
+        BoxType box;
+        size_t  last = std::min(child + node_size,child_end);
+        for(;child < last;child++)
+          box.expand(boxes[child]);
+        boxes[pos] = box;
+      }
+    }
+    return true;
+  }
+  uint32_t  size()const{return m_size;}
+  bool      empty()const{return m_size==0;}
+  /**
+   * @brief 全部对象的外包矩形
+   */
+  BoxType   bounds()const{return (m_size == 0) ? BoxType() : _boxes()[m_node_count - 1];}
+  /**
+   * @brief 第 index 个叶子（Hilbert 顺序）
+   */
+  const BoxType&    box(uint32_t index)const{return _boxes()[index];}
+  const ValueType&  value(uint32_t index)const{return _values()[index];}
+  ValueType&        value(uint32_t index){return _values()[index];}
+public:
+  /**
+   * @brief 查找外包矩形与 range 相交的全部对象，深度优先，不分配内存
+   *
+   * @param visit 可调用对象：bool(const ValueType&)，返回 false 时提前结束
+   * @return size_t 访问的对象个数
+   */
+  template<typename Visitor>
+  size_t    query(const BoxType& range,Visitor visit)const
+  {
+    if(m_size == 0)
+      return 0;
+    const BoxType*    boxes   = _boxes();
+    const ValueType*  values  = _values();
+    uint32_t  stack[max_levels * node_size];
+    uint8_t   levels[max_levels * node_size];
+    size_t    top   = 0;
+    size_t    count = 0;
+    stack[top]  = m_node_count - 1;
+    levels[top] = m_level_count - 1;
+    ++ top;
+    while(top != 0)
+    {
+      -- top;
+      uint32_t  pos   = stack[top];
+      uint8_t   level = levels[top];
+      if(!boxes[pos].intersects(range))
+        continue;
+      if(level == 0)
+      {
+        ++ count;
+        if(!visit(values[pos]))
+          break;
+        continue;
+      }
+      uint32_t first, last;
+      _children(pos,level,first,last);
+      //逆序入栈，使出栈顺序与存放顺序一致
+      for(uint32_t child = last;child > first;child--)
+      {
+        stack[top]  = child - 1;
+        levels[top] = level - 1;
+        ++ top;
+      }
+    }
+    return count;
+  }
+  /**
+   * @brief 查找外包矩形与 range 相交的全部对象
+   */
+  size_t    query(const BoxType& range,std::vector<const ValueType*>& result)const
+  {
+    return query(range,[&result](const ValueType& v){result.push_back(&v);return true;});
+  }
+  /**
+   * @brief 按外包矩形到点 (x,y) 的距离由近及远访问对象（best-first）
+   *        距离是到外包矩形的距离，需要精确距离时由调用者对结果再做计算
+   *
+   * @param visit 可调用对象：bool(const ValueType&,double distance2)，返回 false 时结束
+   * @param max_distance2 只访问距离平方不超过此值的对象
+   * @return size_t 访问的对象个数
+   */
+  template<typename Visitor>
+  size_t    nearest(CoordType x,CoordType y,Visitor visit,double max_distance2 = std::numeric_limits<double>::infinity())const
+  {
+    if(m_size == 0)
+      return 0;
+    struct entry
+    {
+      double    dist;
+      uint32_t  pos;
+      uint8_t   level;
+      bool operator<(const entry& o)const{return dist > o.dist;}
+    };
+    const BoxType*    boxes   = _boxes();
+    const ValueType*  values  = _values();
+    std::priority_queue<entry> queue;
+    size_t count = 0;
+    queue.push(entry{boxes[m_node_count - 1].distance2(x,y),m_node_count - 1,(uint8_t)(m_level_count - 1)});
+    while(!queue.empty())
+    {
+      entry e = queue.top();
+      queue.pop();
+      if(e.dist > max_distance2)
+        break;
+      if(e.level == 0)
+      {
+        ++ count;
+        if(!visit(values[e.pos],e.dist))
+          break;
+        continue;
+      }
+      uint32_t first, last;
+      _children(e.pos,e.level,first,last);
+      for(uint32_t child = first;child < last;child++)
+        queue.push(entry{boxes[child].distance2(x,y),child,(uint8_t)(e.level - 1)});
+    }
+    return count;
+  }
+  /**
+   * @brief 距离点 (x,y) 最近的 k 个对象，由近及远
+   */
+  size_t    nearest(CoordType x,CoordType y,size_t k,std::vector<const ValueType*>& result,
+                    double max_distance2 = std::numeric_limits<double>::infinity())const
+  {
+    if(k == 0)
+      return 0;
+    return nearest(x,y,[&result,k](const ValueType& v,double){result.push_back(&v);return result.size() < k;},max_distance2);
+  }
+public:
+  uint32_t          _node_count()const{return m_node_count;}
+  /**
+   * @brief 层数与各层边界是否与 size() 一致，用于校验外部传入的镜像
+   */
+  bool              _valid_levels()const
+  {
+    if(m_level_count < 1 || m_level_count > max_levels || m_node_count != node_count_for(m_size))
+      return false;
+    size_t n = m_size;
+    size_t e = m_size;
+    for(uint8_t level = 0;level < m_level_count;level++)
+    {
+      if(m_level_end[level] != e || (level + 1 < m_level_count) != (n > 1))
+        return false;
+      n  = (n + node_size - 1) / node_size;
+      e += n;
+    }
+    return true;
+  }
+  const BoxType*    _boxes()const{return (const BoxType*)((const char*)this + m_box_offset);}
+  BoxType*          _boxes(){return (BoxType*)((char*)this + m_box_offset);}
+  const ValueType*  _values()const{return (const ValueType*)((const char*)this + m_value_offset);}
+  ValueType*        _values(){return (ValueType*)((char*)this + m_value_offset);}
+protected:
+  /**
+   * @brief 矩形数组字节数，对齐布局下补齐到值的对齐
+   */
+  static size_t     _box_bytes(size_t nodes)
+  {
+    return layout_round(sizeof(BoxType) * nodes,layout_align<ValueType>());
+  }
+  static size_t     _array_align(size_t bytes)
+  {
+    size_t a = layout_array_align<BoxType>(bytes);
+    return (a < layout_align<ValueType>()) ? layout_align<ValueType>() : a;
+  }
+  /**
+   * @brief 第 level 层位于 pos 的节点，其孩子在矩形数组中的范围 [first,last)
+   */
+  void      _children(uint32_t pos,uint8_t level,uint32_t& first,uint32_t& last)const
+  {
+    uint32_t level_begin = m_level_end[level - 1];
+    uint32_t child_begin = (level == 1) ? 0 : m_level_end[level - 2];
+    first = child_begin + (pos - level_begin) * node_size;
+    last  = std::min(first + (uint32_t)node_size,m_level_end[level - 1]);
+  }
+  /**
+   * @brief 16 位网格坐标 (x,y) 的 Hilbert 曲线序号（无分支、无循环的位运算实现）
+   */
+  static uint32_t   _hilbert(uint32_t x,uint32_t y)
+  {
+    uint32_t a = x ^ y;
+    uint32_t b = 0xFFFF ^ a;
+    uint32_t c = 0xFFFF ^ (x | y);
+    uint32_t d = x & (y ^ 0xFFFF);
+
+    uint32_t A = a | (b >> 1);
+    uint32_t B = (a >> 1) ^ a;
+    uint32_t C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+    uint32_t D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+    a = A; b = B; c = C; d = D;
+    A = ((a & (a >> 2)) ^ (b & (b >> 2)));
+    B = ((a & (b >> 2)) ^ (b & ((a ^ b) >> 2)));
+    C ^= ((a & (c >> 2)) ^ (b & (d >> 2)));
+    D ^= ((b & (c >> 2)) ^ ((a ^ b) & (d >> 2)));
+
+    a = A; b = B; c = C; d = D;
+    A = ((a & (a >> 4)) ^ (b & (b >> 4)));
+    B = ((a & (b >> 4)) ^ (b & ((a ^ b) >> 4)));
+    C ^= ((a & (c >> 4)) ^ (b & (d >> 4)));
+    D ^= ((b & (c >> 4)) ^ ((a ^ b) & (d >> 4)));
+
+    a = A; b = B; c = C; d = D;
+    C ^= ((a & (c >> 8)) ^ (b & (d >> 8)));
+    D ^= ((b & (c >> 8)) ^ ((a ^ b) & (d >> 8)));
+
+    a = C ^ (C >> 1);
+    b = D ^ (D >> 1);
+
+    uint32_t i0 = x ^ y;
+    uint32_t i1 = b | (0xFFFF ^ (i0 | a));
+
+    i0 = (i0 | (i0 << 8)) & 0x00FF00FF;
+    i0 = (i0 | (i0 << 4)) & 0x0F0F0F0F;
+    i0 = (i0 | (i0 << 2)) & 0x33333333;
+    i0 = (i0 | (i0 << 1)) & 0x55555555;
+
+    i1 = (i1 | (i1 << 8)) & 0x00FF00FF;
+    i1 = (i1 | (i1 << 4)) & 0x0F0F0F0F;
+    i1 = (i1 | (i1 << 2)) & 0x33333333;
+    i1 = (i1 | (i1 << 1)) & 0x55555555;
+
+    return (i1 << 1) | i0;
+  }
+};
+template<typename ValueType,typename SizeType,typename CoordType>
+struct has_relative_offset<packed_rtree<ValueType,SizeType,CoordType>>:std::true_type{};
+
+MMO_PACK_END
+
+}//end namespace mmo
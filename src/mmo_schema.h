@@ -0,0 +1,388 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_schema.h
+*           复杂对象--线性映射库--成员描述：由一次声明生成构造、测量、遍历、转换
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include "mmo_segment.h"
+#include "mmo_copy.h"
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @brief 在类中声明参与映射的成员，须写在这些成员的声明之后，宏之后的访问权限为 public
+ *        生成：
+ *          mmo_fields()        各成员引用组成的 std::tuple，供泛型代码在编译期逐个展开；
+ *          mmo_field_names()   成员名列表；
+ *          mmo_copy()          深拷贝钩子，mmo::clone / mmo::copier 可直接使用。
+ *        有了描述后，mmo::from_std / mmo::to_std / mmo::predict_bytes / mmo::visit_fields 即可用于该类，
+ *        全部分派在编译期完成，展开后与手写逐成员代码相同。
+ *        成员须可取引用：类本身不要放在 MMO_PACK_BEGIN/END 之间。
+ *
+ *   class CRoad
+ *   {
+ *   protected:
+ *     uint64_t                       m_id{0};
+ *     mmo::string<int16_t>           m_name;
+ *     mmo::vector<Point2D,int16_t>   m_coors;
+ *     MMO_SCHEMA(CRoad,m_id,m_name,m_coors)
+ *   };
+ *   mmo::std_type<CRoad> src(1,"road_1",{{10,20},{11,21}});   //std::tuple<uint64_t,std::string,std::vector<Point2D>>
+ *   CRoad* road = mmo::build_from_std<CRoad>(src,segment);
+ */
+#define MMO_SCHEMA(Class,...)                                                                     \
+public:                                                                                           \
+  auto  mmo_fields() -> decltype(std::tie(__VA_ARGS__)){return std::tie(__VA_ARGS__);}            \
+  auto  mmo_fields()const -> decltype(std::tie(__VA_ARGS__)){return std::tie(__VA_ARGS__);}       \
+  static const char*  mmo_field_names(){return #__VA_ARGS__;}                                     \
+  void  mmo_copy(const Class& src,mmo::copier& copy){mmo::schema_copy(*this,src,copy);}
+
+namespace mmo
+{
+
+/**
+ * @brief 检测类型是否用 MMO_SCHEMA 声明了成员
+ */
+template<typename T>
+class has_mmo_schema
+{
+  template<typename U>
+  static auto test(int) -> decltype(std::declval<U&>().mmo_fields(),std::true_type());
+  template<typename U>
+  static std::false_type test(...);
+public:
+  enum { value = decltype(test<T>(0))::value };
+};
+
+/**
+ * @brief 按下标在编译期展开：依次调用 f(std::integral_constant<size_t,I>())
+ */
+template<typename Function,size_t... I>
+void  schema_for_each_index(Function&& f,std::index_sequence<I...>)
+{
+  int expand[] = {0,((void)f(std::integral_constant<size_t,I>()),0)...};
+  (void)expand;
+}
+
+/**
+ * @brief 每种可映射类型对应的标准库类型，及两者之间的转换
+ *        默认：纯数据类型（整数、MMO_PLAIN_DATA 声明的 Point2D 等），标准类型就是它自己
+ */
+template<typename T,typename Enable = void>
+struct schema_traits
+{
+  static_assert(is_plain_data<T>::value,"mmo::schema_traits: type is not supported, declare it with MMO_PLAIN_DATA or declare its members with MMO_SCHEMA");
+  typedef T std_type;
+  static void from_std(T& dst,const std_type& src,segment_manager&){dst = src;}
+  static void to_std(const T& src,std_type& dst){dst = src;}
+};
+
+template<typename T>
+using std_type = typename schema_traits<T>::std_type;
+
+/**
+ * @brief mmo::string <-> std::string
+ */
+template<typename SizeType>
+struct schema_traits<string<SizeType>>
+{
+  typedef std::string std_type;
+  static void from_std(string<SizeType>& dst,const std_type& src,segment_manager& segment){dst.assign(src,segment);}
+  static void to_std(const string<SizeType>& src,std_type& dst){src.to_std(dst);}
+};
+
+/**
+ * @brief mmo::vector <-> std::vector，元素可平凡拷贝时整体拷贝
+ */
+template<typename ValueType,typename SizeType>
+struct schema_traits<vector<ValueType,SizeType>>
+{
+  typedef std::vector<mmo::std_type<ValueType>> std_type;
+  static void from_std(vector<ValueType,SizeType>& dst,const std_type& src,segment_manager& segment)
+  {
+    _from_std(dst,src,segment,std::integral_constant<bool,std::is_same<ValueType,mmo::std_type<ValueType>>::value>());
+  }
+  static void to_std(const vector<ValueType,SizeType>& src,std_type& dst)
+  {
+    dst.resize(src.size());
+    for(SizeType i = 0;i < src.size();i++)
+      schema_traits<ValueType>::to_std(src[i],dst[i]);
+  }
+  static void _from_std(vector<ValueType,SizeType>& dst,const std_type& src,segment_manager& segment,std::true_type)
+  {
+    dst.assign(src,segment);
+  }
+  static void _from_std(vector<ValueType,SizeType>& dst,const std_type& src,segment_manager& segment,std::false_type)
+  {
+    dst.resize((SizeType)src.size(),segment);
+    for(size_t i = 0;i < src.size();i++)
+      schema_traits<ValueType>::from_std(dst[(SizeType)i],src[i],segment);
+  }
+};
+
+/**
+ * @brief mmo::var_vector / indexed_var_vector <-> std::vector，indexed_var_vector 构造后建立下标索引
+ */
+template<typename ValueType,typename SizeType>
+struct schema_traits<var_vector<ValueType,SizeType>>
+{
+  typedef std::vector<mmo::std_type<ValueType>> std_type;
+  static void from_std(var_vector<ValueType,SizeType>& dst,const std_type& src,segment_manager& segment)
+  {
+    dst.prepare_append_elements(segment);
+    for(auto& it:src)
+    {
+      auto element = dst.begin_append_element(segment);
+      schema_traits<ValueType>::from_std(element->object(),it,segment);
+      dst.end_append_element(element,segment);
+    }
+  }
+  static void to_std(const var_vector<ValueType,SizeType>& src,std_type& dst)
+  {
+    dst.clear();
+    for(auto it = src.begin();it != src.end();++it)
+    {
+      dst.emplace_back();
+      schema_traits<ValueType>::to_std(*it,dst.back());
+    }
+  }
+};
+template<typename ValueType,typename SizeType>
+struct schema_traits<indexed_var_vector<ValueType,SizeType>>
+{
+  typedef std::vector<mmo::std_type<ValueType>> std_type;
+  static void from_std(indexed_var_vector<ValueType,SizeType>& dst,const std_type& src,segment_manager& segment)
+  {
+    schema_traits<var_vector<ValueType,SizeType>>::from_std(dst,src,segment);
+    dst.finish_append_elements(segment);
+  }
+  static void to_std(const indexed_var_vector<ValueType,SizeType>& src,std_type& dst)
+  {
+    schema_traits<var_vector<ValueType,SizeType>>::to_std(src,dst);
+  }
+};
+
+/**
+ * @brief mmo::hash_map <-> std::vector<std::pair<键,值>>，按 hash_map 的遍历顺序
+ */
+template<typename KeyType,typename ValueType,typename SizeType>
+struct schema_traits<hash_map<KeyType,ValueType,SizeType>>
+{
+  typedef std::vector<std::pair<KeyType,mmo::std_type<ValueType>>> std_type;
+  static void from_std(hash_map<KeyType,ValueType,SizeType>& dst,const std_type& src,segment_manager& segment)
+  {
+    if(src.empty())
+      return;
+    dst.init_hash((SizeType)src.size(),segment);
+    for(auto& it:src)
+    {
+      //值可能是偏移指针等不能经栈中转的类型，先插入默认值再原地构造
+      auto ret = dst.insert(it.first,ValueType(),segment);
+      if(ret.pvalue != NULL)
+        schema_traits<ValueType>::from_std(ret.pvalue->value,it.second,segment);
+    }
+  }
+  static void to_std(const hash_map<KeyType,ValueType,SizeType>& src,std_type& dst)
+  {
+    dst.clear();
+    for(auto it = src.begin();it != src.end();++it)
+    {
+      dst.emplace_back();
+      dst.back().first = it.node->key;
+      schema_traits<ValueType>::to_std(it.node->value,dst.back().second);
+    }
+  }
+};
+
+/**
+ * @brief mmo::offset_ptr <-> std::shared_ptr，空指针对应空指针
+ */
+template<typename ValueType,typename OffsetType>
+struct schema_traits<offset_ptr<ValueType,OffsetType>>
+{
+  typedef std::shared_ptr<mmo::std_type<ValueType>> std_type;
+  static void from_std(offset_ptr<ValueType,OffsetType>& dst,const std_type& src,segment_manager& segment)
+  {
+    if(!src)
+    {
+      dst = (ValueType*)NULL;
+      return;
+    }
+    ValueType* object = construct<ValueType>(segment);
+    schema_traits<ValueType>::from_std(*object,*src,segment);
+    dst = object;
+  }
+  static void to_std(const offset_ptr<ValueType,OffsetType>& src,std_type& dst)
+  {
+    dst.reset();
+    if(src.get() == NULL)
+      return;
+    dst = std::make_shared<mmo::std_type<ValueType>>();
+    schema_traits<ValueType>::to_std(*src.get(),*dst);
+  }
+};
+
+/**
+ * @brief mmo::delta_vector <-> std::vector
+ */
+template<typename PointType,typename SizeType>
+struct schema_traits<delta_vector<PointType,SizeType>>
+{
+  typedef std::vector<PointType> std_type;
+  static void from_std(delta_vector<PointType,SizeType>& dst,const std_type& src,segment_manager& segment){dst.assign(src,segment);}
+  static void to_std(const delta_vector<PointType,SizeType>& src,std_type& dst){src.to_std(dst);}
+};
+
+/**
+ * @brief 成员引用 tuple -> 各成员标准类型组成的 tuple
+ */
+template<typename Fields>
+struct schema_std_tuple;
+template<typename... Fields>
+struct schema_std_tuple<std::tuple<Fields...>>
+{
+  typedef std::tuple<mmo::std_type<typename std::decay<Fields>::type>...> type;
+};
+
+/**
+ * @brief 用 MMO_SCHEMA 声明的类 <-> 各成员标准类型组成的 std::tuple，顺序与声明一致
+ */
+template<typename T>
+struct schema_traits<T,typename std::enable_if<has_mmo_schema<T>::value>::type>
+{
+  typedef decltype(std::declval<T&>().mmo_fields())       FieldsType;
+  typedef typename schema_std_tuple<FieldsType>::type     std_type;
+  typedef std::make_index_sequence<std::tuple_size<FieldsType>::value> IndexType;
+
+  static void from_std(T& dst,const std_type& src,segment_manager& segment)
+  {
+    auto fields = dst.mmo_fields();
+    schema_for_each_index([&](auto i)
+    {
+      auto& field = std::get<decltype(i)::value>(fields);
+      schema_traits<typename std::decay<decltype(field)>::type>::from_std(field,std::get<decltype(i)::value>(src),segment);
+    },IndexType());
+  }
+  static void to_std(const T& src,std_type& dst)
+  {
+    auto fields = src.mmo_fields();
+    schema_for_each_index([&](auto i)
+    {
+      auto& field = std::get<decltype(i)::value>(fields);
+      schema_traits<typename std::decay<decltype(field)>::type>::to_std(field,std::get<decltype(i)::value>(dst));
+    },IndexType());
+  }
+};
+
+/**
+ * @brief 由标准库类型构造，dst 须位于 segment 中且为默认构造状态
+ */
+template<typename T>
+void  from_std(T& dst,const std_type<T>& src,segment_manager& segment)
+{
+  schema_traits<T>::from_std(dst,src,segment);
+}
+
+/**
+ * @brief 在 segment 中构造一个 T 并由标准库类型初始化
+ */
+template<typename T>
+T*    build_from_std(const std_type<T>& src,segment_manager& segment)
+{
+  T* dst = construct<T>(segment);
+  schema_traits<T>::from_std(*dst,src,segment);
+  return dst;
+}
+
+/**
+ * @brief 转换为标准库类型，可用于调试输出、比较、导出
+ */
+template<typename T>
+void  to_std(const T& src,std_type<T>& dst)
+{
+  schema_traits<T>::to_std(src,dst);
+}
+template<typename T>
+std_type<T>   to_std(const T& src)
+{
+  std_type<T> dst;
+  schema_traits<T>::to_std(src,dst);
+  return dst;
+}
+
+/**
+ * @brief build_from_std 所需的精确字节数（含对齐），在测量段中试运行同一构造过程得到
+ */
+template<typename T>
+size_t  predict_bytes(const std_type<T>& src)
+{
+  return measure([&](segment_manager& segment)
+  {
+    build_from_std<T>(src,segment);
+  });
+}
+
+/**
+ * @brief MMO_SCHEMA 声明的成员名，下标与 mmo_fields() 一致
+ */
+template<typename T>
+const std::vector<std::string>& schema_field_names()
+{
+  static const std::vector<std::string> s_names = []()
+  {
+    std::vector<std::string> names;
+    std::string name;
+    for(const char* p = T::mmo_field_names();;p++)
+    {
+      if(*p == ',' || *p == 0)
+      {
+        names.push_back(name);
+        name.clear();
+        if(*p == 0)
+          break;
+      }
+      else if(*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+        name += *p;
+    }
+    return names;
+  }();
+  return s_names;
+}
+
+/**
+ * @brief 依次访问 MMO_SCHEMA 声明的每个成员，按成员的实际类型在编译期分派
+ *
+ * @param visit 可调用对象：void(const std::string& name,Field& field)，通常为泛型 lambda
+ */
+template<typename T,typename Visitor>
+void  visit_fields(T& object,Visitor&& visit)
+{
+  typedef typename std::remove_const<T>::type ObjectType;
+  auto& names   = schema_field_names<ObjectType>();
+  auto  fields  = object.mmo_fields();
+  schema_for_each_index([&](auto i)
+  {
+    visit(names[decltype(i)::value],std::get<decltype(i)::value>(fields));
+  },std::make_index_sequence<std::tuple_size<decltype(fields)>::value>());
+}
+
+/**
+ * @brief MMO_SCHEMA 生成的深拷贝钩子：逐个成员交给 copier
+ */
+template<typename T>
+void  schema_copy(T& dst,const T& src,copier& copy)
+{
+  auto to   = dst.mmo_fields();
+  auto from = src.mmo_fields();
+  schema_for_each_index([&](auto i)
+  {
+    copy(std::get<decltype(i)::value>(to),std::get<decltype(i)::value>(from));
+  },std::make_index_sequence<std::tuple_size<decltype(to)>::value>());
+}
+
+}//end namespace mmo
@@ -0,0 +1,382 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_segment.h
+*           复杂对象--线性映射库--可增长内存段
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include <vector>
+#include <atomic>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace mmo
+{
+
+/**
+ * @brief 可增长的内存段
+ *        预留一段连续的虚拟地址空间，按块按需提交物理内存。
+ *        容器内部全部是相对偏移寻址，要求对象所在空间连续且地址不变，
+ *        因此这里不是把多个独立的 malloc 块串起来，而是在同一段预留地址上逐块提交，
+ *        既不需要预先按最坏情况分配缓冲区，构造完成后也天然是一块连续镜像。
+ */
+class growable_segment:
+  public segment_manager
+{
+public:
+  enum
+  {
+    default_reserve_size  = 1UL << 30,  //默认预留 1G 地址空间，只占虚拟地址，不占物理内存
+    default_block_size    = 64 * 1024,
+  };
+protected:
+  size_t      m_reserved{0};
+  size_t      m_block_size{0};
+  bool        m_sealed{false};
+public:
+  /**
+   * @brief 构造可增长内存段
+   *
+   * @param reserve_size 最大可增长到的字节数
+   * @param block_size   每次提交的块大小，会按页大小取整
+   */
+  growable_segment(size_t reserve_size = default_reserve_size,size_t block_size = default_block_size)
+  {
+    size_t page   = page_size();
+    m_block_size  = round_up(block_size == 0 ? page : block_size,page);
+    m_reserved    = round_up(reserve_size,m_block_size);
+
+    void* p = ::mmap(NULL,m_reserved,PROT_NONE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE,-1,0);
+    if(p == MAP_FAILED)
+    {
+      m_reserved = 0;
+      throw mmo_exception((int32_t)mmo_exception::no_enough_memory,"mmo_exception:: reserve address space failed,size:" + std::to_string(reserve_size));
+    }
+    m_buffer    = (char*)p;
+    m_current   = m_buffer;
+    m_end       = m_buffer;
+    m_capacity  = 0;
+  }
+  growable_segment(const growable_segment&) = delete;
+  growable_segment& operator=(const growable_segment&) = delete;
+  ~growable_segment()
+  {
+    if(m_buffer != nullptr)
+      ::munmap(m_buffer,m_reserved);
+  }
+private:
+  //地址空间由本对象管理，不允许外部替换缓冲区
+  using segment_manager::reset;
+public:
+  size_t    reserved()const{return m_reserved;}
+  size_t    block_size()const{return m_block_size;}
+  size_t    block_count()const{return round_up(m_capacity,m_block_size) / m_block_size;}
+  bool      sealed()const{return m_sealed;}
+public:
+  /**
+   * @brief 封存内存段：释放已提交但未使用的尾部块，之后不再增长
+   *        封存后 data()/size() 即为一块连续的完整镜像
+   *
+   * @return size_t 镜像字节数
+   */
+  size_t    seal()
+  {
+    size_t used = round_up(size(),page_size());
+    if(used < m_capacity)
+    {
+      ::madvise(m_buffer + used,m_capacity - used,MADV_DONTNEED);
+      ::mprotect(m_buffer + used,m_capacity - used,PROT_NONE);
+      m_capacity = used;
+    }
+    m_end     = m_current;
+    m_sealed  = true;
+    return size();
+  }
+  /**
+   * @brief 按提交块切分镜像，得到分散列表，便于 writev 等分块发送/写盘
+   *
+   * @param blocks 输出：每块一个 iovec，最后一块只包含已使用部分
+   */
+  void      scatter(std::vector<struct iovec>& blocks)const
+  {
+    blocks.clear();
+    size_t total = size();
+    for(size_t pos = 0;pos < total;pos += m_block_size)
+    {
+      struct iovec v;
+      v.iov_base  = m_buffer + pos;
+      v.iov_len   = (total - pos) < m_block_size ? (total - pos) : m_block_size;
+      blocks.push_back(v);
+    }
+  }
+  /**
+   * @brief 清空内存段以便复用，已提交的块默认保留，避免反复缺页
+   *
+   * @param release_memory 为 true 时归还全部物理内存
+   */
+  void      clear(bool release_memory = false)
+  {
+    if(release_memory && m_capacity > 0)
+    {
+      ::madvise(m_buffer,m_capacity,MADV_DONTNEED);
+      ::mprotect(m_buffer,m_capacity,PROT_NONE);
+      m_capacity = 0;
+    }
+    m_current = m_buffer;
+    m_end     = m_buffer + m_capacity;
+    m_sealed  = false;
+  }
+protected:
+  bool      grow(size_t size) override
+  {
+    if(m_sealed)
+      return false;
+    size_t need = (size_t)(m_current - m_buffer) + size;
+    if(need > m_reserved)
+      return false;
+    size_t capacity = round_up(need,m_block_size);
+    if(capacity > m_reserved)
+      capacity = m_reserved;
+    if(::mprotect(m_buffer + m_capacity,capacity - m_capacity,PROT_READ|PROT_WRITE) != 0)
+      return false;
+    m_capacity  = capacity;
+    m_end       = m_buffer + m_capacity;
+    return true;
+  }
+protected:
+  static size_t page_size()
+  {
+    static const size_t s_page = (size_t)::sysconf(_SC_PAGESIZE);
+    return s_page;
+  }
+  static size_t round_up(size_t value,size_t unit)
+  {
+    return (value + unit - 1) / unit * unit;
+  }
+};
+
+/**
+ * @brief 测量内存段：与正式构造走完全相同的 init(...) 代码路径，只统计最终镜像的字节数
+ *        对象头、hash 桶表等构造过程需要回读的部分照常写入，
+ *        字串、数组等负载内容由容器跳过写入，对应的页从未被触碰，不占物理内存。
+ *        典型用法是两遍构造：先测量，再按精确大小一次性分配缓冲区正式构造。
+ */
+class measure_segment:
+  public growable_segment
+{
+public:
+  measure_segment(size_t reserve_size = default_reserve_size,size_t block_size = default_block_size):
+    growable_segment(reserve_size,block_size)
+  {
+    m_measuring = true;
+  }
+public:
+  /**
+   * @brief 清空以便复用：已用范围的页同时归还，下一次测量从全零的内存开始，
+   *        不会读到上一次构造残留的对象头（负载不写入，实际归还的只有对象头所在的少量页）
+   */
+  void      clear()
+  {
+    size_t used = round_up(size(),page_size());
+    if(used > m_capacity)
+      used = m_capacity;
+    if(used != 0)
+      ::madvise(m_buffer,used,MADV_DONTNEED);
+    growable_segment::clear();
+  }
+public:
+  /**
+   * @brief 当前线程复用的测量段，避免每次请求都重新预留地址空间
+   */
+  static measure_segment& local()
+  {
+    static thread_local measure_segment s_segment;
+    return s_segment;
+  }
+};
+
+/**
+ * @brief 试运行一遍构造过程，返回所需的精确字节数
+ * 
+ * @tparam Builder  可调用对象：void(segment_manager&)，内部执行与正式构造相同的 construct/init
+ * @param build 
+ * @return size_t 
+ */
+template<typename Builder>
+size_t measure(Builder&& build)
+{
+  measure_segment& segment = measure_segment::local();
+  segment.clear();
+  build((segment_manager&)segment);
+  size_t bytes = segment.size();
+  segment.clear();
+  return bytes;
+}
+
+/**
+ * @brief 多线程共享的内存段：一块连续缓冲区，分配位置用原子操作推进，无锁
+ *        各线程通过自己的 view 分配：view 每次从共享段批量取一块（TLAB），
+ *        块内分配与普通 segment_manager 完全相同、不需任何同步，只有取块时才访问共享的分配位置。
+ *        view 的块恰好位于共享段末尾时直接原地延长，否则另取新块，旧块剩余部分作废（计入 wasted()）。
+ *        注意：
+ *          1. 不同线程的对象交错存放，镜像内容与线程调度有关，不保证每次构造逐字节相同；
+ *          2. 连续性只在块内成立，var_vector 的全部元素必须连续，追加前先 view.reserve(字节数)，
+ *             字节数可用 measure() 得到；或改用 parallel_append_elements；
+ *          3. 作废的块尾与归还失败的空间会留在镜像中，内容为缓冲区原有内容。
+ *
+ *   mmo::concurrent_segment arena(buf.data(),buf.size());
+ *   //每个线程：
+ *   mmo::concurrent_segment::view segment(arena);
+ *   auto* s = mmo::construct<mmo::string<int32_t>>(segment);
+ *   s->assign(name,segment);
+ *   //全部线程结束后：
+ *   mmo::save_image("1.dat",arena.image(),root);
+ */
+class concurrent_segment
+{
+public:
+  enum
+  {
+    default_chunk_size    = 64 * 1024,
+  };
+  /**
+   * @brief 单个线程使用的分配视图，不能跨线程共享
+   */
+  class view:
+    public segment_manager
+  {
+  protected:
+    concurrent_segment*   m_owner{nullptr};
+  public:
+    view(concurrent_segment& owner)
+    {
+      m_owner     = &owner;
+      m_buffer    = owner.m_buffer;
+      m_capacity  = owner.m_capacity;
+      m_current   = m_buffer;
+      m_end       = m_buffer;
+    }
+    view(const view&) = delete;
+    view& operator=(const view&) = delete;
+    ~view()
+    {
+      release();
+    }
+  private:
+    using segment_manager::reset;
+  public:
+    /**
+     * @brief 归还当前块未用的尾部（仅当它仍位于共享段末尾时才能归还）
+     */
+    void    release()
+    {
+      if(m_end != m_current)
+        m_owner->_give_back(m_current,m_end);
+      m_end = m_current;
+    }
+  protected:
+    bool    grow(size_t size) override
+    {
+      size_t  chunk = (size > m_owner->m_chunk_size) ? size : m_owner->m_chunk_size;
+      size_t  need  = size - (size_t)(m_end - m_current);
+      size_t  step  = (need > m_owner->m_chunk_size) ? need : m_owner->m_chunk_size;
+      //块在共享段末尾：原地延长，已分配内容与本次分配保持连续
+      if(m_owner->_extend(m_end,step) || m_owner->_extend(m_end,step = need))
+      {
+        m_end += step;
+        return true;
+      }
+      char*   p     = m_owner->alloc(chunk);
+      if(p == NULL && chunk > size)
+      {
+        chunk = size;
+        p     = m_owner->alloc(chunk);
+      }
+      if(p == NULL)
+        return false;
+      m_owner->m_wasted += (size_t)(m_end - m_current);
+      m_current = p;
+      m_end     = p + chunk;
+      return true;
+    }
+  };
+protected:
+  char*                 m_buffer{nullptr};
+  size_t                m_capacity{0};
+  size_t                m_chunk_size{0};
+  std::atomic<size_t>   m_used{0};
+  std::atomic<size_t>   m_wasted{0};
+public:
+  /**
+   * @param buffer      共享的缓冲区
+   * @param capacity    缓冲区字节数
+   * @param chunk_size  view 每次取块的大小，越大取块竞争越少，作废的块尾可能越多
+   */
+  concurrent_segment(char* buffer,size_t capacity,size_t chunk_size = default_chunk_size)
+  {
+    m_buffer      = buffer;
+    m_capacity    = capacity;
+    m_chunk_size  = (chunk_size == 0) ? 1 : chunk_size;
+  }
+  concurrent_segment(const concurrent_segment&) = delete;
+  concurrent_segment& operator=(const concurrent_segment&) = delete;
+public:
+  /**
+   * @brief 线程安全的直接分配，不经过 view，适合根对象等零散分配
+   */
+  char*       alloc(size_t size)
+  {
+    size_t used = m_used.load(std::memory_order_relaxed);
+    do
+    {
+      if(size > m_capacity - used)
+        return NULL;
+    }while(!m_used.compare_exchange_weak(used,used + size,std::memory_order_relaxed));
+    return m_buffer + used;
+  }
+  const char* data()const{return m_buffer;}
+  size_t      capacity()const{return m_capacity;}
+  size_t      chunk_size()const{return m_chunk_size;}
+  /**
+   * @brief 已分配出去的字节数，即镜像大小（含各 view 尚未用完的块）
+   */
+  size_t      size()const{return m_used.load(std::memory_order_acquire);}
+  /**
+   * @brief 换块时作废的块尾字节数
+   */
+  size_t      wasted()const{return m_wasted.load(std::memory_order_relaxed);}
+  /**
+   * @brief 全部 view 释放后，以普通内存段的形式给出完整镜像，可直接用于 save_image 等
+   */
+  segment_manager image()const
+  {
+    segment_manager segment(m_buffer,m_capacity);
+    segment.advance(size());
+    return segment;
+  }
+protected:
+  /**
+   * @brief end 恰为共享段末尾时，把末尾再推进 size 字节
+   */
+  bool        _extend(char* end,size_t size)
+  {
+    size_t used = (size_t)(end - m_buffer);
+    if(size > m_capacity - used)
+      return false;
+    return m_used.compare_exchange_strong(used,used + size,std::memory_order_relaxed);
+  }
+  /**
+   * @brief [begin,end) 恰为共享段末尾时，把它归还
+   */
+  void        _give_back(char* begin,char* end)
+  {
+    size_t used = (size_t)(end - m_buffer);
+    if(!m_used.compare_exchange_strong(used,(size_t)(begin - m_buffer),std::memory_order_relaxed))
+      m_wasted += (size_t)(end - begin);
+  }
+};
+
+}//end namespace mmo
@@ -0,0 +1,490 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_shm.h
+*           复杂对象--线性映射库--共享内存快照发布与订阅
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include "mmo_segment.h"
+#include "mmo_image.h"
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace mmo
+{
+
+/**
+ * @brief 共享内存控制区，多进程共享，只包含无锁原子量
+ *        每个快照单独放在一个 POSIX 共享内存对象 "<name>.<version>" 中，
+ *        控制区记录当前版本所在的槽位，以及每个槽位上正在读的进程数。
+ */
+struct shm_control
+{
+  enum
+  {
+    control_magic = 0x43484D4D,  // "MMHC"
+    slot_count    = 16,
+  };
+  enum
+  {
+    slot_free     = 0,
+    slot_building = 1,
+    slot_live     = 2,
+    slot_retired  = 3,
+    slot_reclaim  = 4,
+  };
+  struct slot
+  {
+    std::atomic<uint64_t>   version;
+    std::atomic<int32_t>    readers;
+    std::atomic<int32_t>    state;
+  };
+  std::atomic<uint32_t>     magic;
+  std::atomic<uint64_t>     last_version;
+  std::atomic<uint64_t>     current;   //(version << 8) | slot，0 表示尚未发布
+  slot                      slots[slot_count];
+public:
+  static uint64_t make_current(uint64_t version,uint32_t index){return (version << 8) | index;}
+  static uint64_t current_version(uint64_t current){return current >> 8;}
+  static uint32_t current_slot(uint64_t current){return (uint32_t)(current & 0xFF);}
+  static std::string snapshot_name(const std::string& name,uint64_t version){return name + "." + std::to_string(version);}
+  /**
+   * @brief 回收一个已退役且无人读取的槽位，发布者与最后离开的读者都可能调用，由状态 CAS 保证只回收一次
+   *        /dev/shm 带粘滞位，只有属主能删除快照；读者与发布者用户不同时删除失败，
+   *        槽位退回退役状态，留给发布者下次 publish/reclaim 时回收
+   */
+  void    reclaim(const std::string& name,uint32_t index)
+  {
+    slot& s = slots[index];
+    int32_t expected = slot_retired;
+    if(s.readers.load() != 0 || !s.state.compare_exchange_strong(expected,(int32_t)slot_reclaim))
+      return;
+    if(s.readers.load() != 0)
+    {
+      s.state.store(slot_retired);
+      return;
+    }
+    if(::shm_unlink(snapshot_name(name,s.version.load()).c_str()) != 0 && (errno == EPERM || errno == EACCES))
+    {
+      s.state.store(slot_retired);
+      return;
+    }
+    s.state.store(slot_free);
+  }
+};
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+  "shm_control requires address-free lock-free atomics");
+
+/**
+ * @brief 新建共享内存对象，权限按 mode 设置，不受 umask 影响
+ *
+ * @return int 文件描述符；对象已存在时返回 -1 且 errno 为 EEXIST
+ */
+inline int create_shm_object(const std::string& name,mode_t mode)
+{
+  int fd = ::shm_open(name.c_str(),O_RDWR|O_CREAT|O_EXCL,mode);
+  if(fd >= 0 && ::fchmod(fd,mode) != 0)
+  {
+    ::close(fd);
+    ::shm_unlink(name.c_str());
+    throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: fchmod shm failed:" + name);
+  }
+  return fd;
+}
+
+/**
+ * @brief 打开或创建控制区并映射
+ *        订阅者以读写方式打开控制区（登记读者数），所以 mode 需给订阅者所在的用户或组写权限
+ */
+inline shm_control* open_shm_control(const std::string& name,bool create,mode_t mode = 0660)
+{
+  int fd = create ? create_shm_object(name,mode) : -1;
+  if(fd < 0 && (!create || errno == EEXIST))
+    fd = ::shm_open(name.c_str(),O_RDWR,0);
+  if(fd < 0)
+    throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: shm_open failed:" + name);
+  if(create && ::ftruncate(fd,sizeof(shm_control)) != 0)
+  {
+    ::close(fd);
+    throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: ftruncate failed:" + name);
+  }
+  struct stat st;
+  if(::fstat(fd,&st) != 0 || (size_t)st.st_size < sizeof(shm_control))
+  {
+    ::close(fd);
+    throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: invalid shm control:" + name);
+  }
+  void* p = ::mmap(NULL,sizeof(shm_control),PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+  ::close(fd);
+  if(p == MAP_FAILED)
+    throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: mmap shm failed:" + name);
+  shm_control* control = (shm_control*)p;
+  //新建的共享内存全为 0，正好是所有原子量的初始状态，只需写入魔数
+  uint32_t expected = 0;
+  control->magic.compare_exchange_strong(expected,(uint32_t)shm_control::control_magic);
+  if(control->magic.load() != (uint32_t)shm_control::control_magic)
+  {
+    ::munmap(p,sizeof(shm_control));
+    throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: invalid shm control:" + name);
+  }
+  return control;
+}
+
+/**
+ * @brief 快照发布者：在新的共享内存对象中构造快照，再原子地切换当前版本
+ *        同一名字同一时刻只允许一个发布者。
+ *        旧版本在最后一个读者离开后回收；若读者进程异常退出未释放，对应槽位将一直保留。
+ *        默认权限 0660：订阅者需与发布者同用户或同组；任意用户都可订阅时传入 0666。
+ */
+class shm_publisher
+{
+protected:
+  std::string     m_name;
+  shm_control*    m_control{nullptr};
+  mode_t          m_mode{0660};
+public:
+  /**
+   * @param name 共享内存名字，需以 '/' 开头，例如 "/road_map"
+   * @param mode 控制区与快照的权限；控制区已存在时沿用其原有权限
+   */
+  explicit shm_publisher(const std::string& name,mode_t mode = 0660):
+    m_name(name),
+    m_mode(mode)
+  {
+    m_control = open_shm_control(m_name,true,m_mode);
+  }
+  shm_publisher(const shm_publisher&) = delete;
+  shm_publisher& operator=(const shm_publisher&) = delete;
+  ~shm_publisher()
+  {
+    if(m_control != nullptr)
+      ::munmap(m_control,sizeof(shm_control));
+  }
+public:
+  /**
+   * @brief 构造并发布一个新快照
+   *        先用测量段试运行得到精确大小，再在共享内存中原地构造，不产生额外拷贝
+   *
+   * @tparam Builder  可调用对象：const void* (segment_manager&)，返回根对象地址
+   * @param build
+   * @param layout_version 写入镜像头的布局版本
+   * @return uint64_t 新快照的版本号
+   */
+  template<typename Builder>
+  uint64_t  publish(Builder&& build,uint32_t layout_version = 0)
+  {
+    reclaim();
+    uint32_t index = acquire_slot();
+    shm_control::slot& s = m_control->slots[index];
+    uint64_t version = m_control->last_version.fetch_add(1) + 1;
+    s.version.store(version);
+
+    std::string snapshot = shm_control::snapshot_name(m_name,version);
+    char*   map       = nullptr;
+    size_t  map_size  = 0;
+    try
+    {
+      size_t bytes = measure(build);
+      map_size = sizeof(image_header) + bytes;
+      map      = create_snapshot(snapshot,map_size,m_mode);
+
+      segment_manager segment(map + sizeof(image_header),bytes);
+      const void* root = build(segment);
+
+      image_header* header  = ::new((void*)map)image_header();
+      header->layout_version= layout_version;
+      header->root_offset   = (const char*)root - segment.data();
+      header->image_size    = segment.size();
+      ::munmap(map,map_size);
+    }
+    catch(...)
+    {
+      if(map != nullptr)
+        ::munmap(map,map_size);
+      ::shm_unlink(snapshot.c_str());
+      s.state.store(shm_control::slot_free);
+      throw;
+    }
+
+    s.state.store(shm_control::slot_live);
+    uint64_t old = m_control->current.exchange(shm_control::make_current(version,index));
+    if(old != 0)
+    {
+      uint32_t old_index = shm_control::current_slot(old);
+      m_control->slots[old_index].state.store(shm_control::slot_retired);
+      m_control->reclaim(m_name,old_index);
+    }
+    return version;
+  }
+  /**
+   * @brief 回收所有已退役且无读者的旧版本
+   */
+  void      reclaim()
+  {
+    for(uint32_t i = 0;i < shm_control::slot_count;i++)
+      m_control->reclaim(m_name,i);
+  }
+  uint64_t  current_version()const
+  {
+    return shm_control::current_version(m_control->current.load());
+  }
+  /**
+   * @brief 删除控制区和所有快照，仅在整个服务下线时使用
+   */
+  static void remove(const std::string& name)
+  {
+    try
+    {
+      shm_control* control = open_shm_control(name,false);
+      for(uint32_t i = 0;i < shm_control::slot_count;i++)
+      {
+        if(control->slots[i].state.load() != shm_control::slot_free)
+          ::shm_unlink(shm_control::snapshot_name(name,control->slots[i].version.load()).c_str());
+      }
+      ::munmap(control,sizeof(shm_control));
+    }
+    catch(const mmo_exception&)
+    {
+    }
+    ::shm_unlink(name.c_str());
+  }
+protected:
+  uint32_t  acquire_slot()
+  {
+    for(uint32_t i = 0;i < shm_control::slot_count;i++)
+    {
+      int32_t expected = shm_control::slot_free;
+      if(m_control->slots[i].state.compare_exchange_strong(expected,(int32_t)shm_control::slot_building))
+        return i;
+    }
+    throw mmo_exception((int32_t)mmo_exception::no_enough_memory,"mmo_exception:: no free shm snapshot slot,readers still hold old versions!");
+  }
+  static char* create_snapshot(const std::string& snapshot,size_t size,mode_t mode)
+  {
+    ::shm_unlink(snapshot.c_str());  //清理上次异常退出残留的同名对象
+    int fd = create_shm_object(snapshot,mode);
+    if(fd < 0)
+      throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: shm_open failed:" + snapshot);
+    if(::ftruncate(fd,size) != 0)
+    {
+      ::close(fd);
+      throw mmo_exception((int32_t)mmo_exception::no_enough_memory,"mmo_exception:: ftruncate failed:" + snapshot);
+    }
+    void* p = ::mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+    ::close(fd);
+    if(p == MAP_FAILED)
+      throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: mmap shm failed:" + snapshot);
+    return (char*)p;
+  }
+};
+
+class shm_subscriber;
+
+/**
+ * @brief 读者持有的快照句柄，持有期间该版本不会被回收
+ */
+class shm_snapshot
+{
+  friend class shm_subscriber;
+protected:
+  shm_subscriber*       m_owner{nullptr};
+  uint32_t              m_slot{0};
+  uint64_t              m_version{0};
+  const image_header*   m_header{nullptr};
+public:
+  shm_snapshot(){}
+  shm_snapshot(const shm_snapshot&) = delete;
+  shm_snapshot& operator=(const shm_snapshot&) = delete;
+  shm_snapshot(shm_snapshot&& other){swap(other);}
+  shm_snapshot& operator=(shm_snapshot&& other)
+  {
+    release();
+    swap(other);
+    return *this;
+  }
+  ~shm_snapshot(){release();}
+public:
+  inline void         release();
+  bool                valid()const{return m_header != nullptr;}
+  uint64_t            version()const{return m_version;}
+  const image_header& header()const{return *m_header;}
+  const char*         data()const{return m_header->data();}
+  size_t              size()const{return m_header->image_size;}
+  template<typename T>
+  const T*            root()const
+  {
+    return (const T*)(data() + m_header->root_offset);
+  }
+protected:
+  void  swap(shm_snapshot& other)
+  {
+    std::swap(m_owner,other.m_owner);
+    std::swap(m_slot,other.m_slot);
+    std::swap(m_version,other.m_version);
+    std::swap(m_header,other.m_header);
+  }
+};
+
+/**
+ * @brief 快照订阅者：每个读进程一个，获取当前版本时不加锁、不等待发布者
+ *        同一版本只映射一次，本进程内的多个句柄共享该映射
+ *        非线程安全：映射表与引用计数不加锁，acquire() 与句柄的释放都须在同一线程，
+ *        或由调用者加锁；多线程读取时也可以每个线程各建一个订阅者。
+ */
+class shm_subscriber
+{
+  friend class shm_snapshot;
+protected:
+  struct view
+  {
+    uint64_t    version{0};
+    char*       map{nullptr};
+    size_t      map_size{0};
+    int32_t     refs{0};
+  };
+  std::string         m_name;
+  shm_control*        m_control{nullptr};
+  std::vector<view>   m_views;
+public:
+  explicit shm_subscriber(const std::string& name):
+    m_name(name)
+  {
+    m_control = open_shm_control(m_name,false);
+  }
+  shm_subscriber(const shm_subscriber&) = delete;
+  shm_subscriber& operator=(const shm_subscriber&) = delete;
+  ~shm_subscriber()
+  {
+    for(auto& v:m_views)
+      ::munmap(v.map,v.map_size);
+    if(m_control != nullptr)
+      ::munmap(m_control,sizeof(shm_control));
+  }
+public:
+  /**
+   * @brief 获取当前版本的快照；尚未发布时返回无效句柄
+   */
+  shm_snapshot  acquire(uint32_t layout_version = 0)
+  {
+    shm_snapshot snapshot;
+    uint64_t current = 0;
+    for(;;)
+    {
+      current = m_control->current.load();
+      if(current == 0)
+        return snapshot;
+      shm_control::slot& s = m_control->slots[shm_control::current_slot(current)];
+      s.readers.fetch_add(1);
+      //登记后再确认仍是当前版本：发布者先切换版本再检查读者数，两者顺序一致，故不会回收已登记的版本
+      if(m_control->current.load() == current)
+        break;
+      release_slot(shm_control::current_slot(current));
+    }
+    uint32_t index  = shm_control::current_slot(current);
+    uint64_t version= shm_control::current_version(current);
+    view* v = nullptr;
+    try
+    {
+      v = map_view(version);
+    }
+    catch(...)
+    {
+      release_slot(index);
+      throw;
+    }
+    const image_header* header = (const image_header*)v->map;
+    if(!header->valid(v->map_size) || (layout_version != 0 && header->layout_version != layout_version))
+    {
+      release_slot(index);
+      throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: invalid shm snapshot:" + m_name);
+    }
+    v->refs ++;
+    snapshot.m_owner  = this;
+    snapshot.m_slot   = index;
+    snapshot.m_version= version;
+    snapshot.m_header = header;
+    return snapshot;
+  }
+  uint64_t      current_version()const
+  {
+    return shm_control::current_version(m_control->current.load());
+  }
+protected:
+  view*   map_view(uint64_t version)
+  {
+    for(auto& v:m_views)
+    {
+      if(v.version == version)
+        return &v;
+    }
+    //切换到新版本时，解除已无人使用的旧映射
+    for(size_t i = m_views.size();i > 0;i--)
+    {
+      if(m_views[i-1].refs == 0)
+      {
+        ::munmap(m_views[i-1].map,m_views[i-1].map_size);
+        m_views.erase(m_views.begin() + (i-1));
+      }
+    }
+    std::string snapshot = shm_control::snapshot_name(m_name,version);
+    int fd = ::shm_open(snapshot.c_str(),O_RDONLY,0);
+    if(fd < 0)
+      throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: shm_open failed:" + snapshot);
+    struct stat st;
+    if(::fstat(fd,&st) != 0 || (size_t)st.st_size < sizeof(image_header))
+    {
+      ::close(fd);
+      throw mmo_exception((int32_t)mmo_exception::invalid_image,"mmo_exception:: invalid shm snapshot:" + snapshot);
+    }
+    void* p = ::mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_SHARED,fd,0);
+    ::close(fd);
+    if(p == MAP_FAILED)
+      throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: mmap shm failed:" + snapshot);
+    view v;
+    v.version   = version;
+    v.map       = (char*)p;
+    v.map_size  = (size_t)st.st_size;
+    m_views.push_back(v);
+    return &m_views.back();
+  }
+  void    release_view(uint64_t version)
+  {
+    for(size_t i = 0;i < m_views.size();i++)
+    {
+      view& v = m_views[i];
+      if(v.version != version)
+        continue;
+      //当前版本的映射保留下来供下次复用，旧版本无人使用时立即解除映射
+      if(--v.refs == 0 && version != current_version())
+      {
+        ::munmap(v.map,v.map_size);
+        m_views.erase(m_views.begin() + i);
+      }
+      return;
+    }
+  }
+  void    release_slot(uint32_t index)
+  {
+    shm_control::slot& s = m_control->slots[index];
+    if(s.readers.fetch_sub(1) == 1 && s.state.load() == shm_control::slot_retired)
+      m_control->reclaim(m_name,index);
+  }
+};
+
+inline void shm_snapshot::release()
+{
+  if(m_owner == nullptr)
+    return;
+  m_owner->release_view(m_version);
+  m_owner->release_slot(m_slot);
+  m_owner   = nullptr;
+  m_header  = nullptr;
+}
+
+}//end namespace mmo
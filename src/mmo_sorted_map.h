@@ -0,0 +1,289 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_sorted_map.h
+*           复杂对象--线性映射库--Eytzinger 布局的只读有序 map
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include <algorithm>
+
+namespace mmo
+{
+
+MMO_PACK_BEGIN
+
+/**
+ * @brief 无内存分配 ，内容相对地址存储，只读有序 map 模板类
+ *        键按 Eytzinger（BFS 完全二叉树）顺序存放：下标 k 的左右孩子为 2k、2k+1，
+ *        查找路径上的前几层集中在数组头部常驻缓存，后续层可按 16k 提前预取，
+ *        比较结果直接参与下标计算，没有分支预测失败。
+ *        值按同样的顺序单独存放，查找时只扫键数组。
+ *        布局：[对象头][键数组 (size+1)，下标 0 不用][值数组 (size+1)，下标 0 不用]
+ *
+ * @tparam KeyType    需可平凡拷贝且支持 operator<
+ * @tparam ValueType
+ * @tparam SizeType   注意：类型最大值 需大于 寻址空间最大值
+ */
+template<typename KeyType,typename ValueType,typename SizeType>
+class sorted_map
+{
+public:
+  typedef sorted_map<KeyType,ValueType,SizeType>  SelfType;
+  /**
+   * @brief 按键升序遍历的迭代器，内部保存 Eytzinger 下标，0 表示结束
+   */
+  class iterator
+  {
+  public:
+    size_t                index{0};
+    const SelfType*       self{nullptr};
+  public:
+    iterator(const SelfType* pSelf,size_t pos)
+    {
+      index   =pos;
+      self    =pSelf;
+    }
+    bool operator==(const iterator& _rhs) const{return (index == _rhs.index && self == _rhs.self);}
+    bool operator!=(const iterator& _rhs) const{return (index != _rhs.index || self != _rhs.self);}
+    const KeyType&  key()const{return self->_keys()[index];}
+    ValueType&      value()const{return (ValueType&)self->_values()[index];}
+    ValueType* operator->() const{return &value();}
+    ValueType& operator*() const{return value();}
+    iterator operator++(int)
+    {
+      iterator _Tmp = *this;
+      ++*this;
+      return (_Tmp);
+    }
+    /**
+     * @brief 中序后继：有右子树则走到右子树最左，否则沿右孩子链上溯
+     */
+    iterator& operator++()
+    {
+      size_t n = self->m_size;
+      if(index * 2 + 1 <= n)
+      {
+        index = index * 2 + 1;
+        while(index * 2 <= n)
+          index *= 2;
+      }
+      else
+      {
+        while(index & 1)
+          index >>= 1;
+        index >>= 1;
+      }
+      return *this;
+    }
+  };
+protected:
+  SizeType    m_size{0};
+  SizeType    m_key_offset{0};
+  SizeType    m_value_offset{0};
+  ValueType   m_default_value;
+public:
+  sorted_map(){}
+  sorted_map(const SelfType&) = delete;
+  SelfType& operator=(const SelfType&) = delete;
+public:
+  static size_t    predict_capacity_bytes(size_t size)
+  {
+    size_t bytes = _key_bytes(size) + sizeof(ValueType) * (size + 1);
+    return sizeof(SelfType) + bytes + _array_align(bytes) - 1;
+  }
+  /**
+   * @brief 由全部键构造，键无需预先排序，值为默认构造，之后可通过迭代器/get() 原地赋值
+   *
+   * @tparam Container  键的容器
+   * @return true 构造成功；有重复键时返回 false
+   */
+  template<typename Container>
+  bool  build_keys(const Container& keys,segment_manager& segment)
+  {
+    if(m_key_offset != 0)
+      return false;
+    std::vector<KeyType> sorted(keys.begin(),keys.end());
+    std::sort(sorted.begin(),sorted.end());
+    for(size_t i = 1;i < sorted.size();i++)
+    {
+      if(!(sorted[i-1] < sorted[i]))
+        return false;
+    }
+    size_t  n     = sorted.size();
+    size_t  head  = _key_bytes(n);
+    size_t  bytes = head + sizeof(ValueType) * (n + 1);
+    MMO_ALLOC_KIND(alloc_sorted_map_table);
+    char*   p     = segment.alloc(bytes,_array_align(bytes));
+    if(p == NULL)
+    {
+      size_t free_size = segment.get_free_memory();
+      size_t used_size = segment.size();
+      std::string strErrMsg = "mmo_exception:: no enough memory,free:" + std::to_string(free_size) + ",used:"
+        + std::to_string(used_size) + ",alloc size:" + std::to_string(bytes) ;
+      throw mmo_exception((int32_t)mmo_exception::no_enough_memory,strErrMsg);
+      return false;
+    }
+    m_size          = (SizeType)n;
+    m_key_offset    = checked_offset<SizeType>(p - (char*)this);
+    m_value_offset  = checked_offset<SizeType>(p + head - (char*)this);
+    ValueType* values = _values();
+    if(segment.measuring())
+    {
+      //值中的容器头在测量模式下也要构造，见 vector::resize
+      if(!std::is_trivially_default_constructible<ValueType>::value)
+      {
+        for(size_t k = 0;k <= n;k++)
+          ::new((void*)(values + k))ValueType();
+      }
+      return true;
+    }
+    memset(p,0,sizeof(KeyType));
+    size_t next = 0;
+    _fill(sorted,next,1);
+    for(size_t k = 0;k <= n;k++)
+      ::new((void*)(values + k))ValueType();
+    return true;
+  }
+  /**
+   * @brief 由全部键值对构造
+   *
+   * @tparam Container  元素为 std::pair<KeyType,ValueType> 的容器，如 std::map / std::vector
+   */
+  template<typename Container>
+  bool  build(const Container& items,segment_manager& segment)
+  {
+    std::vector<KeyType> keys;
+    keys.reserve(items.size());
+    for(auto& it:items)
+      keys.push_back(it.first);
+    if(!build_keys(keys,segment))
+      return false;
+    if(segment.measuring())
+      return true;
+    for(auto& it:items)
+      _values()[_search(it.first)] = it.second;
+    return true;
+  }
+  SizeType  size()const{return m_size;}
+  bool      empty()const{return m_size==0;}
+public:
+  iterator  begin()const
+  {
+    size_t k = (m_size == 0) ? 0 : 1;
+    while(k != 0 && k * 2 <= (size_t)m_size)
+      k *= 2;
+    return iterator(this,k);
+  }
+  iterator  end()const{return iterator(this,0);}
+  /**
+   * @brief 第一个不小于 key 的元素
+   */
+  iterator  lower_bound(const KeyType& key)const{return iterator(this,_search(key));}
+  /**
+   * @brief 第一个大于 key 的元素
+   */
+  iterator  upper_bound(const KeyType& key)const{return iterator(this,_search_upper(key));}
+  iterator  find(const KeyType& key)const
+  {
+    size_t k = _search(key);
+    return (k != 0 && !(key < _keys()[k])) ? iterator(this,k) : end();
+  }
+  const ValueType* get(const KeyType& key)const
+  {
+    size_t k = _search(key);
+    return (k != 0 && !(key < _keys()[k])) ? &_values()[k] : NULL;
+  }
+  ValueType* get(const KeyType& key)
+  {
+    return (ValueType*)((const SelfType*)this)->get(key);
+  }
+  ValueType&        operator[](const KeyType& key)
+  {
+    ValueType* p = get(key);
+    return (p == NULL) ? m_default_value : *p;
+  }
+  const ValueType&  operator[](const KeyType& key)const
+  {
+    const ValueType* p = get(key);
+    return (p == NULL) ? m_default_value : *p;
+  }
+  /**
+   * @brief 遍历 [low,high] 闭区间内的全部元素
+   *
+   * @param visit 可调用对象：void(const KeyType&,const ValueType&)
+   * @return size_t 访问的元素个数
+   */
+  template<typename Visitor>
+  size_t    for_range(const KeyType& low,const KeyType& high,Visitor visit)const
+  {
+    size_t   count = 0;
+    iterator last  = upper_bound(high);
+    for(iterator it = lower_bound(low);it != last;++it,++count)
+      visit(it.key(),*it);
+    return count;
+  }
+public:
+  const KeyType*    _keys()const{return (const KeyType*)((const char*)this + m_key_offset);}
+  KeyType*          _keys(){return (KeyType*)((char*)this + m_key_offset);}
+  const ValueType*  _values()const{return (const ValueType*)((const char*)this + m_value_offset);}
+  ValueType*        _values(){return (ValueType*)((char*)this + m_value_offset);}
+protected:
+  /**
+   * @brief 无分支下降：比较结果直接决定走左(2k)还是右(2k+1)，
+   *        结束时 k 的二进制末尾多出的 "1...10" 是最后几次向右走，去掉后即为答案，0 表示不存在
+   *        k 的第 4 代后代是连续的 16 个键 [16k,16k+16)，提前预取其所在缓存行
+   *        （预取指令不会因地址越界而出错，不必对数组末尾做判断）
+   */
+  size_t    _search(const KeyType& key)const
+  {
+    const KeyType*  keys  = _keys();
+    size_t          n     = m_size;
+    size_t          k     = 1;
+    while(k <= n)
+    {
+      __builtin_prefetch((const char*)keys + k * 16 * sizeof(KeyType));
+      k = 2 * k + (size_t)(keys[k] < key);
+    }
+    return k >> __builtin_ffsll(~(long long)k);
+  }
+  size_t    _search_upper(const KeyType& key)const
+  {
+    const KeyType*  keys  = _keys();
+    size_t          n     = m_size;
+    size_t          k     = 1;
+    while(k <= n)
+    {
+      __builtin_prefetch((const char*)keys + k * 16 * sizeof(KeyType));
+      k = 2 * k + (size_t)(!(key < keys[k]));
+    }
+    return k >> __builtin_ffsll(~(long long)k);
+  }
+  /**
+   * @brief 键数组字节数，对齐布局下补齐到值的对齐
+   */
+  static size_t   _key_bytes(size_t size)
+  {
+    return layout_round(sizeof(KeyType) * (size + 1),layout_align<ValueType>());
+  }
+  static size_t   _array_align(size_t bytes)
+  {
+    size_t a = layout_array_align<KeyType>(bytes);
+    return (a < layout_align<ValueType>()) ? layout_align<ValueType>() : a;
+  }
+  void      _fill(const std::vector<KeyType>& sorted,size_t& next,size_t k)
+  {
+    if(k > (size_t)m_size)
+      return;
+    _fill(sorted,next,2 * k);
+    _keys()[k] = sorted[next++];
+    _fill(sorted,next,2 * k + 1);
+  }
+};
+template<typename KeyType,typename ValueType,typename SizeType>
+struct has_relative_offset<sorted_map<KeyType,ValueType,SizeType>>:std::true_type{};
+
+MMO_PACK_END
+
+}//end namespace mmo
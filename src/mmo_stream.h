@@ -0,0 +1,423 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_stream.h
+*           复杂对象--线性映射库--边构造边写出的流式内存段
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include "mmo_segment.h"
+#include "mmo_image.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+namespace mmo
+{
+
+/**
+ * @brief 流式内存段：构造过程中把已定稿的部分写到文件或套接字，并归还其物理内存
+ *        容器的负载总是在对象头之后分配，对象头写好、负载填完之后，这段字节就不会再改，
+ *        可以先写出；只有少数一直要修改到最后的对象头（根对象、正在追加元素的 var_vector 等）需要留在内存中。
+ *        地址空间仍是一整段连续预留（偏移寻址依赖于此），写出后的页用 MADV_DONTNEED 归还，
+ *        常驻内存约为 window_size + 钉住的页，与镜像总大小无关。
+ *        写出由后台线程完成，构造与 I/O 重叠；写线程积压超过 window_size 时 checkpoint() 阻塞等待。
+ *        约定：
+ *          1. 之后还会修改的对象头先 pin()，写出时跳过：可寻址的 fd（文件）在 finish() 时用 pwrite 回写这些位置；
+ *             不可寻址的 fd（套接字、管道）按顺序流格式写出，钉住的位置先以 0 占位，finish() 时作为尾部记录发出，
+ *             内存中始终只留钉住的页。顺序流格式（send_stream_image 写出，receive_stream_image 读入，见 mmo_net.h）：
+ *               [块]...[块][结束块][钉住区个数][钉住区]...[image_header]
+ *               块：    uint64 字节数 + 镜像中接下来的这么多字节（钉住的位置为 0），字节数为 0 表示结束
+ *               钉住区：uint64 偏移 + uint64 字节数 + 最终内容，个数为 uint64；
+ *             文件头要到构造结束才能确定，由 send_stream_image 最后发出；
+ *          2. 只在安全点调用 checkpoint()：此前分配的内容除钉住的部分外都已定稿，之后也不再读取
+ *             （如 end_append_element 之后）；需要回读全部元素的操作
+ *             （indexed_var_vector::finish_append_elements、hash_map 的插入等）要在两次 checkpoint 之间完成；
+ *          3. 最后调用 finish()，写出剩余内容并等待写线程结束。
+ *
+ *   mmo::stream_segment segment(fd);
+ *   CRoadMap* pRoadMap = mmo::construct<CRoadMap>(segment);
+ *   segment.pin(pRoadMap);
+ *   pRoadMap->m_roads.prepare_append_elements(segment);
+ *   for(...)
+ *   {
+ *     auto element = pRoadMap->m_roads.begin_append_element(segment);
+ *     element->object().init(...,segment);
+ *     pRoadMap->m_roads.end_append_element(element,segment);
+ *     segment.checkpoint();
+ *   }
+ *   segment.finish();
+ */
+class stream_segment:
+  public growable_segment
+{
+public:
+  enum : size_t
+  {
+    default_stream_reserve  = 1UL << 38,  //默认预留 256G 地址空间，只占虚拟地址
+    default_window_size     = 64UL << 20,
+    default_flush_size      = 4UL << 20,
+  };
+protected:
+  struct range
+  {
+    size_t    offset;
+    size_t    bytes;
+  };
+  int                       m_fd{-1};
+  off_t                     m_base{0};
+  bool                      m_seekable{false};
+  bool                      m_finished{false};
+  size_t                    m_window{0};
+  size_t                    m_flush_size{0};
+  size_t                    m_flushed{0};         //已交给写线程的字节数
+  size_t                    m_written{0};         //写线程已写完的字节数
+  size_t                    m_released{0};        //已归还物理内存的字节数，按页对齐
+  size_t                    m_sent{0};            //顺序写时已发出的镜像字节数（含钉住区的占位），只由写线程与 finish 访问
+  int                       m_error{0};
+  bool                      m_stop{false};
+  std::vector<range>        m_pins;
+  std::deque<range>         m_jobs;
+  std::mutex                m_mutex;
+  std::condition_variable   m_cond;
+  std::thread               m_writer;
+public:
+  /**
+   * @param fd            输出 fd，可寻址时从 base 处开始用 pwrite 写，否则按顺序流格式 write
+   * @param base          镜像在文件中的起始位置，如镜像文件头之后；顺序写时不用
+   * @param window_size   写线程最多积压的字节数
+   * @param flush_size    未写出的内容达到此大小时 checkpoint() 才交给写线程，避免过小的写
+   * @param reserve_size  镜像最大字节数（虚拟地址预留）
+   */
+  stream_segment(int fd,off_t base = 0,size_t window_size = default_window_size,size_t flush_size = default_flush_size,
+                 size_t reserve_size = default_stream_reserve):
+    growable_segment(reserve_size,default_block_size)
+  {
+    m_fd          = fd;
+    m_base        = base;
+    m_seekable    = (::lseek(fd,0,SEEK_CUR) != (off_t)-1);
+    m_window      = window_size;
+    m_flush_size  = (flush_size == 0) ? page_size() : flush_size;
+    m_writer      = std::thread([this](){_write_loop();});
+  }
+  stream_segment(const stream_segment&) = delete;
+  stream_segment& operator=(const stream_segment&) = delete;
+  ~stream_segment()
+  {
+    _stop();
+  }
+public:
+  bool      seekable()const{return m_seekable;}
+  size_t    flushed()const{return m_flushed;}
+  /**
+   * @brief 钉住 [p,p+bytes)：之后仍会修改，不随 checkpoint 写出，其所在页一直保留
+   *        须在覆盖它的 checkpoint 之前调用
+   */
+  void      pin(const void* p,size_t bytes)
+  {
+    size_t offset = (size_t)((const char*)p - m_buffer);
+    if((const char*)p < m_buffer || offset < m_flushed || offset + bytes > size())
+      throw mmo_exception((int32_t)mmo_exception::invalid_memory_address,"mmo_exception:: pin range already flushed or out of segment!");
+    std::lock_guard<std::mutex> lock(m_mutex);
+    range r = {offset,bytes};
+    m_pins.push_back(r);
+  }
+  template<typename T>
+  void      pin(const T* object){pin(object,sizeof(T));}
+  /**
+   * @brief 安全点：未写出的内容达到 flush_size 时交给写线程
+   */
+  void      checkpoint()
+  {
+    if(size() - m_flushed >= m_flush_size)
+      _flush(size());
+  }
+  /**
+   * @brief 写出全部剩余内容，回写钉住的对象头（顺序写时发出结束块与钉住区记录），等待写线程结束；
+   *        出错时抛出 io_error 异常
+   *
+   * @return size_t 镜像字节数
+   */
+  size_t    finish()
+  {
+    if(m_finished)
+      return size();
+    _flush(size());
+    _stop();
+    m_finished = true;
+    if(!m_seekable && m_error == 0)
+      m_error = _write_trailer();
+    for(size_t i = 0;i < m_pins.size() && m_error == 0 && m_seekable;i++)
+      m_error = _write_at(m_pins[i].offset,m_pins[i].bytes);
+    seal();
+    if(m_error != 0)
+      throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: stream write failed,errno:" + std::to_string(m_error));
+    return size();
+  }
+protected:
+  /**
+   * @brief 把 [m_flushed,end) 去掉钉住的部分后交给写线程
+   */
+  void      _flush(size_t end)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    size_t from = m_flushed;
+    while(from < end)
+    {
+      //跳过覆盖 from 的钉住区，钉住区可能首尾相接，反复跳直到不再移动
+      for(bool moved = true;moved;)
+      {
+        moved = false;
+        for(auto& pin:m_pins)
+        {
+          if(pin.offset <= from && from < pin.offset + pin.bytes)
+          {
+            from  = pin.offset + pin.bytes;
+            moved = true;
+          }
+        }
+      }
+      if(from >= end)
+        break;
+      size_t to = end;
+      for(auto& pin:m_pins)
+      {
+        if(pin.offset > from && pin.offset < to)
+          to = pin.offset;
+      }
+      range job = {from,to - from};
+      m_jobs.push_back(job);
+      from = to;
+    }
+    if(end > m_flushed)
+    {
+      range mark = {end,0};       //长度为 0：只推进写出位置
+      m_jobs.push_back(mark);
+      m_flushed = end;
+    }
+    m_cond.notify_all();
+    //积压过多时等待，常驻内存因此有上界
+    m_cond.wait(lock,[this](){return m_flushed - m_written <= m_window || m_error != 0;});
+  }
+  void      _write_loop()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(;;)
+    {
+      m_cond.wait(lock,[this](){return m_stop || !m_jobs.empty();});
+      if(m_jobs.empty())
+        return;
+      range job = m_jobs.front();
+      m_jobs.pop_front();
+      if(job.bytes == 0)
+      {
+        m_written = job.offset;
+        _release(job.offset);
+        m_cond.notify_all();
+        continue;
+      }
+      if(m_error != 0)
+        continue;
+      lock.unlock();
+      int error = m_seekable ? _write_at(job.offset,job.bytes) : _write_frame(job.offset,job.bytes);
+      lock.lock();
+      if(error != 0)
+      {
+        m_error = error;
+        m_cond.notify_all();
+      }
+    }
+  }
+  /**
+   * @brief 归还 [m_released,end) 中完整的页，含钉住内容的页除外；持锁调用
+   */
+  void      _release(size_t end)
+  {
+    size_t page = page_size();
+    end = end / page * page;
+    if(end <= m_released)
+      return;
+    //相邻的可归还页合并为一次 madvise
+    size_t first = m_released;
+    for(size_t pos = m_released;pos < end;pos += page)
+    {
+      bool pinned = false;
+      for(auto& pin:m_pins)
+      {
+        if(pin.offset < pos + page && pos < pin.offset + pin.bytes)
+          pinned = true;
+      }
+      if(pinned)
+      {
+        if(pos > first)
+          ::madvise(m_buffer + first,pos - first,MADV_DONTNEED);
+        first = pos + page;
+      }
+    }
+    if(end > first)
+      ::madvise(m_buffer + first,end - first,MADV_DONTNEED);
+    m_released = end;
+  }
+  int       _write_at(size_t offset,size_t bytes)
+  {
+    const char* p = m_buffer + offset;
+    while(bytes > 0)
+    {
+      ssize_t n = ::pwrite(m_fd,p,bytes,m_base + (off_t)(p - m_buffer));
+      if(n < 0 && errno == EINTR)
+        continue;
+      if(n <= 0)
+        return (n < 0) ? errno : EIO;
+      p     += n;
+      bytes -= (size_t)n;
+    }
+    return 0;
+  }
+  /**
+   * @brief 顺序写一个块：[uint64 字节数][上一块之后钉住区的 0 占位][offset 起的 bytes 字节]
+   */
+  int       _write_frame(size_t offset,size_t bytes)
+  {
+    static const char zeros[4096] = {0};
+    uint64_t  len   = (uint64_t)(offset + bytes - m_sent);
+    int       error = _write_all(m_fd,&len,sizeof(len));
+    for(size_t gap = offset - m_sent;gap > 0 && error == 0;)
+    {
+      size_t n = (gap < sizeof(zeros)) ? gap : sizeof(zeros);
+      error = _write_all(m_fd,zeros,n);
+      gap  -= n;
+    }
+    if(bytes > 0 && error == 0)
+      error = _write_all(m_fd,m_buffer + offset,bytes);
+    m_sent = offset + bytes;
+    return error;
+  }
+  /**
+   * @brief 顺序写的结尾：末尾钉住区的占位、结束块、钉住区记录
+   */
+  int       _write_trailer()
+  {
+    int error = 0;
+    if(size() > m_sent)
+      error = _write_frame(size(),0);
+    uint64_t  end   = 0;
+    uint64_t  count = m_pins.size();
+    if(error == 0)
+      error = _write_all(m_fd,&end,sizeof(end));
+    if(error == 0)
+      error = _write_all(m_fd,&count,sizeof(count));
+    for(size_t i = 0;i < m_pins.size() && error == 0;i++)
+    {
+      uint64_t record[2] = {(uint64_t)m_pins[i].offset,(uint64_t)m_pins[i].bytes};
+      error = _write_all(m_fd,record,sizeof(record));
+      if(error == 0)
+        error = _write_all(m_fd,m_buffer + m_pins[i].offset,m_pins[i].bytes);
+    }
+    return error;
+  }
+public:
+  /**
+   * @brief 顺序写满 bytes 字节，返回 0 或 errno；套接字用 MSG_NOSIGNAL，对端关闭时返回 EPIPE 而不是触发信号
+   */
+  static int _write_all(int fd,const void* data,size_t bytes)
+  {
+    const char* p = (const char*)data;
+    while(bytes > 0)
+    {
+      ssize_t n = ::send(fd,p,bytes,MSG_NOSIGNAL);
+      if(n < 0 && errno == ENOTSOCK)
+        n = ::write(fd,p,bytes);
+      if(n < 0 && errno == EINTR)
+        continue;
+      if(n <= 0)
+        return (n < 0) ? errno : EIO;
+      p     += n;
+      bytes -= (size_t)n;
+    }
+    return 0;
+  }
+protected:
+  void      _stop()
+  {
+    if(!m_writer.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cond.notify_all();
+    m_writer.join();
+  }
+};
+
+/**
+ * @brief 流式保存镜像文件：边构造边写盘，镜像可远大于物理内存
+ *        与 save_image 相同，先写临时文件、落盘后再改名；文件头在最后回写
+ *
+ * @tparam Builder  可调用对象：T*(stream_segment&)，构造并返回根对象，内部按 stream_segment 的约定 pin/checkpoint
+ * @return size_t 镜像字节数
+ */
+template<typename Builder>
+size_t stream_image(const std::string& path,Builder&& build,uint32_t layout_version = 0,
+                    size_t window_size = stream_segment::default_window_size,
+                    size_t flush_size = stream_segment::default_flush_size)
+{
+  std::string tmp_path;
+  int fd = create_temp_file(path,tmp_path);
+  image_header header;
+  try
+  {
+    stream_segment segment(fd,(off_t)sizeof(image_header),window_size,flush_size);
+    const char* root = (const char*)build(segment);
+    if(root < segment.data() || root >= segment.data() + segment.size())
+      throw mmo_exception((int32_t)mmo_exception::invalid_memory_address,"mmo_exception:: image root out of segment!");
+    header.layout_version = layout_version;
+    header.root_offset    = root - segment.data();
+    header.image_size     = segment.finish();
+  }
+  catch(...)
+  {
+    ::close(fd);
+    unlink(tmp_path.c_str());
+    throw;
+  }
+  bool ok = ::pwrite(fd,&header,sizeof(header),0) == (ssize_t)sizeof(header);
+  commit_temp_file(fd,tmp_path,path,ok);
+  return (size_t)header.image_size;
+}
+
+/**
+ * @brief 流式发送镜像到套接字或管道：边构造边按顺序流格式发出，最后发出文件头，
+ *        对端用 receive_stream_image（mmo_net.h）接收；常驻内存与 stream_image 相同，只留窗口与钉住的页
+ *
+ * @tparam Builder  可调用对象：T*(stream_segment&)，构造并返回根对象，内部按 stream_segment 的约定 pin/checkpoint
+ * @return size_t 镜像字节数
+ */
+template<typename Builder>
+size_t send_stream_image(int fd,Builder&& build,uint32_t layout_version = 0,
+                         size_t window_size = stream_segment::default_window_size,
+                         size_t flush_size = stream_segment::default_flush_size)
+{
+  stream_segment segment(fd,0,window_size,flush_size);
+  if(segment.seekable())
+    throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: send_stream_image needs a socket or pipe,use stream_image for files!");
+  const char* root = (const char*)build(segment);
+  if(root < segment.data() || root >= segment.data() + segment.size())
+    throw mmo_exception((int32_t)mmo_exception::invalid_memory_address,"mmo_exception:: image root out of segment!");
+  image_header header;
+  header.layout_version = layout_version;
+  header.root_offset    = root - segment.data();
+  header.image_size     = segment.finish();
+  int error = stream_segment::_write_all(fd,&header,sizeof(header));
+  if(error != 0)
+    throw mmo_exception((int32_t)mmo_exception::io_error,"mmo_exception:: stream write failed,errno:" + std::to_string(error));
+  return (size_t)header.image_size;
+}
+
+}//end namespace mmo
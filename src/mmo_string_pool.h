@@ -0,0 +1,96 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_string_pool.h
+*           复杂对象--线性映射库--构造期字串去重池
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include <type_traits>
+#include <unordered_map>
+
+namespace mmo
+{
+
+/**
+ * @brief 字串去重池，只在构造端使用，不进入镜像
+ *        构造时按内容查表，相同内容的 mmo::string 通过相对偏移指向同一份内容，只存储一次。
+ *        读取端无需任何改动：被共享的 mmo::string 与普通的完全一样。
+ *        注意：池中记录的是本内存段内的地址，一个池只能用于一个内存段的一次构造，
+ *             两遍构造（先测量、再正式构造）时每一遍都要先 clear()。
+ *
+ * @tparam SizeType 与 mmo::string 的 SizeType 一致，须为有符号类型：
+ *                  共享的内容位于字串对象之前，需要负的相对偏移，无符号类型下一个都共享不了
+ */
+template<typename SizeType>
+class string_pool
+{
+  static_assert(std::is_signed<SizeType>::value,"mmo::string_pool: SizeType must be signed, a shared payload lies before the string and needs a negative offset");
+  typedef string<SizeType>  StringType;
+protected:
+  std::unordered_map<std::string,const char*>   m_payloads;
+  std::unordered_map<std::string,StringType*>   m_objects;
+  size_t      m_hits{0};
+  size_t      m_saved_bytes{0};
+public:
+  string_pool(){}
+  string_pool(const string_pool&) = delete;
+  string_pool& operator=(const string_pool&) = delete;
+public:
+  /**
+   * @brief 给 dst 赋值：内容已出现过则共享已有内容，否则拷贝一份并登记
+   *        已有内容距离太远、SizeType 表示不了时也会拷贝，并以新拷贝作为之后共享的目标
+   *
+   * @param dst     位于 segment 中的字串对象
+   * @param src
+   * @param segment
+   * @return true
+   */
+  bool    assign(StringType& dst,const std::string& src,segment_manager& segment)
+  {
+    if(src.empty())
+      return dst.assign(src,segment);
+    auto it = m_payloads.find(src);
+    if(it != m_payloads.end() && dst._share(it->second,(SizeType)src.size()))
+    {
+      ++ m_hits;
+      m_saved_bytes += src.size() + 1;
+      return true;
+    }
+    if(!dst.assign(src,segment))
+      return false;
+    m_payloads[src] = dst.data();
+    return true;
+  }
+  /**
+   * @brief 返回内容为 src 的字串对象，已存在则直接复用整个对象，适合 offset_ptr<string> 形式的引用
+   */
+  StringType* intern(const std::string& src,segment_manager& segment)
+  {
+    auto it = m_objects.find(src);
+    if(it != m_objects.end())
+    {
+      ++ m_hits;
+      m_saved_bytes += sizeof(StringType) + (src.empty() ? 0 : src.size() + 1);
+      return it->second;
+    }
+    StringType* dst = construct<StringType>(segment);
+    assign(*dst,src,segment);
+    m_objects[src] = dst;
+    return dst;
+  }
+  void    clear()
+  {
+    m_payloads.clear();
+    m_objects.clear();
+    m_hits        = 0;
+    m_saved_bytes = 0;
+  }
+public:
+  size_t  unique_count()const{return m_payloads.size();}
+  size_t  hits()const{return m_hits;}
+  size_t  saved_bytes()const{return m_saved_bytes;}
+};
+
+}//end namespace mmo
@@ -0,0 +1,470 @@
+#pragma once
+
+/*************************************************\
+* @file   : mmo_verify.h
+*           复杂对象--线性映射库--不可信镜像的越界校验
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include "mmo_image.h"
+#include "mmo_schema.h"
+#include "mmo_sorted_map.h"
+#include "mmo_flat_hash_map.h"
+#include "mmo_perfect_hash_map.h"
+#include "mmo_rtree.h"
+#include "mmo_offset.h"
+#include <type_traits>
+#include <utility>
+
+namespace mmo
+{
+
+class verifier;
+
+/**
+ * @brief 检测类型是否提供了校验钩子：bool mmo_verify(mmo::verifier& verify)const
+ */
+template<typename T>
+class has_mmo_verify
+{
+  template<typename U>
+  static auto test(int) -> decltype(std::declval<const U&>().mmo_verify(std::declval<verifier&>()),std::true_type());
+  template<typename U>
+  static std::false_type test(...);
+public:
+  enum { value = decltype(test<T>(0))::value };
+};
+
+/**
+ * @brief 镜像校验器：从根对象出发遍历一遍，检查每个相对偏移引用的内容都落在缓冲区内
+ *        网络收到的、或来自其他进程的镜像，在当作对象使用之前先校验，
+ *        偏移或长度被篡改/损坏时返回 false，而不是越界读。
+ *        - string / vector / var_vector / indexed_var_vector / hash_map / flat_hash_map / perfect_hash_map /
+ *          offset_ptr / far_ptr / delta_vector / sorted_map / packed_rtree 内置支持；
+ *        - 纯数据类型（整数、枚举，以及 MMO_PLAIN_DATA 声明的 Point2D 等）无需检查；
+ *        - MMO_SCHEMA 声明过的类逐成员检查；
+ *        - 其他类型提供 bool mmo_verify(mmo::verifier& verify)const，对每个成员调用 verify(m_xxx)。
+ *        每个引用只做一次无符号比较，不分配内存，耗时与镜像大小成线性；
+ *        offset_ptr 形成的环或大量共享由嵌套深度和访问对象数两个上限截断。
+ *        对齐布局下同时检查对象相对缓冲区起始的对齐，缓冲区本身需按缓存行对齐。
+ *
+ *   const CRoadMap* pRoadMap = mmo::verified_root<CRoadMap>(buf.data(),buf.size());
+ */
+class verifier
+{
+public:
+  enum
+  {
+    default_max_depth = 256,
+  };
+protected:
+  const char*   m_begin{nullptr};
+  size_t        m_size{0};
+  size_t        m_budget{0};      //剩余可访问的对象数
+  size_t        m_depth{0};
+  size_t        m_max_depth{0};
+  const char*   m_error{nullptr};
+public:
+  /**
+   * @param data      镜像数据
+   * @param size      镜像字节数
+   * @param max_depth offset_ptr 的最大嵌套深度
+   * @param budget    最多访问的对象数，0 表示与镜像字节数相同
+   */
+  verifier(const void* data,size_t size,size_t max_depth = default_max_depth,size_t budget = 0)
+  {
+    m_begin     = (const char*)data;
+    m_size      = size;
+    m_budget    = (budget == 0) ? size : budget;
+    m_max_depth = max_depth;
+  }
+  verifier(const verifier&) = delete;
+  verifier& operator=(const verifier&) = delete;
+public:
+  /**
+   * @brief 第一处校验失败的原因，未失败时为 NULL
+   */
+  const char*   error()const{return m_error;}
+  bool          fail(const char* error)
+  {
+    if(m_error == nullptr)
+      m_error = error;
+    return false;
+  }
+  /**
+   * @brief [p,p+bytes) 是否在缓冲区内；p 在缓冲区之前时差值回绕为极大值，一次比较即可
+   */
+  bool          range(const void* p,size_t bytes)const
+  {
+    size_t offset = (size_t)((const char*)p - m_begin);
+    return offset <= m_size && bytes <= m_size - offset;
+  }
+  /**
+   * @brief 可以按 T 读取 p：在缓冲区内，对齐布局下还需对齐
+   */
+  template<typename T>
+  bool          object(const void* p)const
+  {
+    size_t offset = (size_t)((const char*)p - m_begin);
+    return range(p,sizeof(T)) && (offset & (layout_align<T>() - 1)) == 0;
+  }
+  /**
+   * @brief 可以按 T[count] 读取 p，count 为负数或乘积溢出都视为越界
+   */
+  template<typename T,typename CountType>
+  bool          array(const void* p,CountType count)const
+  {
+    size_t offset = (size_t)((const char*)p - m_begin);
+    return (int64_t)count >= 0 && offset <= m_size && (size_t)count <= (m_size - offset) / sizeof(T)
+        && (offset & (layout_align<T>() - 1)) == 0;
+  }
+public:
+  /**
+   * @brief 通用类型：有 mmo_verify 钩子则调用钩子，MMO_SCHEMA 声明的类逐成员检查，否则须为纯数据类型
+   */
+  template<typename T>
+  bool  operator()(const T& src)
+  {
+    return _verify(src,std::integral_constant<int,has_mmo_verify<T>::value ? 2 : (has_mmo_schema<T>::value ? 1 : 0)>());
+  }
+  template<typename SizeType>
+  bool  operator()(const string<SizeType>& src)
+  {
+    //c_str() 依赖结尾的 0，空串也指向一个 0 字节（默认指向对象自身的 m_size）
+    if(!array<char>(src.data(),(int64_t)src.size() + 1) || src.data()[src.size()] != 0)
+      return fail("string out of range");
+    return true;
+  }
+  template<typename ValueType,typename SizeType>
+  bool  operator()(const vector<ValueType,SizeType>& src)
+  {
+    if(!array<ValueType>(src.data(),src.size()))
+      return fail("vector out of range");
+    return _verify_array(src.data(),(size_t)src.size(),std::integral_constant<bool,_plain<ValueType>::value>());
+  }
+  template<typename ValueType,typename SizeType>
+  bool  operator()(const var_vector<ValueType,SizeType>& src)
+  {
+    return _verify_elements(src,(const SizeType*)NULL);
+  }
+  template<typename ValueType,typename SizeType>
+  bool  operator()(const indexed_var_vector<ValueType,SizeType>& src)
+  {
+    if(!src.indexed())
+      return _verify_elements(src,(const SizeType*)NULL);
+    if(!array<SizeType>(src._index_table(),src.size()))
+      return fail("var_vector index out of range");
+    return _verify_elements(src,src._index_table());
+  }
+  /**
+   * @brief 逐个桶沿链表遍历，链上节点总数须与 size() 一致，链表成环时在超出 size() 处截断
+   */
+  template<typename KeyType,typename ValueType,typename SizeType>
+  bool  operator()(const hash_map<KeyType,ValueType,SizeType>& src)
+  {
+    typedef hash_node<KeyType,ValueType,SizeType> NodeType;
+    typedef offset_ptr<NodeType,SizeType>         NodePtr;
+    if(!(*this)(src._default_value()))
+      return false;
+    int64_t size    = (int64_t)src.size();
+    int64_t buckets = (int64_t)src.hash_size();
+    if(size < 0 || buckets < 0 || (buckets == 0 && size != 0))
+      return fail("hash_map size invalid");
+    if(buckets == 0)
+      return true;
+    const NodePtr* table = src._key_table();
+    if(!array<NodePtr>(table,buckets))
+      return fail("hash_map table out of range");
+    int64_t count = 0;
+    for(int64_t i = 0;i < buckets;i++)
+    {
+      for(const NodeType* node = table[i].get();node != NULL;node = node->next.get())
+      {
+        if(++count > size || !object<NodeType>(node))
+          return fail("hash_map node out of range");
+        if(!_visit() || !(*this)(node->key) || !(*this)(node->value))
+          return false;
+      }
+    }
+    return (count == size) ? true : fail("hash_map size mismatch");
+  }
+  template<typename ValueType,typename OffsetType>
+  bool  operator()(const offset_ptr<ValueType,OffsetType>& src)
+  {
+    return _pointee(src.get(),"offset_ptr out of range","offset_ptr nested too deep");
+  }
+  /**
+   * @brief 远指针先检查远程偏移槽本身在范围内，再读取槽中的偏移
+   */
+  template<typename ValueType,typename NearType,typename FarType>
+  bool  operator()(const far_ptr<ValueType,NearType,FarType>& src)
+  {
+    if(src._is_far() && !object<FarType>(src._slot()))
+      return fail("far_ptr slot out of range");
+    return _pointee(src.get(),"far_ptr out of range","far_ptr nested too deep");
+  }
+  /**
+   * @brief 编码数据须恰好是 2*size() 个完整的变长整数，解码时不会读出 bytes() 之外
+   */
+  template<typename PointType,typename SizeType>
+  bool  operator()(const delta_vector<PointType,SizeType>& src)
+  {
+    int64_t count = (int64_t)src.size() * 2;
+    if(!array<uint8_t>(src._data(),src.bytes()) || count < 0)
+      return fail("delta_vector out of range");
+    const uint8_t* p    = src._data();
+    const uint8_t* last = p + (size_t)src.bytes();
+    for(int64_t i = 0;i < count;i++)
+    {
+      const uint8_t* limit = (last - p > 5) ? p + 5 : last;
+      while(p < limit && (*p & 0x80) != 0)
+        p++;
+      if(p == limit)
+        return fail("delta_vector varint truncated");
+      p++;
+    }
+    return (p == last) ? true : fail("delta_vector size mismatch");
+  }
+  template<typename KeyType,typename ValueType,typename SizeType>
+  bool  operator()(const sorted_map<KeyType,ValueType,SizeType>& src)
+  {
+    int64_t size = (int64_t)src.size();
+    if(size < 0)
+      return fail("sorted_map size invalid");
+    if(size == 0)
+      return true;
+    if(!array<KeyType>(src._keys(),size + 1) || !array<ValueType>(src._values(),size + 1))
+      return fail("sorted_map out of range");
+    return _verify_array(src._keys() + 1,(size_t)size,std::integral_constant<bool,_plain<KeyType>::value>())
+        && _verify_array(src._values() + 1,(size_t)size,std::integral_constant<bool,_plain<ValueType>::value>());
+  }
+  /**
+   * @brief 控制字节只能是空或满，满的个数须与 size() 一致且至少留一个空桶，查找因此必然结束；
+   *        尾部 16 个镜像字节须与开头一致，只检查满槽位的键值
+   */
+  template<typename KeyType,typename ValueType,typename SizeType>
+  bool  operator()(const flat_hash_map<KeyType,ValueType,SizeType>& src)
+  {
+    typedef flat_hash_map<KeyType,ValueType,SizeType> MapType;
+    typedef typename MapType::SlotType                SlotType;
+    const int64_t group = (int64_t)MapType::group_width;
+    if(!(*this)(src._default_value()))
+      return false;
+    int64_t size    = (int64_t)src.size();
+    int64_t buckets = (int64_t)src.hash_size();
+    if(size < 0 || buckets < 0 || (buckets == 0 && size != 0))
+      return fail("flat_hash_map size invalid");
+    if(buckets == 0)
+      return true;
+    if(buckets < group || buckets % group != 0 || size >= buckets)
+      return fail("flat_hash_map size invalid");
+    const int8_t*   ctrl  = src._ctrl();
+    const SlotType* slots = src._slots();
+    if(!array<int8_t>(ctrl,buckets + group) || !array<SlotType>(slots,buckets))
+      return fail("flat_hash_map out of range");
+    if(memcmp(ctrl,ctrl + buckets,(size_t)group) != 0)
+      return fail("flat_hash_map control mirror mismatch");
+    int64_t count = 0;
+    for(int64_t i = 0;i < buckets;i++)
+    {
+      if(ctrl[i] < 0)
+      {
+        if(ctrl[i] != MapType::ctrl_empty)
+          return fail("flat_hash_map control byte invalid");
+        continue;
+      }
+      if(++count > size)
+        return fail("flat_hash_map size mismatch");
+      if(!_plain<KeyType>::value || !_plain<ValueType>::value)
+      {
+        if(!_visit() || !(*this)(slots[i].key) || !(*this)(slots[i].value))
+          return false;
+      }
+    }
+    return (count == size) ? true : fail("flat_hash_map size mismatch");
+  }
+  /**
+   * @brief 直接放置的位移须指向 size() 以内的槽位，其余位移经乘法映射后必然在范围内
+   */
+  template<typename KeyType,typename ValueType,typename SizeType>
+  bool  operator()(const perfect_hash_map<KeyType,ValueType,SizeType>& src)
+  {
+    typedef perfect_hash_map<KeyType,ValueType,SizeType> MapType;
+    typedef typename MapType::SlotType                   SlotType;
+    if(!(*this)(src._default_value()))
+      return false;
+    int64_t size    = (int64_t)src.size();
+    int64_t buckets = (int64_t)src.hash_size();
+    if(size < 0 || buckets < 0 || (size != 0 && buckets == 0))
+      return fail("perfect_hash_map size invalid");
+    if(size == 0)
+      return true;
+    const uint32_t* displace  = src._displace();
+    const SlotType* slots     = src._slots();
+    if(!array<uint32_t>(displace,buckets) || !array<SlotType>(slots,size))
+      return fail("perfect_hash_map out of range");
+    for(int64_t i = 0;i < buckets;i++)
+    {
+      if((displace[i] & MapType::direct_flag) != 0 && (int64_t)(displace[i] & ~MapType::direct_flag) >= size)
+        return fail("perfect_hash_map displacement out of range");
+    }
+    if(_plain<KeyType>::value && _plain<ValueType>::value)
+      return true;
+    for(int64_t i = 0;i < size;i++)
+    {
+      if(!_visit() || !(*this)(slots[i].key) || !(*this)(slots[i].value))
+        return false;
+    }
+    return true;
+  }
+  /**
+   * @brief 层边界由 size() 推算后比对，查询中由层边界算出的孩子下标因此都不会越界
+   */
+  template<typename ValueType,typename SizeType,typename CoordType>
+  bool  operator()(const packed_rtree<ValueType,SizeType,CoordType>& src)
+  {
+    typedef typename packed_rtree<ValueType,SizeType,CoordType>::BoxType BoxType;
+    if(!src._valid_levels())
+      return fail("packed_rtree levels invalid");
+    if(src.size() == 0)
+      return true;
+    if(!array<BoxType>(src._boxes(),src._node_count()) || !array<ValueType>(src._values(),src.size()))
+      return fail("packed_rtree out of range");
+    return _verify_array(src._values(),(size_t)src.size(),std::integral_constant<bool,_plain<ValueType>::value>());
+  }
+protected:
+  /**
+   * @brief 不含任何引用，无需逐个检查
+   */
+  template<typename T>
+  struct _plain:
+    std::integral_constant<bool,!has_mmo_verify<T>::value && !has_mmo_schema<T>::value && is_plain_data<T>::value>
+  {
+  };
+  template<typename ValueType>
+  bool  _pointee(const ValueType* p,const char* range_error,const char* depth_error)
+  {
+    if(p == NULL)
+      return true;
+    if(!object<ValueType>(p))
+      return fail(range_error);
+    if(m_depth >= m_max_depth)
+      return fail(depth_error);
+    if(!_visit())
+      return false;
+    m_depth++;
+    bool ok = (*this)(*p);
+    m_depth--;
+    return ok;
+  }
+  bool  _visit()
+  {
+    if(m_budget == 0)
+      return fail("too many objects");
+    m_budget--;
+    return true;
+  }
+  template<typename T>
+  bool  _verify(const T& src,std::integral_constant<int,2>)
+  {
+    return src.mmo_verify(*this);
+  }
+  template<typename T>
+  bool  _verify(const T& src,std::integral_constant<int,1>)
+  {
+    bool ok     = true;
+    auto fields = src.mmo_fields();
+    schema_for_each_index([&](auto i)
+    {
+      ok = ok && (*this)(std::get<decltype(i)::value>(fields));
+    },std::make_index_sequence<std::tuple_size<decltype(fields)>::value>());
+    return ok;
+  }
+  template<typename T>
+  bool  _verify(const T&,std::integral_constant<int,0>)
+  {
+    static_assert(is_plain_data<T>::value,"mmo::verifier: type is not supported, declare it with MMO_PLAIN_DATA, declare its members with MMO_SCHEMA or provide bool mmo_verify(mmo::verifier&)const");
+    return true;
+  }
+  template<typename T>
+  bool  _verify_array(const T*,size_t,std::true_type)
+  {
+    return true;
+  }
+  template<typename T>
+  bool  _verify_array(const T* src,size_t count,std::false_type)
+  {
+    for(size_t i = 0;i < count;i++)
+    {
+      if(!_visit() || !(*this)(src[i]))
+        return false;
+    }
+    return true;
+  }
+  /**
+   * @brief 元素首尾相接，逐个检查元素头与元素字节数，有偏移表时同时比对表中的偏移
+   */
+  template<typename ValueType,typename SizeType>
+  bool  _verify_elements(const var_vector<ValueType,SizeType>& src,const SizeType* table)
+  {
+    typedef var_element<ValueType,SizeType> ElementType;
+    int64_t size = (int64_t)src.size();
+    if(size < 0)
+      return fail("var_vector size invalid");
+    if(size == 0)
+      return true;
+    const ElementType*  element = src.begin().element_;
+    const char*         first   = (const char*)element;
+    for(int64_t i = 0;i < size;i++)
+    {
+      if(!object<ElementType>(element))
+        return fail("var_vector element out of range");
+      int64_t bytes = (int64_t)element->_data_bytes();
+      if(bytes < (int64_t)sizeof(ValueType) || !range(element,sizeof(ElementType) + (size_t)bytes))
+        return fail("var_element out of range");
+      if(table != NULL && (int64_t)table[i] != (int64_t)((const char*)element - first))
+        return fail("var_vector index mismatch");
+      if(!_visit() || !(*this)(element->object()))
+        return false;
+      element = (const ElementType*)(element->data() + bytes);
+    }
+    return true;
+  }
+};
+
+/**
+ * @brief 校验 [data,data+size) 中位于 root_offset 的 T 对象及其引用的全部内容
+ *
+ * @param error 失败时输出原因，可为 NULL
+ * @return true 可以安全地当作 T 使用
+ */
+template<typename T>
+bool  verify(const void* data,size_t size,size_t root_offset = 0,const char** error = NULL)
+{
+  verifier  check(data,size);
+  const T*  root = (const T*)((const char*)data + root_offset);
+  bool      ok   = (root_offset <= size && check.object<T>(root)) ? check(*root) : check.fail("root out of range");
+  if(error != NULL)
+    *error = check.error();
+  return ok;
+}
+
+/**
+ * @brief 校验通过后返回根对象，否则抛出 invalid_image 异常
+ */
+template<typename T>
+const T*  verified_root(const void* data,size_t size,size_t root_offset = 0)
+{
+  const char* error = NULL;
+  if(!verify<T>(data,size,root_offset,&error))
+    throw mmo_exception((int32_t)mmo_exception::invalid_image,std::string("mmo_exception:: image verify failed:") + error);
+  return (const T*)((const char*)data + root_offset);
+}
+template<typename T>
+const T*  verified_root(const mapped_image& image)
+{
+  return verified_root<T>(image.data(),image.size(),image.header().root_offset);
+}
+
+}//end namespace mmo
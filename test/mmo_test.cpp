@@ -0,0 +1,1525 @@
+/*************************************************\
+* @file   : mmo_test.cpp
+*           复杂对象--线性映射库--回归测试
+*           make test 编译并运行，全部通过时返回 0
+* @version: 1.1
+* @date   : 2026/10/16
+\*************************************************/
+#include "mmo_lib.h"
+#include "mmo_segment.h"
+#include "mmo_copy.h"
+#include "mmo_rtree.h"
+#include "mmo_parallel.h"
+#include "mmo_offset.h"
+#include "mmo_stream.h"
+#include "mmo_net.h"
+#include "mmo_verify.h"
+#include "mmo_shm.h"
+#include "mmo_schema.h"
+#include "mmo_flat_hash_map.h"
+#include "mmo_perfect_hash_map.h"
+#include "mmo_string_pool.h"
+#include "mmo_delta_vector.h"
+#include "mmo_report.h"
+#include "mmo_patch.h"
+#include "mmo_sorted_map.h"
+#include "mmo_overlay.h"
+#include <chrono>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+#include <map>
+#include <algorithm>
+#include <thread>
+
+static int          g_failed  = 0;
+static int          g_checks  = 0;
+static std::string  g_temp_dir;     //测试写出的文件都放在这个临时目录下，结束时整个删除
+
+#define MMO_CHECK(cond) \
+  do{ \
+    g_checks ++; \
+    if(!(cond)){ \
+      g_failed ++; \
+      printf("  FAILED %s:%d: %s\n",__FILE__,__LINE__,#cond); \
+    } \
+  }while(0)
+
+/**
+ * @brief 临时目录下的文件路径
+ */
+static std::string temp_path(const char* name)
+{
+  return g_temp_dir + "/" + name;
+}
+
+/**
+ * @brief 临时目录下的文件个数
+ */
+static size_t count_temp_files()
+{
+  size_t count = 0;
+  DIR*   dir   = opendir(g_temp_dir.c_str());
+  if(dir == NULL)
+    return 0;
+  while(struct dirent* entry = readdir(dir))
+  {
+    if(strcmp(entry->d_name,".") != 0 && strcmp(entry->d_name,"..") != 0)
+      count ++;
+  }
+  closedir(dir);
+  return count;
+}
+
+/**
+ * @brief 删除临时目录及其中的文件，测试中途失败留下的文件也一并清理
+ */
+static void remove_temp_dir()
+{
+  DIR* dir = opendir(g_temp_dir.c_str());
+  if(dir == NULL)
+    return;
+  while(struct dirent* entry = readdir(dir))
+  {
+    if(strcmp(entry->d_name,".") != 0 && strcmp(entry->d_name,"..") != 0)
+      unlink(temp_path(entry->d_name).c_str());
+  }
+  closedir(dir);
+  rmdir(g_temp_dir.c_str());
+}
+
+typedef mmo::hash_map<int32_t,int32_t,int32_t>  IntMap;
+
+class CInner
+{
+public:
+  IntMap    m_map;
+public:
+  void  mmo_copy(const CInner& src,mmo::copier& copy){copy(m_map,src.m_map);}
+};
+
+class COuter
+{
+public:
+  mmo::vector<CInner,int32_t>   m_items;
+public:
+  void  mmo_copy(const COuter& src,mmo::copier& copy){copy(m_items,src.m_items);}
+};
+
+/**
+ * @brief 同一线程反复测量同一构造过程，结果不变且与正式构造的字节数相同
+ *        vector 的元素含容器头，测量段复用时不能读到上一次残留的内容
+ */
+static void test_measure_repeat()
+{
+  mmo::growable_segment source;
+  COuter* outer = mmo::construct<COuter>(source);
+  outer->m_items.resize(3,source);
+  for(int32_t i = 0;i < 3;i++)
+  {
+    outer->m_items[i].m_map.init_hash(8,source);
+    for(int32_t k = 0;k < 8;k++)
+      outer->m_items[i].m_map.insert(k,k * i,source);
+  }
+
+  auto build = [outer](mmo::segment_manager& segment){mmo::clone(*outer,segment);};
+  size_t first  = mmo::measure(build);
+  size_t second = mmo::measure(build);
+  size_t third  = mmo::measure(build);
+  MMO_CHECK(first == second);
+  MMO_CHECK(first == third);
+
+  std::vector<char> buf(first);
+  mmo::segment_manager segment(buf.data(),buf.size());
+  COuter* copy = mmo::clone(*outer,segment);
+  MMO_CHECK(segment.size() == first);
+  MMO_CHECK(copy->m_items.size() == 3);
+  MMO_CHECK(copy->m_items[2].m_map.size() == 8);
+  MMO_CHECK(copy->m_items[2].m_map.get(7) != NULL && *copy->m_items[2].m_map.get(7) == 14);
+}
+
+/**
+ * @brief 层数上限须覆盖 build() 接受的全部元素个数
+ */
+static void test_rtree_levels()
+{
+  typedef mmo::packed_rtree<int32_t,int32_t> Tree;
+  MMO_CHECK(Tree::level_count_for(0) == 1);
+  MMO_CHECK(Tree::level_count_for(16) == 2);
+  MMO_CHECK(Tree::level_count_for((size_t)1 << 28) == 8);
+  MMO_CHECK(Tree::level_count_for(((size_t)1 << 28) + 1) == 9);
+  MMO_CHECK(Tree::level_count_for((size_t)0xFFFFFFFFU) <= (size_t)Tree::max_levels);
+
+  std::vector<std::pair<Tree::BoxType,int32_t>> items;
+  for(int32_t i = 0;i < 5000;i++)
+    items.emplace_back(Tree::BoxType(i,i,i + 1,i + 1),i);
+  mmo::growable_segment segment;
+  Tree* tree = mmo::construct<Tree>(segment);
+  MMO_CHECK(tree->build(items,segment));
+  size_t found = 0;
+  tree->query(Tree::BoxType(100,100,199,199),[&found](const int32_t&){found ++;return true;});
+  MMO_CHECK(found == 101);
+}
+
+class CNamed
+{
+public:
+  int32_t                 m_id{0};
+  mmo::string<int32_t>    m_name;
+};
+
+/**
+ * @brief 串行追加元素后再并行追加，对齐布局下块前的填充不能破坏元素遍历
+ */
+static void test_parallel_append_after_serial()
+{
+  typedef mmo::indexed_var_vector<CNamed,int32_t> Vector;
+  mmo::growable_segment segment;
+  Vector* items = mmo::construct<Vector>(segment);
+  items->prepare_append_elements(segment);
+  auto element = items->begin_append_element(segment);
+  element->object().m_id = 1;
+  element->object().m_name.assign("a",segment);
+  items->end_append_element(element,segment);
+  mmo::parallel_append_elements(*items,100,[](size_t i,CNamed& item,mmo::segment_manager& seg)
+  {
+    item.m_id = (int32_t)i + 2;
+    item.m_name.assign(std::string(i % 7 + 1,'x') + std::to_string(i + 2),seg);
+  },segment,4);
+  items->finish_append_elements(segment);
+
+  MMO_CHECK(items->size() == 101);
+  int32_t expect = 1;
+  for(auto it = items->begin();it != items->end();++it,++expect)
+    MMO_CHECK(it->m_id == expect);
+  MMO_CHECK(expect == 102);
+  MMO_CHECK(std::string((*items)[0].m_name.c_str()) == "a");
+  MMO_CHECK(std::string((*items)[100].m_name.c_str()) == std::string(99 % 7 + 1,'x') + "101");
+}
+
+/**
+ * @brief indexed_var_vector：变长元素的下标访问与顺序遍历一致，按 m_id 二分查找的结果与 std::lower_bound/upper_bound 相同；
+ *        未生成偏移表时退化为顺序访问，结果不变
+ */
+static void test_indexed_var_vector()
+{
+  typedef mmo::indexed_var_vector<CNamed,int32_t> Vector;
+  mmo::growable_segment segment;
+  Vector* items = mmo::construct<Vector>(segment);
+  Vector* plain = mmo::construct<Vector>(segment);
+  std::vector<int32_t> ids;
+  for(int pass = 0;pass < 2;pass++)
+  {
+    Vector* vec = pass == 0 ? items : plain;
+    vec->prepare_append_elements(segment);
+    for(int32_t i = 0;i < 300;i++)
+    {
+      auto element = vec->begin_append_element(segment);
+      element->object().m_id = i * 2;
+      element->object().m_name.assign(std::string(i % 13 + 1,'n') + std::to_string(i),segment);
+      vec->end_append_element(element,segment);
+      if(pass == 0)
+        ids.push_back(i * 2);
+    }
+    if(pass == 0)
+      vec->finish_append_elements(segment);
+  }
+  MMO_CHECK(items->indexed() && !plain->indexed());
+  MMO_CHECK(items->size() == 300 && items->front().m_id == 0 && items->back().m_id == 598);
+
+  bool same = true;
+  int32_t i = 0;
+  for(auto it = items->begin();it != items->end();++it,++i)
+  {
+    std::string name = std::string(i % 13 + 1,'n') + std::to_string(i);
+    same = same && &(*items)[i] == &*it && (*items)[i].m_id == i * 2 && name == (*items)[i].m_name.c_str();
+    same = same && (*plain)[i].m_id == i * 2 && name == plain->at(i).m_name.c_str();
+  }
+  MMO_CHECK(same && i == 300);
+
+  auto less_id  = [](const CNamed& item,int32_t id){return item.m_id < id;};
+  auto id_less  = [](int32_t id,const CNamed& item){return id < item.m_id;};
+  bool bounds = true;
+  for(int32_t key = -3;key < 605;key++)
+  {
+    int32_t lower = (int32_t)(std::lower_bound(ids.begin(),ids.end(),key) - ids.begin());
+    int32_t upper = (int32_t)(std::upper_bound(ids.begin(),ids.end(),key) - ids.begin());
+    bounds = bounds && items->lower_bound(key,less_id) == lower && items->upper_bound(key,id_less) == upper;
+    bounds = bounds && plain->lower_bound(key,less_id) == lower && plain->upper_bound(key,id_less) == upper;
+  }
+  MMO_CHECK(bounds);
+}
+
+/**
+ * @brief 并行构造挂分配统计：工作线程的分配带着调用线程的调用点按原用途上报，拼接不重复计数
+ */
+static void test_parallel_tracking()
+{
+  typedef mmo::indexed_var_vector<CNamed,int32_t> Vector;
+  mmo::growable_segment segment;
+  mmo::alloc_tracker    tracker;
+  segment.set_observer(&tracker);
+  {
+    mmo::alloc_scope site("parallel_names");
+    Vector* items = mmo::construct<Vector>(segment);
+    items->prepare_append_elements(segment);
+    mmo::parallel_append_elements(*items,100,[](size_t i,CNamed& item,mmo::segment_manager& seg)
+    {
+      item.m_id = (int32_t)i;
+      item.m_name.assign(std::string(i % 5 + 1,'y'),seg);
+    },segment,4);
+    items->finish_append_elements(segment);
+    MMO_CHECK(items->size() == 100 && (*items)[99].m_id == 99);
+  }
+  segment.set_observer(nullptr);
+  mmo::alloc_tracker::stat sum = tracker.total();
+  MMO_CHECK(sum.bytes + sum.padding == segment.size());
+  bool named = true;
+  for(auto& it:tracker.sites())
+    named = named && it.first.first == "parallel_names";
+  MMO_CHECK(named);
+
+  //与串行构造的分配次数、字节数相同，拼接的各块不再计数
+  mmo::growable_segment serial;
+  mmo::alloc_tracker    expect;
+  serial.set_observer(&expect);
+  Vector* items = mmo::construct<Vector>(serial);
+  items->prepare_append_elements(serial);
+  for(int32_t i = 0;i < 100;i++)
+  {
+    auto element = items->begin_append_element(serial);
+    element->object().m_id = i;
+    element->object().m_name.assign(std::string(i % 5 + 1,'y'),serial);
+    items->end_append_element(element,serial);
+  }
+  items->finish_append_elements(serial);
+  serial.set_observer(nullptr);
+  MMO_CHECK(sum.count == expect.total().count && sum.bytes == expect.total().bytes);
+  MMO_CHECK(tracker.kind_stat(mmo::alloc_var_block).count == 0);
+}
+
+/**
+ * @brief concurrent_segment：多个线程经各自的 view 同时分配，取块很小以频繁争用；
+ *        各线程的字串内容正确、任意两段分配互不重叠且都在镜像范围内；预留后追加的 var_vector 连续可遍历
+ */
+static void test_concurrent_segment()
+{
+  typedef mmo::string<int32_t>                    String;
+  typedef mmo::var_vector<CNamed,int32_t>         Vector;
+  enum { threads = 4,strings = 2000 };
+  std::vector<char>         buffer(16 << 20);
+  mmo::concurrent_segment   arena(buffer.data(),buffer.size(),256);
+  std::vector<String*>      names[threads];
+  Vector*                   vectors[threads] = {nullptr};
+  bool                      reserved[threads] = {false};
+  std::vector<std::thread>  pool;
+  for(int t = 0;t < threads;t++)
+  {
+    pool.emplace_back([&,t]()
+    {
+      mmo::concurrent_segment::view segment(arena);
+      for(int i = 0;i < strings;i++)
+      {
+        String* name = mmo::construct<String>(segment);
+        name->assign(std::to_string(t) + ":" + std::string(i % 37,'c') + std::to_string(i),segment);
+        names[t].push_back(name);
+      }
+      auto build = [t](mmo::segment_manager& seg)
+      {
+        Vector* items = mmo::construct<Vector>(seg);
+        items->prepare_append_elements(seg);
+        for(int i = 0;i < 100;i++)
+        {
+          auto element = items->begin_append_element(seg);
+          element->object().m_id = t * 1000 + i;
+          element->object().m_name.assign(std::string(i % 9 + 1,'v'),seg);
+          items->end_append_element(element,seg);
+        }
+        return items;
+      };
+      //MMO_CHECK 的计数不是线程安全的，结果留到主线程检查
+      reserved[t] = segment.reserve(mmo::measure([&](mmo::segment_manager& seg){build(seg);}));
+      vectors[t]  = build(segment);
+    });
+  }
+  for(auto& thread:pool)
+    thread.join();
+
+  const char* first = buffer.data();
+  const char* last  = first + arena.size();
+  std::vector<std::pair<const char*,const char*>> ranges;
+  bool names_ok = true;
+  for(int t = 0;t < threads;t++)
+  {
+    for(int i = 0;i < strings;i++)
+    {
+      const String* name = names[t][i];
+      names_ok = names_ok && std::string(name->c_str()) == std::to_string(t) + ":" + std::string(i % 37,'c') + std::to_string(i);
+      ranges.push_back(std::make_pair((const char*)name,(const char*)name + sizeof(String)));
+      ranges.push_back(std::make_pair(name->c_str(),name->c_str() + name->_data_bytes()));
+    }
+  }
+  MMO_CHECK(names_ok);
+  std::sort(ranges.begin(),ranges.end());
+  bool disjoint = ranges.front().first >= first && ranges.back().second <= last;
+  for(size_t i = 1;i < ranges.size();i++)
+    disjoint = disjoint && ranges[i - 1].second <= ranges[i].first;
+  MMO_CHECK(disjoint);
+
+  bool vectors_ok = true;
+  for(int t = 0;t < threads;t++)
+  {
+    vectors_ok = vectors_ok && reserved[t];
+    int32_t expect = t * 1000;
+    for(auto it = vectors[t]->begin();it != vectors[t]->end();++it,++expect)
+      vectors_ok = vectors_ok && it->m_id == expect && it->m_name.size() == (expect - t * 1000) % 9 + 1;
+    vectors_ok = vectors_ok && expect == t * 1000 + 100;
+  }
+  MMO_CHECK(vectors_ok);
+  MMO_CHECK(arena.size() <= arena.capacity() && arena.image().size() == arena.size());
+}
+
+class CFarNode
+{
+public:
+  mmo::far_ptr<CFarNode>          m_next;
+  mmo::vector<char,int32_t>       m_payload;
+  int32_t                         m_id{0};
+public:
+  void  mmo_copy(const CFarNode& src,mmo::copier& copy)
+  {
+    copy.reserve(m_next,src.m_next);
+    copy(m_payload,src.m_payload);
+    m_id = src.m_id;
+    copy(m_next,src.m_next);
+  }
+};
+
+/**
+ * @brief 远指针：按自然顺序构造（先预留槽，再构造大成员，最后 assign），以及深拷贝远指针
+ */
+static void test_far_ptr_copy()
+{
+  mmo::growable_segment source;
+  CFarNode* head = mmo::construct<CFarNode>(source);
+  head->m_id = 1;
+  head->m_next.reserve(source);
+  head->m_payload.resize(40000,source);
+  CFarNode* tail = mmo::construct<CFarNode>(source);
+  tail->m_id = 2;
+  head->m_next.assign(tail,source);
+  MMO_CHECK(head->m_next._is_far());
+  MMO_CHECK(head->m_next.get() == tail);
+  MMO_CHECK(tail->m_next.get() == NULL);
+
+  mmo::growable_segment target;
+  CFarNode* copy = mmo::clone(*head,target);
+  MMO_CHECK(copy->m_id == 1);
+  MMO_CHECK(copy->m_payload.size() == 40000);
+  MMO_CHECK(copy->m_next._is_far());
+  MMO_CHECK(copy->m_next.get() != NULL && copy->m_next->m_id == 2);
+  MMO_CHECK(copy->m_next->m_next.get() == NULL);
+
+  //未预留槽且当前位置已超出近范围时无法指向远处
+  CFarNode* lone = mmo::construct<CFarNode>(source);
+  lone->m_payload.resize(40000,source);
+  bool overflow = false;
+  try
+  {
+    lone->m_next.assign(head,source);
+  }
+  catch(const mmo::mmo_exception& e)
+  {
+    overflow = e.code() == (int32_t)mmo::mmo_exception::offset_overflow;
+  }
+  MMO_CHECK(overflow);
+
+  head->m_next.reset();
+  MMO_CHECK(head->m_next.get() == NULL && head->m_next._is_far());
+}
+
+/**
+ * @brief 流式写出：写文件时钉住区最后回写；经套接字顺序发送时钉住区作为尾部记录发出，
+ *        接收到的镜像与写文件得到的镜像逐字节相同
+ */
+static void test_stream_image()
+{
+  //根对象钉在开头，写出一批后才改；末尾再钉一个对象，结束时才定稿
+  auto build = [](mmo::stream_segment& segment)
+  {
+    CNamed* root = mmo::construct<CNamed>(segment);
+    segment.pin(root);
+    root->m_name.assign(std::string(100000,'s'),segment);
+    segment.checkpoint();
+    root->m_id = 7;
+    CNamed* tail = mmo::construct<CNamed>(segment);
+    segment.pin(tail);
+    segment.checkpoint();
+    tail->m_id = 8;
+    return root;
+  };
+  std::string path = temp_path("stream.dat");
+  mmo::stream_image(path,build,0,mmo::stream_segment::default_window_size,4096);
+
+  int fds[2];
+  MMO_CHECK(::socketpair(AF_UNIX,SOCK_STREAM,0,fds) == 0);
+  size_t      sent      = 0;
+  bool        seekable  = true;
+  std::string error;
+  std::thread sender([&]()
+  {
+    try
+    {
+      sent = mmo::send_stream_image(fds[0],[&](mmo::stream_segment& segment)
+      {
+        seekable = segment.seekable();
+        return build(segment);
+      },0,mmo::stream_segment::default_window_size,4096);
+    }
+    catch(const std::exception& e)
+    {
+      error = e.what();
+    }
+    ::close(fds[0]);
+  });
+  mmo::received_image received = mmo::receive_stream_image(fds[1]);
+  sender.join();
+  ::close(fds[1]);
+  MMO_CHECK(error.empty() && !seekable && sent == received.size());
+  MMO_CHECK(received.root<CNamed>()->m_id == 7 && received.root<CNamed>()->m_name.size() == 100000);
+  {
+    mmo::mapped_image image(path);
+    MMO_CHECK(image.root<CNamed>()->m_id == 7);
+    MMO_CHECK(image.root<CNamed>()->m_name.size() == 100000);
+    MMO_CHECK(image.size() == received.size() && image.header().root_offset == received.header().root_offset);
+    MMO_CHECK(memcmp(image.data(),received.data(),image.size()) == 0);
+  }
+  unlink(path.c_str());
+
+  //流在中途断开时接收端报 io_error
+  MMO_CHECK(::socketpair(AF_UNIX,SOCK_STREAM,0,fds) == 0);
+  uint64_t len = 16;
+  MMO_CHECK(::write(fds[0],&len,sizeof(len)) == (ssize_t)sizeof(len));
+  ::close(fds[0]);
+  bool broken = false;
+  try
+  {
+    mmo::receive_stream_image(fds[1]);
+  }
+  catch(const mmo::mmo_exception& e)
+  {
+    broken = e.code() == (int32_t)mmo::mmo_exception::io_error;
+  }
+  ::close(fds[1]);
+  MMO_CHECK(broken);
+}
+
+/**
+ * @brief 在另一线程中执行 send，当前线程执行 receive，返回 receive 的结果；出错时 error 为异常信息
+ *        接收端出错时先关闭自己一端，发送端随之失败退出，不会阻塞
+ */
+template<typename Sender,typename Receiver>
+static mmo::received_image send_receive(Sender send,Receiver receive,std::string& error)
+{
+  int fds[2];
+  mmo::received_image image;
+  if(::socketpair(AF_UNIX,SOCK_STREAM,0,fds) != 0)
+  {
+    error = "socketpair failed";
+    return image;
+  }
+  std::thread sender([&]()
+  {
+    try
+    {
+      send(fds[0]);
+    }
+    catch(...)
+    {
+      //发送端的失败由接收端的结果体现
+    }
+    ::close(fds[0]);
+  });
+  try
+  {
+    image = receive(fds[1]);
+  }
+  catch(const mmo::mmo_exception& e)
+  {
+    error = std::to_string(e.code());
+  }
+  ::close(fds[1]);
+  sender.join();
+  return image;
+}
+
+/**
+ * @brief 镜像收发：多块的可增长内存段经 sendmsg 分散发送、镜像文件经 sendfile 发送，收到的内容与原镜像逐字节相同；
+ *        布局版本不符或超出 max_bytes 的镜像以 invalid_image 拒绝
+ */
+static void test_send_receive()
+{
+  mmo::growable_segment segment;
+  CNamed* root = mmo::construct<CNamed>(segment);
+  root->m_id = 11;
+  root->m_name.assign(std::string(300000,'w'),segment);   //跨越多个提交块
+  std::vector<struct iovec> blocks;
+  segment.scatter(blocks);
+  MMO_CHECK(blocks.size() > 1);
+
+  std::string error;
+  mmo::received_image image = send_receive([&](int fd){mmo::send_image(fd,segment,root,5,mmo::send_zerocopy);},
+    [](int fd){return mmo::receive_image(fd,5);},error);
+  MMO_CHECK(error.empty() && image.is_open() && image.size() == segment.size() && image.header().layout_version == 5);
+  MMO_CHECK(memcmp(image.data(),segment.data(),segment.size()) == 0);
+  MMO_CHECK(image.root<CNamed>()->m_id == 11 && image.root<CNamed>()->m_name.size() == 300000);
+
+  std::string path = temp_path("send.dat");
+  mmo::save_image(path,segment,root,5);
+  mmo::received_image file_image = send_receive([&](int fd){mmo::send_image_file(fd,path);},
+    [](int fd){return mmo::receive_image(fd);},error);
+  MMO_CHECK(error.empty() && file_image.size() == segment.size());
+  MMO_CHECK(memcmp(file_image.data(),segment.data(),segment.size()) == 0);
+  unlink(path.c_str());
+
+  std::string invalid = std::to_string((int32_t)mmo::mmo_exception::invalid_image);
+  send_receive([&](int fd){mmo::send_image(fd,segment,root,5);},[](int fd){return mmo::receive_image(fd,6);},error);
+  MMO_CHECK(error == invalid);
+  error.clear();
+  send_receive([&](int fd){mmo::send_image(fd,segment,root,5);},[&](int fd){return mmo::receive_image(fd,5,segment.size() - 1);},error);
+  MMO_CHECK(error == invalid);
+}
+
+/**
+ * @brief hash 超出有符号 SizeType 范围的键仍落在合法的桶内；旧格式版本的镜像被拒绝
+ */
+static void test_hash_wide_keys()
+{
+  typedef mmo::hash_map<uint64_t,int32_t,int32_t> WideMap;
+  mmo::growable_segment segment;
+  WideMap* map = mmo::construct<WideMap>(segment);
+  map->init_hash(64,segment);
+  for(uint64_t i = 0;i < 64;i++)
+    map->insert(((uint64_t)1 << 31) + i * 0x9E3779B97F4A7C15ULL,(int32_t)i,segment);
+  bool all = true;
+  for(uint64_t i = 0;i < 64;i++)
+  {
+    const int32_t* v = map->get(((uint64_t)1 << 31) + i * 0x9E3779B97F4A7C15ULL);
+    all = all && v != NULL && *v == (int32_t)i;
+  }
+  MMO_CHECK(all);
+
+  std::string path = temp_path("format.dat");
+  mmo::save_image(path,segment,map);
+  {
+    FILE* fp = fopen(path.c_str(),"r+b");
+    uint16_t old_format = 1;
+    bool written = fp != NULL && fseek(fp,offsetof(mmo::image_header,format),SEEK_SET) == 0
+                && fwrite(&old_format,sizeof(old_format),1,fp) == 1;
+    written = (fp != NULL && fclose(fp) == 0) && written;
+    MMO_CHECK(written);
+  }
+  bool rejected = false;
+  try
+  {
+    mmo::mapped_image image(path);
+  }
+  catch(const mmo::mmo_exception& e)
+  {
+    rejected = e.code() == (int32_t)mmo::mmo_exception::invalid_image;
+  }
+  MMO_CHECK(rejected);
+  unlink(path.c_str());
+}
+
+/**
+ * @brief 前 count 个键批量查找的结果与找到的个数是否与逐个 get() 相同，out 之后的一项不应被写
+ */
+template<typename MapType>
+static bool same_as_get(const MapType& map,const std::vector<int32_t>& keys,size_t count)
+{
+  std::vector<const int32_t*> out(count + 1,(const int32_t*)&keys);   //多一项检查不越界写
+  size_t found  = map.get_many(keys.data(),count,out.data());
+  size_t expect = 0;
+  bool   same   = out[count] == (const int32_t*)&keys;
+  for(size_t i = 0;i < count;i++)
+  {
+    same    = same && out[i] == map.get(keys[i]);
+    expect += (map.get(keys[i]) != NULL) ? 1 : 0;
+  }
+  return same && found == expect;
+}
+
+/**
+ * @brief 批量查找与逐个 get() 的结果相同：命中与未命中混排、桶内长链、键数不是批大小 16 的整数倍
+ */
+static void test_get_many()
+{
+  typedef mmo::hash_map<int32_t,int32_t,int32_t>      HashMap;
+  typedef mmo::flat_hash_map<int32_t,int32_t,int32_t> FlatMap;
+  mmo::growable_segment segment;
+  HashMap* chained = mmo::construct<HashMap>(segment);
+  chained->init_hash(7,segment);                //桶少，链长
+  FlatMap* flat = mmo::construct<FlatMap>(segment);
+  flat->init_hash(600,segment);
+  for(int32_t i = 0;i < 500;i++)
+  {
+    chained->insert(i * 3,i,segment);
+    flat->add(i * 3,i,segment);
+  }
+  std::vector<int32_t> keys;
+  for(int32_t i = 0;i < 1003;i++)
+    keys.push_back((i * 7919) % 1600 - 50);
+  bool chained_same = true;
+  bool flat_same    = true;
+  for(size_t count:{(size_t)0,(size_t)1,(size_t)15,(size_t)16,(size_t)17,(size_t)1003})
+  {
+    chained_same  = chained_same && same_as_get(*chained,keys,count);
+    flat_same     = flat_same && same_as_get(*flat,keys,count);
+  }
+  MMO_CHECK(chained_same);
+  MMO_CHECK(flat_same);
+}
+
+/**
+ * @brief sorted_map：各种元素个数（含空与满二叉树边界）下按键升序遍历，lower_bound/upper_bound/get/for_range
+ *        与 std::map 一致；重复键构造失败
+ */
+static void test_sorted_map()
+{
+  typedef mmo::sorted_map<int32_t,int32_t,int32_t> SortedMap;
+  mmo::growable_segment segment;
+  bool ordered  = true;
+  bool bounds   = true;
+  bool ranges   = true;
+  for(int32_t n:{0,1,2,3,7,8,15,16,1000})
+  {
+    std::map<int32_t,int32_t> expect;
+    for(int32_t i = 0;i < n;i++)
+      expect[(i * 7919) % (n * 5 + 1) - n] = i;   //乱序插入、间隔不等
+    SortedMap* map = mmo::construct<SortedMap>(segment);
+    MMO_CHECK(map->build(expect,segment) && map->size() == (int32_t)expect.size());
+
+    auto want = expect.begin();
+    for(auto it = map->begin();it != map->end();++it,++want)
+      ordered = ordered && want != expect.end() && it.key() == want->first && *it == want->second;
+    ordered = ordered && want == expect.end();
+
+    for(int32_t key = -n - 2;key <= n * 4 + 2;key++)
+    {
+      auto lower  = map->lower_bound(key);
+      auto upper  = map->upper_bound(key);
+      auto elower = expect.lower_bound(key);
+      auto eupper = expect.upper_bound(key);
+      bounds = bounds && (elower == expect.end() ? lower == map->end() : lower != map->end() && lower.key() == elower->first);
+      bounds = bounds && (eupper == expect.end() ? upper == map->end() : upper != map->end() && upper.key() == eupper->first);
+      const int32_t* v = map->get(key);
+      bounds = bounds && (expect.count(key) == 0 ? v == NULL && map->find(key) == map->end() : v != NULL && *v == expect[key]);
+    }
+
+    size_t  count = 0;
+    int64_t sum   = 0;
+    size_t  visited = map->for_range(-n / 2,n,[&](const int32_t& key,const int32_t& value){sum += key - value;});
+    for(auto it = expect.lower_bound(-n / 2);it != expect.end() && it->first <= n;++it,++count)
+      sum -= it->first - it->second;
+    ranges = ranges && visited == count && sum == 0;
+  }
+  MMO_CHECK(ordered);
+  MMO_CHECK(bounds);
+  MMO_CHECK(ranges);
+
+  std::vector<std::pair<int32_t,int32_t>> dup = {{3,1},{5,2},{3,3}};
+  SortedMap* map = mmo::construct<SortedMap>(segment);
+  MMO_CHECK(!map->build(dup,segment));
+}
+
+/**
+ * @brief 容器的拷贝构造被禁用后编译器仍可能把它当作可平凡拷贝，copier 不能对含相对偏移的元素按字节拷贝
+ */
+static void test_copy_relative_elements()
+{
+  typedef mmo::vector<mmo::string<int32_t>,int32_t> Names;
+  static_assert(mmo::has_relative_offset<mmo::string<int32_t>>::value,"string holds a relative offset");
+  mmo::growable_segment source;
+  Names* names = mmo::construct<Names>(source);
+  names->resize(3,source);
+  for(int32_t i = 0;i < 3;i++)
+    (*names)[i].assign("name_" + std::to_string(i),source);
+
+  mmo::growable_segment target;
+  Names* copy = mmo::clone(*names,target);
+  MMO_CHECK(copy->size() == 3);
+  bool inside = true;
+  for(int32_t i = 0;i < 3;i++)
+  {
+    const char* p = (*copy)[i].c_str();
+    inside = inside && p >= target.data() && p < target.data() + target.size();
+    MMO_CHECK(std::string(p) == "name_" + std::to_string(i));
+  }
+  MMO_CHECK(inside);
+}
+
+class CPair
+{
+public:
+  mmo::string<int32_t>    m_name;
+  int32_t                 m_id{0};
+  MMO_SCHEMA(CPair,m_name,m_id)
+};
+
+class CPairNoSchema
+{
+public:
+  mmo::string<int32_t>    m_name;
+  int32_t                 m_id{0};
+};
+
+class CPlainPoint
+{
+public:
+  int32_t   x{0};
+  int32_t   y{0};
+};
+MMO_PLAIN_DATA(CPlainPoint)
+static bool operator==(const CPlainPoint& a,const CPlainPoint& b){return a.x == b.x && a.y == b.y;}
+
+/**
+ * @brief 含容器的结构体即使被编译器视为可平凡拷贝也不算纯数据：须经 MMO_SCHEMA/钩子逐成员拷贝，
+ *        源内存段释放后副本的串内容仍完整
+ */
+static void test_copy_nested_struct()
+{
+  static_assert(!mmo::is_plain_data<CPairNoSchema>::value,"struct with a container is not plain data");
+  static_assert(mmo::is_plain_data<CPlainPoint>::value && mmo::is_plain_data<int32_t[4]>::value,"declared plain data");
+
+  typedef mmo::vector<CPair,int32_t>        Pairs;
+  typedef mmo::vector<CPlainPoint,int32_t>  Points;
+  mmo::growable_segment target;
+  Pairs*  pairs_copy  = NULL;
+  Points* points_copy = NULL;
+  {
+    mmo::growable_segment source;
+    Pairs* pairs = mmo::construct<Pairs>(source);
+    pairs->resize(4,source);
+    for(int32_t i = 0;i < 4;i++)
+    {
+      (*pairs)[i].m_id = i;
+      (*pairs)[i].m_name.assign("pair_" + std::to_string(i),source);
+    }
+    Points* points = mmo::construct<Points>(source);
+    points->resize(2,source);
+    (*points)[1].x = 5;
+    (*points)[1].y = 6;
+    pairs_copy  = mmo::clone(*pairs,target);
+    points_copy = mmo::clone(*points,target);
+  }
+  MMO_CHECK(pairs_copy->size() == 4);
+  for(int32_t i = 0;i < 4;i++)
+  {
+    MMO_CHECK((*pairs_copy)[i].m_id == i);
+    MMO_CHECK(std::string((*pairs_copy)[i].m_name.c_str()) == "pair_" + std::to_string(i));
+  }
+  MMO_CHECK(points_copy->size() == 2 && (*points_copy)[1].x == 5 && (*points_copy)[1].y == 6);
+}
+
+/**
+ * @brief 结构体成员中的串偏移被篡改到缓冲区之外时校验失败，而不是把结构体当作纯数据放过
+ */
+static void test_verify_nested_offset()
+{
+  typedef mmo::vector<CPair,int32_t> Pairs;
+  mmo::growable_segment segment;
+  Pairs* pairs = mmo::construct<Pairs>(segment);
+  pairs->resize(3,segment);
+  for(int32_t i = 0;i < 3;i++)
+    (*pairs)[i].m_name.assign("name_" + std::to_string(i),segment);
+  size_t      offset  = (char*)pairs - segment.data();
+  const char* error   = NULL;
+  MMO_CHECK(mmo::verify<Pairs>(segment.data(),segment.size(),offset,&error));
+
+  //string 布局：[m_size][m_offset]
+  int32_t far_offset = 0x10000000;
+  memcpy((char*)&(*pairs)[1].m_name + sizeof(int32_t),&far_offset,sizeof(far_offset));
+  MMO_CHECK(!mmo::verify<Pairs>(segment.data(),segment.size(),offset,&error));
+  MMO_CHECK(error != NULL && std::string(error) == "string out of range");
+}
+
+class CMaps
+{
+public:
+  mmo::flat_hash_map<int32_t,int32_t,int32_t>                   m_flat;
+  mmo::perfect_hash_map<int32_t,mmo::string<int32_t>,int32_t>   m_perfect;
+public:
+  bool  mmo_verify(mmo::verifier& verify)const{return verify(m_flat) && verify(m_perfect);}
+};
+
+/**
+ * @brief flat_hash_map / perfect_hash_map 的越界校验：完好的镜像通过，篡改控制字节、位移或值的偏移后被拒绝
+ */
+static void test_verify_hash_maps()
+{
+  mmo::growable_segment segment;
+  CMaps* maps = mmo::construct<CMaps>(segment);
+  maps->m_flat.init_hash(100,segment);
+  std::vector<int32_t> keys;
+  for(int32_t i = 0;i < 100;i++)
+  {
+    maps->m_flat.insert(i * 7,i,segment);
+    keys.push_back(i * 13);
+  }
+  MMO_CHECK(maps->m_perfect.build_keys(keys,segment));
+  for(int32_t key:keys)
+    maps->m_perfect.get(key)->assign(std::to_string(key),segment);
+
+  size_t      offset  = (char*)maps - segment.data();
+  const char* error   = NULL;
+  MMO_CHECK(mmo::verify<CMaps>(segment.data(),segment.size(),offset,&error));
+
+  int8_t* ctrl  = maps->m_flat._ctrl();
+  int8_t  saved = ctrl[20];
+  ctrl[20] = (int8_t)0xFF;
+  MMO_CHECK(!mmo::verify<CMaps>(segment.data(),segment.size(),offset,&error));
+  MMO_CHECK(error != NULL && std::string(error) == "flat_hash_map control byte invalid");
+  ctrl[20] = saved;
+  ctrl[3] ^= 0x01;
+  MMO_CHECK(!mmo::verify<CMaps>(segment.data(),segment.size(),offset,&error));
+  ctrl[3] ^= 0x01;
+
+  uint32_t* displace = (uint32_t*)maps->m_perfect._displace();
+  uint32_t  direct   = displace[0];
+  displace[0] = mmo::perfect_hash_map<int32_t,mmo::string<int32_t>,int32_t>::direct_flag | 100;
+  MMO_CHECK(!mmo::verify<CMaps>(segment.data(),segment.size(),offset,&error));
+  MMO_CHECK(error != NULL && std::string(error) == "perfect_hash_map displacement out of range");
+  displace[0] = direct;
+  MMO_CHECK(mmo::verify<CMaps>(segment.data(),segment.size(),offset,&error));
+
+  //串内容分配在槽位数组之后，截断到槽位数组末尾时值的引用越界
+  size_t slots_end = (const char*)(maps->m_perfect._slots() + keys.size()) - segment.data();
+  MMO_CHECK(!mmo::verify<CMaps>(segment.data(),slots_end,offset,&error));
+  MMO_CHECK(error != NULL && std::string(error) == "string out of range");
+}
+
+/**
+ * @brief 控制区按指定权限创建，不受 umask 影响，订阅者需要组写权限登记读者数
+ */
+static void test_shm_mode()
+{
+  std::string name = "/mmo_test_shm_" + std::to_string(getpid());
+  mmo::shm_publisher::remove(name);
+  mode_t old_mask = umask(022);
+  {
+    mmo::shm_publisher publisher(name,0660);
+    publisher.publish([](mmo::segment_manager& segment)
+    {
+      CNamed* root = mmo::construct<CNamed>(segment);
+      root->m_id = 9;
+      return (const void*)root;
+    });
+    struct stat st;
+    int fd = shm_open(name.c_str(),O_RDONLY,0);
+    MMO_CHECK(fd >= 0 && fstat(fd,&st) == 0 && (st.st_mode & 0777) == 0660);
+    close(fd);
+    fd = shm_open(mmo::shm_control::snapshot_name(name,publisher.current_version()).c_str(),O_RDONLY,0);
+    MMO_CHECK(fd >= 0 && fstat(fd,&st) == 0 && (st.st_mode & 0777) == 0660);
+    close(fd);
+
+    mmo::shm_subscriber subscriber(name);
+    mmo::shm_snapshot snapshot = subscriber.acquire();
+    MMO_CHECK(snapshot.valid() && snapshot.root<CNamed>()->m_id == 9);
+  }
+  umask(old_mask);
+  mmo::shm_publisher::remove(name);
+}
+
+/**
+ * @brief 临时文件唯一、落盘后改名：成功时目标完整、临时文件不残留；写入失败时清理临时文件并抛出 io_error
+ */
+static void test_commit_temp_file()
+{
+  std::string path = temp_path("image.dat");
+
+  mmo::growable_segment segment;
+  CNamed* root = mmo::construct<CNamed>(segment);
+  root->m_id = 3;
+  mmo::save_image(path,segment,root);
+  MMO_CHECK(count_temp_files() == 1);
+  {
+    mmo::mapped_image image(path);
+    MMO_CHECK(image.root<CNamed>()->m_id == 3);
+  }
+
+  //同一路径的两次保存各用各的临时文件
+  std::string tmp_path;
+  std::string other_path;
+  FILE* fp    = mmo::create_temp_stream(path,tmp_path);
+  FILE* other = mmo::create_temp_stream(path,other_path);
+  MMO_CHECK(tmp_path != other_path && tmp_path.compare(0,path.size(),path) == 0);
+  MMO_CHECK(fwrite("partial",7,1,other) == 1);
+  mmo::commit_temp_file(other,other_path,temp_path("other.dat"));
+  bool failed = false;
+  try
+  {
+    mmo::commit_temp_file(fp,tmp_path,path,false);
+  }
+  catch(const mmo::mmo_exception& e)
+  {
+    failed = e.code() == (int32_t)mmo::mmo_exception::io_error;
+  }
+  MMO_CHECK(failed);
+  MMO_CHECK(access(tmp_path.c_str(),F_OK) != 0);
+  MMO_CHECK(count_temp_files() == 2);
+  {
+    mmo::mapped_image image(path);
+    MMO_CHECK(image.root<CNamed>()->m_id == 3);
+  }
+  unlink(path.c_str());
+  unlink(temp_path("other.dat").c_str());
+}
+
+/**
+ * @brief flat_hash_map：命中、未命中、重复键、容量已满与遍历；桶数超出 SizeType 时抛出 offset_overflow
+ */
+static void test_flat_hash_map()
+{
+  typedef mmo::flat_hash_map<int32_t,int32_t,int32_t> FlatMap;
+  mmo::growable_segment segment;
+  FlatMap* map = mmo::construct<FlatMap>(segment);
+  MMO_CHECK(map->init_hash(1000,segment));
+  MMO_CHECK(map->hash_size() % FlatMap::group_width == 0 && map->hash_size() > 1000);
+  bool added = true;
+  for(int32_t i = 0;i < 1000;i++)
+    added = map->add(i * 3,i,segment) && added;
+  MMO_CHECK(added && map->size() == 1000);
+  MMO_CHECK(!map->add(3,-1,segment));             //重复键
+  MMO_CHECK(!map->add(100000,-1,segment));        //容量已满
+  bool hits = true;
+  bool miss = true;
+  for(int32_t i = 0;i < 1000;i++)
+  {
+    const int32_t* v = map->get(i * 3);
+    hits = hits && v != NULL && *v == i;
+    miss = miss && map->get(i * 3 + 1) == NULL && map->find(i * 3 + 2) == map->end();
+  }
+  MMO_CHECK(hits);
+  MMO_CHECK(miss);
+  MMO_CHECK((*map)[3] == 1 && (*map)[4] == 0);
+  int64_t sum   = 0;
+  size_t  count = 0;
+  for(auto it = map->begin();it != map->end();++it,++count)
+    sum += it.key() - *it * 3;
+  MMO_CHECK(count == 1000 && sum == 0);
+
+  typedef mmo::flat_hash_map<int32_t,int32_t,int16_t> SmallMap;
+  bool overflow = false;
+  try
+  {
+    SmallMap::bucket_count_for(30000);
+  }
+  catch(const mmo::mmo_exception& e)
+  {
+    overflow = e.code() == (int32_t)mmo::mmo_exception::offset_overflow;
+  }
+  MMO_CHECK(overflow);
+  MMO_CHECK(SmallMap::bucket_count_for(1000) > 1000);
+}
+
+/**
+ * @brief perfect_hash_map：每个键命中自己的值，其他键未命中；重复键在放置前即被拒绝；键数超出 SizeType 时抛出 offset_overflow
+ */
+static void test_perfect_hash_map()
+{
+  typedef mmo::perfect_hash_map<int64_t,int32_t,int32_t> PerfectMap;
+  std::vector<std::pair<int64_t,int32_t>> items;
+  for(int32_t i = 0;i < 5000;i++)
+    items.emplace_back((int64_t)i * 7919 + 11,i);
+  mmo::growable_segment segment;
+  PerfectMap* map = mmo::construct<PerfectMap>(segment);
+  MMO_CHECK(map->build(items,segment));
+  MMO_CHECK(map->size() == 5000 && map->hash_size() == PerfectMap::bucket_count_for(5000));
+  bool hits = true;
+  bool miss = true;
+  for(auto& it:items)
+  {
+    const int32_t* v = map->get(it.first);
+    hits = hits && v != NULL && *v == it.second;
+    miss = miss && map->get(it.first + 1) == NULL && map->find(-it.first) == map->end();
+  }
+  MMO_CHECK(hits);
+  MMO_CHECK(miss);
+  MMO_CHECK((*map)[items[9].first] == 9 && (*map)[3] == 0);
+
+  PerfectMap* empty = mmo::construct<PerfectMap>(segment);
+  MMO_CHECK(empty->build(std::vector<std::pair<int64_t,int32_t>>(),segment));
+  MMO_CHECK(empty->get(11) == NULL);
+
+  items.push_back(items[1234]);
+  PerfectMap* dup = mmo::construct<PerfectMap>(segment);
+  auto start = std::chrono::steady_clock::now();
+  MMO_CHECK(!dup->build(items,segment));
+  MMO_CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+
+  bool overflow = false;
+  try
+  {
+    mmo::perfect_hash_map<int32_t,int32_t,int16_t>::bucket_count_for(200000);
+  }
+  catch(const mmo::mmo_exception& e)
+  {
+    overflow = e.code() == (int32_t)mmo::mmo_exception::offset_overflow;
+  }
+  MMO_CHECK(overflow);
+}
+
+/**
+ * @brief string_pool：相同内容只存一份，共享的字串读出相同内容；intern 复用整个字串对象
+ */
+static void test_string_pool()
+{
+  typedef mmo::vector<mmo::string<int32_t>,int32_t> Names;
+  mmo::growable_segment segment;
+  mmo::string_pool<int32_t> pool;
+  Names* names = mmo::construct<Names>(segment);
+  names->resize(100,segment);
+  size_t before = segment.size();
+  bool assigned = true;
+  for(int32_t i = 0;i < 100;i++)
+    assigned = pool.assign((*names)[i],"road_name_" + std::to_string(i % 10),segment) && assigned;
+  MMO_CHECK(assigned);
+  MMO_CHECK(pool.unique_count() == 10 && pool.hits() == 90);
+  MMO_CHECK(segment.size() - before < 10 * 16 + 64);
+  bool same = true;
+  for(int32_t i = 0;i < 100;i++)
+  {
+    same = same && std::string((*names)[i].c_str()) == "road_name_" + std::to_string(i % 10);
+    same = same && (*names)[i].data() == (*names)[i % 10].data();
+  }
+  MMO_CHECK(same);
+
+  mmo::string<int32_t>* a = pool.intern("label",segment);
+  mmo::string<int32_t>* b = pool.intern("label",segment);
+  mmo::string<int32_t>* c = pool.intern("other",segment);
+  MMO_CHECK(a == b && a != c && std::string(c->c_str()) == "other");
+}
+
+/**
+ * @brief delta_vector 用的坐标点
+ */
+class CDeltaPoint
+{
+public:
+  int32_t   x{0};
+  int32_t   y{0};
+public:
+  CDeltaPoint(){}
+  CDeltaPoint(int32_t _x,int32_t _y):x(_x),y(_y){}
+  bool operator==(const CDeltaPoint& rhs)const{return x == rhs.x && y == rhs.y;}
+};
+
+/**
+ * @brief delta_vector：小差值成段（走 8 点成块解码）、大差值与极值（逐点解码）混排，
+ *        decode()/to_std() 与迭代器都还原出原始坐标；点数超出 SizeType 时抛出 offset_overflow
+ */
+static void test_delta_vector()
+{
+  typedef mmo::delta_vector<CDeltaPoint,int32_t> Points;
+  std::vector<CDeltaPoint> src;
+  int32_t x = -1000;
+  int32_t y = 5000;
+  for(int32_t i = 0;i < 1000;i++)
+  {
+    if(i % 97 < 40)
+    {
+      x += i % 7 - 3;
+      y -= i % 5;
+    }
+    else if(i % 97 < 45)
+    {
+      x += 100000;
+      y -= 70000;
+    }
+    else
+      x += 1;
+    src.emplace_back(x,y);
+  }
+  src.emplace_back(INT32_MAX,INT32_MIN);
+  src.emplace_back(INT32_MIN,INT32_MAX);
+  for(int32_t i = 0;i < 11;i++)             //结尾不足 16 字节的逐点尾段
+    src.emplace_back(i,-i);
+
+  mmo::growable_segment segment;
+  Points* points = mmo::construct<Points>(segment);
+  MMO_CHECK(points->assign(src,segment));
+  MMO_CHECK(points->size() == (int32_t)src.size() && (size_t)points->bytes() == Points::encoded_bytes(src));
+  MMO_CHECK(points->bytes() < (int32_t)(src.size() * 4));
+  std::vector<CDeltaPoint> decoded;
+  points->to_std(decoded);
+  MMO_CHECK(decoded == src);
+  std::vector<CDeltaPoint> iterated;
+  for(auto it = points->begin();it != points->end();++it)
+    iterated.push_back(*it);
+  MMO_CHECK(iterated == src);
+
+  Points* copy = mmo::construct<Points>(segment);
+  MMO_CHECK(copy->assign(*points,segment));
+  std::vector<CDeltaPoint> copied;
+  copy->to_std(copied);
+  MMO_CHECK(copied == src);
+
+  bool overflow = false;
+  try
+  {
+    mmo::delta_vector<CDeltaPoint,int16_t> small;
+    small.assign(std::vector<CDeltaPoint>(40000),segment);
+  }
+  catch(const mmo::mmo_exception& e)
+  {
+    overflow = e.code() == (int32_t)mmo::mmo_exception::offset_overflow;
+  }
+  MMO_CHECK(overflow);
+}
+
+/**
+ * @brief 各类容器都有的 MMO_SCHEMA 类
+ */
+class CSchemaRoad
+{
+public:
+  uint64_t                                m_id{0};
+  mmo::string<int32_t>                    m_name;
+  mmo::vector<CPlainPoint,int32_t>        m_coors;
+  mmo::delta_vector<CDeltaPoint,int32_t>  m_shape;
+  mmo::var_vector<CPair,int32_t>          m_lanes;
+  mmo::hash_map<int32_t,int32_t,int32_t>  m_labels;
+  mmo::offset_ptr<CPair,int32_t>          m_main;
+  MMO_SCHEMA(CSchemaRoad,m_id,m_name,m_coors,m_shape,m_lanes,m_labels,m_main)
+};
+
+/**
+ * @brief schema：from_std 构造后 to_std 还原出相同的标准库数据，predict_bytes 与实际构造的字节数（含对齐）相同
+ */
+static void test_schema_round_trip()
+{
+  typedef mmo::indexed_var_vector<CSchemaRoad,int32_t> Roads;
+  mmo::std_type<Roads> src(3);
+  for(int32_t i = 0;i < 3;i++)
+  {
+    auto& road = src[i];
+    std::get<0>(road) = 1000 + i;
+    std::get<1>(road) = std::string(i * 5 + 1,'r');
+    for(int32_t k = 0;k < i * 4 + 1;k++)
+    {
+      CPlainPoint pt;
+      pt.x = k * 10;
+      pt.y = -k;
+      std::get<2>(road).push_back(pt);
+      std::get<3>(road).push_back(CDeltaPoint(k * 3 + i,k * k));
+    }
+    for(int32_t k = 0;k < i + 1;k++)
+    {
+      std::get<4>(road).push_back(std::make_tuple(std::string(k + 1,'l'),k));
+      std::get<5>(road).push_back(std::make_pair(k * 7,k + i));
+    }
+    if(i != 1)                                  //中间一条的 offset_ptr 为空
+      std::get<6>(road) = std::make_shared<mmo::std_type<CPair>>(std::string("main"),i);
+  }
+
+  size_t predicted = mmo::predict_bytes<Roads>(src);
+  mmo::growable_segment segment;
+  Roads* roads = mmo::build_from_std<Roads>(src,segment);
+  MMO_CHECK(predicted == segment.size());
+  MMO_CHECK(roads->indexed() && roads->size() == 3 && (*roads)[2].m_id == 1002);
+
+  mmo::std_type<Roads> dst = mmo::to_std(*roads);
+  bool same = dst.size() == src.size();
+  for(size_t i = 0;same && i < src.size();i++)
+  {
+    auto& a = src[i];
+    auto& b = dst[i];
+    std::sort(std::get<5>(b).begin(),std::get<5>(b).end());    //hash_map 按遍历顺序导出
+    same = std::get<0>(a) == std::get<0>(b) && std::get<1>(a) == std::get<1>(b) && std::get<2>(a) == std::get<2>(b)
+        && std::get<3>(a) == std::get<3>(b) && std::get<4>(a) == std::get<4>(b) && std::get<5>(a) == std::get<5>(b)
+        && (std::get<6>(a) ? (std::get<6>(b) && *std::get<6>(a) == *std::get<6>(b)) : !std::get<6>(b));
+  }
+  MMO_CHECK(same);
+}
+
+/**
+ * @brief 分配统计：alloc、对齐分配与 advance 都通知观察者，报告中没有未经统计的字节
+ */
+static void test_alloc_tracker()
+{
+  mmo::growable_segment segment;
+  mmo::alloc_tracker    tracker;
+  segment.set_observer(&tracker);
+  MMO_CHECK(segment.alloc(3) != NULL);
+  MMO_CHECK(segment.alloc(16,8) != NULL);
+  MMO_CHECK(segment.advance(100));
+  segment.set_observer(nullptr);
+  MMO_CHECK(segment.advance(7));
+  mmo::alloc_tracker::stat sum = tracker.total();
+  MMO_CHECK(sum.count == 3 && sum.bytes == 119 && sum.padding == 5);
+  MMO_CHECK(sum.bytes + sum.padding == segment.size() - 7);
+}
+
+/**
+ * @brief 补丁应用是否以 invalid_image 拒绝
+ */
+static bool patch_rejected(const std::vector<char>& old_data,const std::string& patch,size_t max_new_size = 0)
+{
+  try
+  {
+    mmo::growable_segment segment;
+    mmo::apply_patch(old_data.data(),old_data.size(),patch.data(),patch.size(),segment,max_new_size);
+  }
+  catch(const mmo::mmo_exception& e)
+  {
+    return e.code() == (int32_t)mmo::mmo_exception::invalid_image;
+  }
+  return false;
+}
+
+/**
+ * @brief 补丁：中间插入内容、其后偏移整体平移，补丁远小于数据且还原一致；
+ *        内容损坏、截断、基准不符、new_size 超出上限的补丁以 invalid_image 拒绝，不按伪造的 new_size 分配
+ */
+static void test_patch()
+{
+  //[256 项偏移表][256 条 16 字节记录]，新版本在第 128 条记录前插入 37 字节
+  std::vector<char> old_data;
+  std::vector<char> new_data;
+  for(int pass = 0;pass < 2;pass++)
+  {
+    std::vector<char>& data = pass == 0 ? old_data : new_data;
+    for(uint32_t i = 0;i < 256;i++)
+    {
+      uint32_t offset = i * 16 + ((pass == 1 && i >= 128) ? 37 : 0);
+      data.insert(data.end(),(const char*)&offset,(const char*)&offset + 4);
+    }
+    for(uint32_t i = 0;i < 256;i++)
+    {
+      if(pass == 1 && i == 128)
+        data.insert(data.end(),37,'+');
+      char record[16] = {0};
+      snprintf(record,sizeof(record),"record_%u",i);
+      data.insert(data.end(),record,record + 16);
+    }
+  }
+  std::string patch = mmo::make_patch(old_data.data(),old_data.size(),new_data.data(),new_data.size());
+  MMO_CHECK(patch.size() < new_data.size() / 8);
+  mmo::growable_segment segment;
+  char* out = mmo::apply_patch(old_data.data(),old_data.size(),patch.data(),patch.size(),segment);
+  MMO_CHECK(memcmp(out,new_data.data(),new_data.size()) == 0);
+
+  bool flipped = true;
+  for(size_t i = sizeof(mmo::patch_header);i < patch.size();i++)
+  {
+    std::string bad = patch;
+    bad[i] ^= 0x5a;
+    flipped = flipped && patch_rejected(old_data,bad);
+  }
+  MMO_CHECK(flipped);
+  MMO_CHECK(patch_rejected(old_data,patch.substr(0,patch.size() - 1)));
+  MMO_CHECK(patch_rejected(new_data,patch));
+  MMO_CHECK(patch_rejected(old_data,patch,new_data.size() - 1));
+  std::string huge = patch;
+  ((mmo::patch_header*)&huge[0])->new_size = (uint64_t)1 << 50;
+  MMO_CHECK(patch_rejected(old_data,huge));
+
+  //镜像文件：补丁覆盖文件头，new_size 伪造的补丁在分配前即被拒绝
+  std::string old_path = temp_path("patch_old.dat");
+  std::string new_path = temp_path("patch_new.dat");
+  for(int pass = 0;pass < 2;pass++)
+  {
+    mmo::growable_segment image;
+    CNamed* root = mmo::construct<CNamed>(image);
+    root->m_id = pass + 1;
+    root->m_name.assign(pass == 0 ? "old road" : "new road name",image);
+    mmo::save_image(pass == 0 ? old_path : new_path,image,root);
+  }
+  std::string patch_path = temp_path("patch.mmp");
+  mmo::make_patch_file(old_path,new_path,patch_path);
+  std::string out_path = temp_path("patch_out.dat");
+  mmo::apply_patch_file(old_path,patch_path,out_path);
+  {
+    mmo::mapped_image image(out_path);
+    MMO_CHECK(image.root<CNamed>()->m_id == 2 && std::string(image.root<CNamed>()->m_name.c_str()) == "new road name");
+  }
+  std::vector<char> file_patch;
+  {
+    FILE* fp = fopen(patch_path.c_str(),"rb");
+    char  buf[4096];
+    size_t n = 0;
+    while(fp != NULL && (n = fread(buf,1,sizeof(buf),fp)) > 0)
+      file_patch.insert(file_patch.end(),buf,buf + n);
+    if(fp != NULL)
+      fclose(fp);
+  }
+  ((mmo::patch_header*)file_patch.data())->new_size = (uint64_t)1 << 50;
+  bool rejected = false;
+  try
+  {
+    mmo::apply_patch_file(old_path,file_patch.data(),file_patch.size(),out_path);
+  }
+  catch(const mmo::mmo_exception& e)
+  {
+    rejected = e.code() == (int32_t)mmo::mmo_exception::invalid_image;
+  }
+  MMO_CHECK(rejected);
+  unlink(old_path.c_str());
+  unlink(new_path.c_str());
+  unlink(patch_path.c_str());
+  unlink(out_path.c_str());
+}
+
+/**
+ * @brief 覆盖层的合并内容与期望的键值是否一致：逐个 get() 与 for_each 遍历两种方式都核对
+ */
+template<typename ViewType>
+static bool same_labels(const ViewType& view,const std::map<int32_t,int32_t>& expect)
+{
+  bool same = view.size() == expect.size();
+  for(auto& it:expect)
+  {
+    const int32_t* value = view.get(it.first);
+    same = same && value != NULL && *value == it.second;
+  }
+  std::map<int32_t,int32_t> seen;
+  view.for_each([&](const int32_t& key,const int32_t& value)
+  {
+    same = same && seen.emplace(key,value).second;
+  });
+  return same && seen == expect;
+}
+
+/**
+ * @brief overlay_hash_map：覆盖层的写入与删除遮蔽基础镜像，快照不受之后写入的影响；
+ *        后台压实后换上新镜像，压实期间的写入留在新的一层中
+ */
+static void test_overlay()
+{
+  typedef mmo::hash_map<int32_t,int32_t,int32_t>          LabelMap;
+  typedef mmo::overlay_hash_map<int32_t,int32_t,int32_t>  Labels;
+  std::string path = temp_path("overlay.dat");
+  std::map<int32_t,int32_t> expect;
+  {
+    mmo::growable_segment segment;
+    LabelMap* map = mmo::construct<LabelMap>(segment);
+    map->init_hash(100,segment);
+    for(int32_t i = 0;i < 100;i++)
+    {
+      expect[i] = i * 10;
+      map->insert(i,i * 10,segment);
+    }
+    mmo::save_image(path,segment,map);
+  }
+  auto   image = std::make_shared<mmo::mapped_image>(path);
+  Labels labels(image->root<LabelMap>(),image);
+  MMO_CHECK(same_labels(labels.view(),expect));
+
+  //改写、新增、删除基础镜像中的键
+  labels.put(5,-5);
+  labels.put(200,2000);
+  labels.emplace(201,[](int32_t& value,mmo::segment_manager&){value = 2010;});
+  MMO_CHECK(labels.erase(7));
+  MMO_CHECK(!labels.erase(7) && !labels.erase(300));
+  expect[5]   = -5;
+  expect[200] = 2000;
+  expect[201] = 2010;
+  expect.erase(7);
+  MMO_CHECK(labels.get(7) == NULL && !labels.contains(7) && image->root<LabelMap>()->get(7) != NULL);
+  MMO_CHECK(*image->root<LabelMap>()->get(5) == 50);
+  MMO_CHECK(labels.layer_count() == 1 && labels.overlay_entries() == 4);
+  MMO_CHECK(same_labels(labels.view(),expect));
+
+  //快照之后的写入进入新的一层，快照看到的仍是旧内容；删除后再写入同一个键
+  Labels::ViewType frozen = labels.snapshot();
+  std::map<int32_t,int32_t> frozen_expect = expect;
+  MMO_CHECK(labels.erase(5));
+  labels.put(7,-7);
+  expect.erase(5);
+  expect[7] = -7;
+  MMO_CHECK(labels.layer_count() == 2);
+  MMO_CHECK(same_labels(frozen,frozen_expect));
+  MMO_CHECK(same_labels(labels.view(),expect));
+
+  //已有压实在进行时不能再开始；压实期间的写入留在新的一层，换上新镜像后仍可见
+  auto compact = [&path](const Labels::ViewType& merged){return mmo::compact_image(merged,path);};
+  MMO_CHECK(labels.start_compaction(compact));
+  MMO_CHECK(labels.compacting() && !labels.start_compaction(compact));
+  size_t compacted = expect.size();
+  labels.put(0,-1);
+  expect[0] = -1;
+  MMO_CHECK(labels.finish_compaction());
+  MMO_CHECK(!labels.compacting() && labels.layer_count() == 1 && labels.overlay_entries() == 1);
+  MMO_CHECK(labels.base() != image->root<LabelMap>() && (size_t)labels.base()->size() == compacted);
+  MMO_CHECK(labels.base()->get(5) == NULL && *labels.base()->get(7) == -7 && *labels.base()->get(0) == 0);
+  MMO_CHECK(same_labels(labels.view(),expect));
+  //旧镜像文件已被改名替换，快照持有的旧映射仍可读
+  MMO_CHECK(same_labels(frozen,frozen_expect));
+  unlink(path.c_str());
+}
+
+int main(int argc,char* argv[])
+{
+  char dir[] = "/tmp/mmo_test_XXXXXX";
+  if(mkdtemp(dir) == NULL)
+  {
+    printf("mkdtemp failed\n");
+    return 1;
+  }
+  g_temp_dir = dir;
+  struct
+  {
+    const char*           name;
+    std::function<void()> run;
+  } tests[] =
+  {
+    {"measure_repeat",test_measure_repeat},
+    {"rtree_levels",test_rtree_levels},
+    {"parallel_append",test_parallel_append_after_serial},
+    {"parallel_tracking",test_parallel_tracking},
+    {"indexed_var_vector",test_indexed_var_vector},
+    {"concurrent_segment",test_concurrent_segment},
+    {"far_ptr_copy",test_far_ptr_copy},
+    {"stream_image",test_stream_image},
+    {"send_receive",test_send_receive},
+    {"hash_wide_keys",test_hash_wide_keys},
+    {"get_many",test_get_many},
+    {"sorted_map",test_sorted_map},
+    {"flat_hash_map",test_flat_hash_map},
+    {"perfect_hash_map",test_perfect_hash_map},
+    {"string_pool",test_string_pool},
+    {"delta_vector",test_delta_vector},
+    {"schema_round_trip",test_schema_round_trip},
+    {"alloc_tracker",test_alloc_tracker},
+    {"copy_relative",test_copy_relative_elements},
+    {"copy_nested_struct",test_copy_nested_struct},
+    {"verify_hash_maps",test_verify_hash_maps},
+    {"verify_nested_offset",test_verify_nested_offset},
+    {"shm_mode",test_shm_mode},
+    {"commit_temp_file",test_commit_temp_file},
+    {"patch",test_patch},
+    {"overlay",test_overlay},
+  };
+  for(auto& test:tests)
+  {
+    int failed = g_failed;
+    try
+    {
+      test.run();
+    }
+    catch(const std::exception& e)
+    {
+      g_failed ++;
+      printf("  FAILED %s: exception: %s\n",test.name,e.what());
+    }
+    printf("%-24s %s\n",test.name,failed == g_failed ? "ok" : "FAILED");
+  }
+  remove_temp_dir();
+  printf("%d checks, %d failed\n",g_checks,g_failed);
+  return g_failed == 0 ? 0 : 1;
+}